@@ -1,7 +1,9 @@
 #pragma once
 
+#include <functional>
 #include <string>
 #include "third_party/nlohmann/json.hpp"
+#include "azure_openai.hpp"
 
 namespace cord19 {
 
@@ -11,14 +13,6 @@ using json = nlohmann::json;
 struct Engine;
 class StatsTracker;
 
-// Configuration for Azure OpenAI service
-struct AzureOpenAIConfig {
-    std::string endpoint;      // e.g., "https://your-resource.openai.azure.com"
-    std::string api_key;
-    std::string model;         // e.g., "gpt-5.2-chat"
-    std::string api_version = "2024-02-15-preview"; // Azure OpenAI API version
-};
-
 // Generate an AI overview of search results using Azure OpenAI with caching
 // Takes the search results JSON and returns an AI-generated overview
 // Uses Engine's AI cache to save on API costs (24hr expiry, LRU eviction)
@@ -31,4 +25,21 @@ json generate_ai_overview(const AzureOpenAIConfig& config,
                           StatsTracker* stats = nullptr,
                           bool is_authorized = false);
 
+// Receives overview text as it is generated; returns false once the client is gone
+using OverviewDeltaFn = std::function<bool(const std::string&)>;
+
+// Streaming variant of generate_ai_overview: the overview is requested with
+// "stream": true and passed to on_delta piece by piece (a cached overview, or one
+// generated for a concurrent request, arrives in one piece). Returns the same JSON
+// as generate_ai_overview, and the finished overview is cached the same way, even
+// if the client stops reading.
+json generate_ai_overview_stream(const AzureOpenAIConfig& config,
+                                 const std::string& query,
+                                 int k,
+                                 const json& search_results,
+                                 Engine* engine,
+                                 StatsTracker* stats,
+                                 bool is_authorized,
+                                 const OverviewDeltaFn& on_delta);
+
 } // namespace cord19
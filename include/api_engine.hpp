@@ -1,23 +1,94 @@
 #pragma once
 
+#include <array>
+#include <atomic>
 #include <chrono>
+#include <condition_variable>
+#include <cstdint>
 #include <filesystem>
-#include <list>
+#include <memory>
 #include <mutex>
 #include <string>
+#include <thread>
 #include <unordered_map>
 #include <vector>
 
 #include "api_autocomplete.hpp"
+#include "api_metadata.hpp"
 #include "api_types.hpp"
+#include "lru_cache.hpp"
+#include "posting_cursor.hpp"
+#include "metadata_store.hpp"
 #include "semantic_embedding.hpp"
+#include "single_flight.hpp"
 
 namespace cord19 {
 
-// Cache entry structure for LRU cache
-struct CacheEntry {
-    json result;
-    std::list<std::string>::iterator lru_iter;
+// Search response shared with the result cache (never mutated once built).
+// `body` is the compact JSON object without the "query" echo, so one body serves
+// every spelling of a normalized query; per-request fields (the caller's query,
+// timings) are spliced in before its closing brace (see splice_json_fields), so
+// a hit is a copy of bytes.
+struct SearchResult {
+    std::shared_ptr<const std::string> body;
+    std::string query;       // the query as the caller sent it (echoed as "query")
+    bool from_cache = false; // served from the response cache or shared with an identical in-flight search
+
+    // Parse the body back into a JSON tree with the query echo (for callers that inspect results)
+    json parsed() const {
+        json j = body ? json::parse(*body) : json::object();
+        j["query"] = query;
+        return j;
+    }
+};
+
+// Insert the members of `fields` into a serialized JSON object before its closing brace
+std::string splice_json_fields(const std::string& object_json, const json& fields);
+
+// Ranked hits of one normalized query, kept to Engine::SEARCH_DEPTH so that
+// any smaller k is served by slicing the front of the list.
+struct RankedHits {
+    struct Hit {
+        float s;
+        uint32_t segId;
+        uint32_t docId;
+    };
+    std::vector<Hit> hits; // best first
+    uint64_t found = 0;    // matched docs across all segments
+    json facets;           // year / journal / source counts over all matches (null unless asked for)
+};
+
+// Doc attribute filter of a search; clauses are AND-ed (see Engine::parse_filter)
+struct SearchFilter {
+    bool has_date = false;
+    int32_t day_from = INT32_MIN;      // publish day range, inclusive
+    int32_t day_to = INT32_MAX;
+    std::vector<std::string> journals; // allowed journals, case-folded (empty = any)
+    std::vector<std::string> sources;  // allowed sources, case-folded (empty = any)
+    std::string key;                   // canonical form, part of cache keys
+
+    bool empty() const { return key.empty(); }
+};
+
+// Query split into scoring terms, operators and quoted phrases
+struct ParsedQuery {
+    std::vector<std::string> terms;                // scored index terms in query order (phrase terms included)
+    std::vector<std::string> required;             // +terms and AND operands
+    std::vector<std::string> excluded;             // -terms
+    std::vector<std::vector<std::string>> phrases; // quoted runs of 2+ terms that must be adjacent
+    std::vector<std::vector<std::string>> excluded_phrases; // -"quoted" runs
+    std::string key;                               // normalized query, operators and quotes kept
+
+    // Every match contains all required and phrase terms (evaluated by intersection)
+    bool conjunctive() const { return !required.empty() || !phrases.empty(); }
+};
+
+// One query of a batch search (same parameters as /api/search)
+struct SearchRequest {
+    std::string query;
+    int k = 10;
+    SearchFilter filter;
+    bool facets = false;
 };
 
 struct Engine {
@@ -27,57 +98,161 @@ struct Engine {
 
     std::unordered_map<std::string, MetaInfo> uid_to_meta;
     fs::path metadata_csv_path;  // Path to metadata.csv for on-demand reads
+    MetadataColumns metadata_cols; // Column positions in metadata.csv
+
+    // Columnar metadata (INDEX_DIR/metadata.bin from metadataconvert).
+    // When present it replaces uid_to_meta and the CSV reads.
+    MetadataStore meta_store;
 
     // Autocomplete index built from the loaded lexicon.
     AutocompleteIndex ac;
 
+    // Journal and source names of the loaded docs (ids used by Segment::attrs).
+    // At most MAX_SOURCES sources, since each doc keeps its sources as a bitmask.
+    static constexpr uint32_t MAX_SOURCES = 32;
+    AttrValues journals;
+    AttrValues sources;
+
     // Optional semantic expansion index (classic word embeddings).
     // If no embeddings are loaded, search falls back to keyword BM25.
     SemanticIndex sem;
 
-    // Search result cache: stores up to 2600 queries with LRU eviction
-    // Key format: "query|k" (e.g., "covid|10")
-    std::unordered_map<std::string, CacheEntry> cache;
-    std::list<std::string> lru_list; // Most recently used at front
-    static constexpr size_t MAX_CACHE_SIZE = 2600;
+    // Result caches: sharded, thread-safe LRUs bounded by approximate byte size.
+    // They have their own locks, so hits never wait on `mtx`.
+    static constexpr size_t SEARCH_CACHE_BYTES = 32u << 20;
+    static constexpr size_t AI_OVERVIEW_CACHE_BYTES = 8u << 20;
+    static constexpr size_t AI_SUMMARY_CACHE_BYTES = 8u << 20;
+    static constexpr size_t RANKED_HITS_CACHE_BYTES = 8u << 20;
+    static constexpr size_t POSTING_CACHE_BYTES = 64u << 20;
+    static constexpr size_t META_CACHE_BYTES = 8u << 20;
+    static constexpr size_t FILTER_CACHE_BYTES = 16u << 20;
+
+    // Ranked lists are computed and cached at this depth (also the max k)
+    static constexpr int SEARCH_DEPTH = 100;
+
+    // Multi-term queries keep this many BM25 hits and re-rank them by term proximity
+    static constexpr int PROXIMITY_DEPTH = 2 * SEARCH_DEPTH;
+    static constexpr float PROXIMITY_WEIGHT = 0.25f;
+
+    // BM25F weights of title, abstract and body on segments with field data
+    // (BM25F_TITLE_WEIGHT / BM25F_ABSTRACT_WEIGHT / BM25F_BODY_WEIGHT, default 3 / 1.5 / 1)
+    const std::array<float, FIELD_COUNT> field_weights = field_weights_from_env();
+
+    // Journals listed per facet response (most frequent first)
+    static constexpr size_t FACET_JOURNALS = 20;
 
-    // AI overview cache: stores up to 500 AI overviews with LRU eviction
-    // Key format: "query|k" (e.g., "covid|10") - same as search cache
-    std::unordered_map<std::string, CacheEntry> ai_overview_cache;
-    std::list<std::string> ai_overview_lru_list; // Most recently used at front
-    static constexpr size_t MAX_AI_OVERVIEW_CACHE_SIZE = 500;
+    // Phrase candidates checked against positions per segment (best BM25 scores first)
+    static constexpr size_t PHRASE_VERIFY_LIMIT = 5000;
 
-    // AI summary cache: stores up to 1000 AI summaries with LRU eviction
+    // Search result cache (serialized response bodies)
+    // Key format (search_cache_key): "<normalized query>|k" with k clamped to 1..SEARCH_DEPTH,
+    // then "|filter:<SearchFilter::key>" if filtered and "|facets" if facets were asked for
+    // (e.g., "covid vaccine|10" for "COVID  the Vaccine", "covid|10|filter:date:2020-01-01..|facets")
+    // Policy comes from SEARCH_CACHE_POLICY ("tinylfu" by default, or "lru").
+    ShardedLruCache<std::string> cache{SEARCH_CACHE_BYTES, search_cache_policy()};
+
+    // Key-only replay of the search cache traffic under the other policy, so
+    // /api/stats can compare hit ratios of both policies on the same requests.
+    ShardedLruCache<std::string> cache_shadow{SEARCH_CACHE_BYTES, shadow_cache_policy()};
+
+    // Ranked hit lists behind the response cache, independent of k and of query spelling
+    // Key format: normalized query terms plus the same filter/facets suffix as the
+    // search cache (e.g., "covid vaccine" for "COVID  the Vaccine")
+    // Holds segment/doc ids, so it is cleared on reload and never persisted.
+    ShardedLruCache<RankedHits> ranked_hits_cache{RANKED_HITS_CACHE_BYTES, search_cache_policy()};
+
+    // Decoded posting lists of hot terms, shared by all queries that use them
+    // Key format: "segId:termId" (cleared on reload). Few shards, since long lists are large.
+    // A list is only admitted once df * access frequency reaches POSTING_ADMIT_SCORE,
+    // so rare terms (cheap to read) and one-off terms do not churn the cache.
+    static constexpr uint64_t POSTING_ADMIT_SCORE = 1024;
+    ShardedLruCache<PostingList> posting_cache{POSTING_CACHE_BYTES, CachePolicy::Lru, 4};
+    FrequencySketch posting_sketch{1u << 16};
+    std::mutex posting_sketch_mtx;
+
+    // Doc filter bitsets (see filter_bits), so a repeated filter is not re-evaluated per doc
+    // Key format: "segId|<SearchFilter::key>" (cleared on reload, like the attributes they read)
+    ShardedLruCache<std::vector<uint64_t>> filter_cache{FILTER_CACHE_BYTES, CachePolicy::Lru, 4};
+
+    // Parsed display metadata (no abstract) of hot docs, used without a metadata store
+    // Key format: cord_uid (cleared on reload)
+    ShardedLruCache<MetaData> meta_cache{META_CACHE_BYTES};
+
+    // AI overview cache
+    // Key format: "<normalized query>|k" with k as requested, never clamped and
+    // with no filter or facets suffix (e.g., "covid vaccine|10" for "COVID  the Vaccine")
+    ShardedLruCache<json> ai_overview_cache{AI_OVERVIEW_CACHE_BYTES};
+
+    // AI summary cache
     // Key format: "summary|cord_uid" (e.g., "summary|abc123")
-    std::unordered_map<std::string, CacheEntry> ai_summary_cache;
-    std::list<std::string> ai_summary_lru_list; // Most recently used at front
-    static constexpr size_t MAX_AI_SUMMARY_CACHE_SIZE = 1000;
+    ShardedLruCache<json> ai_summary_cache{AI_SUMMARY_CACHE_BYTES};
+
+    // In-flight tables: concurrent misses on the same key share one computation
+    // (keys as in the matching caches; a follower of a search counts as a cache hit)
+    SingleFlight<SearchResult> search_flights;
+    SingleFlight<json> ai_overview_flights;
+    SingleFlight<json> ai_summary_flights;
+
+    // Write-behind cache persistence: inserts only mark a cache dirty, and a
+    // background thread snapshots dirty caches to disk every CACHE_FLUSH_INTERVAL.
+    static constexpr std::chrono::seconds CACHE_FLUSH_INTERVAL{30};
+    std::atomic<bool> cache_dirty{false};
+    std::atomic<bool> ai_overview_cache_dirty{false};
+    std::atomic<bool> ai_summary_cache_dirty{false};
+    std::mutex cache_file_mtx; // Serializes cache file writes
 
-    // Cache persistence counters (save to disk every N updates)
-    size_t cache_updates_since_save = 0;
-    size_t ai_overview_cache_updates_since_save = 0;
-    size_t ai_summary_cache_updates_since_save = 0;
-    static constexpr size_t CACHE_SAVE_INTERVAL = 1; // Save every update for immediate persistence
+    std::thread cache_flusher;
+    std::mutex cache_flusher_mtx;
+    std::condition_variable cache_flusher_cv;
+    bool cache_flusher_stop = false;
 
     std::mutex mtx;
 
     ~Engine(); // Destructor to save caches on shutdown
     bool reload();
-    json search(const std::string& query, int k);
+    SearchResult search(const std::string& query, int k, const SearchFilter& filter = {}, bool facets = false);
+
+    // Several searches under one lock: shared terms are read once and queries are
+    // ranked in parallel. Results are in request order.
+    static constexpr size_t MAX_BATCH_QUERIES = 256;
+    std::vector<SearchResult> search_batch(const std::vector<SearchRequest>& requests);
     json suggest(const std::string& user_input, int limit);
     
+    // Per-policy hit ratios and occupancy of all result caches
+    json cache_stats_json() const;
+
+    // Metadata of one document by cord_uid (returns false if unknown)
+    bool get_metadata(const std::string& cord_uid, MetaData& out);
+
     // Public cache key generator for use by AI overview and other components
     std::string make_cache_key(const std::string& query, int k);
+
+    // Full response cache key of a search (query normalized, k clamped, filter and facets appended)
+    std::string search_cache_key(const std::string& query, int k, const SearchFilter& filter, bool facets);
+
+    // Lowercased query terms without stopwords and 1-char tokens, joined by spaces
+    // (+/- operators and "quoted phrases" of 2+ terms are kept)
+    static std::string normalize_query(const std::string& query);
+
+    // Query syntax: words are OR-ed and BM25-scored; +word must occur, -word must
+    // not, `a AND b` requires both operands, and "quoted words" must be adjacent
+    static ParsedQuery parse_query(const std::string& query);
+
+    // Filter syntax: ';'-separated clauses, e.g. "date>=2021-01;journal=Lancet|BMJ;source=PMC".
+    // Dates are YYYY, YYYY-MM or YYYY-MM-DD with =, <, <=, > or >=; names ignore case.
+    // Returns false with a message on a malformed expression.
+    static bool parse_filter(const std::string& expr, SearchFilter& out, std::string& error);
     
     // AI overview cache helpers (public for use by ai_overview module)
-    json get_ai_overview_from_cache(const std::string& cache_key);
+    std::shared_ptr<const json> get_ai_overview_from_cache(const std::string& cache_key);
     void put_ai_overview_in_cache(const std::string& cache_key, const json& result);
     
     // AI summary cache helpers (public for use by ai_summary module)
-    json get_ai_summary_from_cache(const std::string& cache_key);
+    std::shared_ptr<const json> get_ai_summary_from_cache(const std::string& cache_key);
     void put_ai_summary_in_cache(const std::string& cache_key, const json& result);
     
-    // Cache persistence (save/load to JSON files)
+    // Cache persistence (binary files; legacy JSON files are read if no binary file exists)
+    void flush_dirty_caches();
     void save_cache();
     void load_cache();
     void save_ai_overview_cache();
@@ -86,8 +261,42 @@ struct Engine {
     void load_ai_summary_cache();
     
 private:
-    json get_from_cache(const std::string& cache_key);
-    void put_in_cache(const std::string& cache_key, const json& result);
+    static CachePolicy search_cache_policy();
+    static std::array<float, FIELD_COUNT> field_weights_from_env();
+    static CachePolicy shadow_cache_policy();
+    void start_cache_flusher();
+    void stop_cache_flusher();
+    std::shared_ptr<const std::string> get_from_cache(const std::string& cache_key);
+    void put_in_cache(const std::string& cache_key, std::shared_ptr<const std::string> body);
+
+    // Posting list of a term in a segment, from posting_cache or the inverted file (caller holds `mtx`).
+    // `admit` caches the list regardless of its admission score.
+    std::shared_ptr<const PostingList> read_postings(uint32_t segId, const LexEntry& e, bool admit = false);
+    // Cursor over a term's postings (and positions) in a segment (false if the term is absent)
+    bool open_cursor(uint32_t segId, const std::string& term, PostingCursor& c);
+    // Query terms with weights, expanded by embeddings when enabled (caller holds `mtx`)
+    std::vector<std::pair<std::string, float>> weighted_terms(const std::vector<std::string>& base_terms);
+    // Fill Segment::attrs of all segments from the metadata store or CSV (caller holds `mtx`)
+    void load_doc_attrs();
+    // One bit per docId of a segment, set if the doc passes the filter
+    void filter_bits(const Segment& seg, const SearchFilter& filter, std::vector<uint64_t>& bits) const;
+    // filter_bits of a segment, from filter_cache or evaluated and cached
+    std::shared_ptr<const std::vector<uint64_t>> cached_filter_bits(uint32_t segId, const SearchFilter& filter);
+    // BM25 scores of the docs that contain every required term and no excluded one
+    // (and, given `allow`, whose bit is set)
+    void score_conjunctive(uint32_t segId, const std::vector<std::pair<std::string, float>>& qterms_w,
+                           const ParsedQuery& q, const std::vector<uint64_t>* allow,
+                           std::unordered_map<uint32_t, float>& score);
+    // Keep only scored docs that contain the phrase (or, with `exclude`, drop them)
+    void filter_phrase(uint32_t segId, const std::vector<std::string>& phrase, bool exclude,
+                       std::unordered_map<uint32_t, float>& score);
+    // Boost hits whose query terms occur close together, then re-sort them
+    void proximity_rerank(const std::vector<std::string>& terms, std::vector<RankedHits::Hit>& hits);
+    // Score all segments and keep the top SEARCH_DEPTH hits (caller holds `mtx`)
+    std::shared_ptr<const RankedHits> rank(const std::vector<std::pair<std::string, float>>& qterms_w,
+                                           const ParsedQuery& q, const SearchFilter& filter, bool facets);
+    // Build result entries with metadata for the first k hits (caller holds `mtx`)
+    json hydrate(const RankedHits& ranked, int k);
 };
 
 } // namespace cord19
\ No newline at end of file
@@ -3,6 +3,7 @@
 #include <filesystem>
 #include <string>
 #include <unordered_map>
+#include <vector>
 
 #include "api_types.hpp"
 
@@ -14,10 +15,29 @@ void load_metadata_uid_meta(
     std::unordered_map<std::string, MetaInfo>& uid_to_meta
 );
 
-// Fetch metadata for a specific cord_uid from file on-demand
-MetaData fetch_metadata(
+// Display form of an authors field: first author's surname + " et al."
+std::string first_author_et_al(const std::string& authors_raw);
+
+// Column positions in metadata.csv (-1 if absent), resolved once from the header
+struct MetadataColumns {
+    int url = -1;
+    int publish_time = -1;
+    int authors = -1;
+    int title = -1;
+    int abstract = -1;
+    int journal = -1;
+    int source = -1;
+};
+
+bool read_metadata_columns(const fs::path& metadata_csv, MetadataColumns& cols);
+
+// Fetch several rows in one pass over the file (results are in the order of `rows`).
+// Only the needed columns are parsed; the abstract is skipped unless asked for.
+std::vector<MetaData> fetch_metadata_batch(
     const fs::path& metadata_csv,
-    const MetaInfo& meta_info
+    const MetadataColumns& cols,
+    const std::vector<MetaInfo>& rows,
+    bool with_abstract
 );
 
 } // namespace cord19
@@ -13,8 +13,14 @@ void save_manifest(const fs::path& manifest_path, const std::vector<std::string>
 
 std::string seg_name(uint32_t id);
 
+// Segment names from manifest.bin (or the segments folder as fallback)
+std::vector<std::string> list_segment_names(const fs::path& index_dir);
+
 bool load_segment(const fs::path& segdir, Segment& s);
 
+// Load only docs.bin (doc lengths and cord_uids) into a segment
+bool load_segment_docs(const fs::path& segdir, Segment& s);
+
 // For /add_document (single-doc segment creation)
 void write_barrelized_index_files_single_doc(
     const fs::path& segdir,
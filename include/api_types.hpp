@@ -4,10 +4,16 @@
 #include <fstream>
 #include <mutex>
 #include <string>
+#include <string_view>
+#include <type_traits>
 #include <unordered_map>
 #include <vector>
 
 #include "barrels.hpp"
+#include "doc_attrs.hpp"
+#include "fields.hpp"
+#include "mmap_file.hpp"
+#include "positions.hpp"
 #include "third_party/nlohmann/json.hpp"
 
 namespace cord19 {
@@ -15,10 +21,14 @@ namespace cord19 {
 namespace fs = std::filesystem;
 using json = nlohmann::json;
 
+// Row id for documents that are not in the metadata store
+static constexpr uint32_t NO_META_ROW = UINT32_MAX;
+
 struct DocInfo {
-    std::string cord_uid;  // Kept for matching with metadata index
-    uint32_t doc_len = 0;  // Needed for BM25 scoring
+    uint32_t meta_row = NO_META_ROW; // Row in the metadata store, resolved at load time
+    uint32_t doc_len = 0;            // Needed for BM25 scoring
 };
+static_assert(std::is_trivially_copyable<DocInfo>::value, "DocInfo must stay a plain record");
 
 struct LexEntry {
     uint32_t termId = 0;
@@ -28,6 +38,28 @@ struct LexEntry {
     uint32_t barrelId = 0; // used only when barrels enabled
 };
 
+// One (docId, tf) pair as stored in inverted files
+struct Posting {
+    uint32_t docId = 0;
+    uint32_t tf = 0;
+};
+static_assert(sizeof(Posting) == 8, "Posting must match the on-disk layout");
+
+// Decoded posting list of one term in one segment
+struct PostingList {
+    std::vector<Posting> postings;
+    std::vector<uint16_t> field_tfs; // pack_field_tf() per posting (segments with field data only)
+
+    size_t bytes() const { return postings.size() * sizeof(Posting) + field_tfs.size() * sizeof(uint16_t); }
+};
+
+// Title and abstract length of one doc in index terms, as stored in fields.bin
+struct FieldLens {
+    uint32_t title = 0;
+    uint32_t abstract = 0;
+};
+static_assert(sizeof(FieldLens) == 8, "FieldLens must match the on-disk layout");
+
 // Store byte positions in metadata.csv file for on-demand loading
 struct MetaInfo {
     uint64_t file_offset = 0;  // Byte position where this row starts in metadata.csv
@@ -41,6 +73,8 @@ struct MetaData {
     std::string author;       // display: "Smith et al."
     std::string title;
     std::string abstract;
+    std::string journal;
+    std::string source;       // "; "-separated source list (source_x)
 };
 
 struct Segment {
@@ -50,13 +84,37 @@ struct Segment {
     std::vector<DocInfo> docs;
     std::unordered_map<std::string, LexEntry> lex;
 
+    // cord_uids of all docs in one heap (uid_offsets has docs.size() + 1 entries)
+    std::string uid_heap;
+    std::vector<uint32_t> uid_offsets;
+
+    std::string_view cord_uid(uint32_t docId) const {
+        return std::string_view(uid_heap).substr(uid_offsets[docId], uid_offsets[docId + 1] - uid_offsets[docId]);
+    }
+
+    // Posting, position and field files are mapped and read positionally,
+    // so concurrent queries can read one segment without locking.
+
     // legacy
-    std::ifstream inv;
+    RandomAccessFile inv;
 
     // barrels
     bool use_barrels = false;
     BarrelParams barrel_params{};
-    std::vector<std::ifstream> inv_barrels;
+    std::vector<RandomAccessFile> inv_barrels;
+
+    // positions (optional, needed for phrase matching and proximity)
+    bool has_positions = false;
+    std::vector<PositionsBarrel> pos_barrels;
+
+    // per-field tfs and lengths (optional, enables BM25F)
+    bool has_fields = false;
+    std::vector<FieldLens> field_lens;
+    float avg_field_len[FIELD_COUNT] = {};
+    std::vector<RandomAccessFile> field_barrels;
+
+    // filter attributes per doc (publish date, journal, sources)
+    DocAttrs attrs;
 };
 
 } // namespace cord19
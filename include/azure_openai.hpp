@@ -0,0 +1,34 @@
+#pragma once
+
+#include <chrono>
+#include <functional>
+#include <memory>
+#include <string>
+#include "upstream_client.hpp"
+
+namespace cord19 {
+
+// Configuration for Azure OpenAI service
+struct AzureOpenAIConfig {
+    std::string endpoint;      // e.g., "https://your-resource.openai.azure.com"
+    std::string api_key;
+    std::string model;         // e.g., "gpt-5.2-chat"
+    std::string api_version = "2024-02-15-preview"; // Azure OpenAI API version
+    std::chrono::milliseconds timeout{60000};        // deadline of one call, queueing included
+
+    // Shared keep-alive connections to the endpoint (created by the server at startup)
+    std::shared_ptr<UpstreamClient> client;
+};
+
+// POST a chat completions request body to the configured deployment
+UpstreamResult azure_chat_completion(const AzureOpenAIConfig& config, const std::string& body);
+
+// Streamed chat completion ("stream": true in the body): content deltas are passed to
+// on_delta as they arrive, and the result body is reassembled into the shape of a
+// non-streamed response (or {"error": ...} if the stream sent an error event). A client
+// that stops reading (on_delta returns false) no longer receives deltas, but the
+// completion is still read to the end for the cache.
+UpstreamResult azure_chat_completion_stream(const AzureOpenAIConfig& config, const std::string& body,
+                                            const std::function<bool(const std::string&)>& on_delta);
+
+} // namespace cord19
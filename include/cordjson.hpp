@@ -2,6 +2,8 @@
 #include <filesystem>
 #include <fstream>
 #include <string>
+#include <string_view>
+#include <vector>
 #include "third_party/nlohmann/json.hpp"
 
 namespace fs = std::filesystem;
@@ -29,7 +31,16 @@ inline std::string extract_text_from_cord_json(const json& j) {
         }
     };
 
-    append_field("title");
+    // Full-text files keep the title under metadata.title; a top-level title wins
+    if (j.contains("title") && j["title"].is_string()) {
+        append_field("title");
+    } else if (j.contains("metadata") && j["metadata"].is_object()) {
+        const json& m = j["metadata"];
+        if (m.contains("title") && m["title"].is_string()) {
+            out += m["title"].get<std::string>();
+            out.push_back('\n');
+        }
+    }
 
     // Append text from section arrays
     auto append_sections = [&](const char* key) {
@@ -47,3 +58,406 @@ inline std::string extract_text_from_cord_json(const json& j) {
 
     return out;
 }
+
+// Searchable text of a CORD-19 document split by field; title + abstract + body
+// is exactly the text of extract_text_from_cord_json
+struct CordFields {
+    std::string title;    // ends with '\n' when present
+    std::string abstract; // one '\n'-terminated line per section
+    std::string body;
+};
+
+// Streaming scanner that pulls the same text as extract_text_from_cord_json
+// straight out of the raw JSON, without building a DOM.
+//
+// Only the title (top-level "title", else "metadata.title" as in CORD-19
+// full-text files), "abstract[].text" and "body_text[].text" strings are
+// decoded; everything else (bib_entries, ref_entries, spans, ...) is skipped in
+// place. The whole input is still validated like json::parse (grammar, string
+// escapes, UTF-8), so documents that fail to parse are rejected the same way.
+class CordJsonScanner {
+public:
+    explicit CordJsonScanner(std::string_view raw)
+        : p_(raw.data()), end_(raw.data() + raw.size()) {}
+
+    // Append title, abstract and body text to out (false if the JSON is invalid)
+    bool extract(std::string& out) {
+        CordFields f;
+        if (!extract(f)) return false;
+        out += f.title;
+        out += f.abstract;
+        out += f.body;
+        return true;
+    }
+
+    // Title, abstract and body text by field (false if the JSON is invalid)
+    bool extract(CordFields& out) {
+        // Skip UTF-8 BOM
+        if (end_ - p_ >= 3 && (unsigned char)p_[0] == 0xEF &&
+            (unsigned char)p_[1] == 0xBB && (unsigned char)p_[2] == 0xBF) p_ += 3;
+
+        ws();
+        if (p_ == end_) return false;
+
+        // Non-object documents parse but have no text
+        if (*p_ != '{') {
+            if (!skip_value()) return false;
+            ws();
+            return p_ == end_;
+        }
+
+        // Later duplicates of a key replace earlier ones, as in the DOM
+        std::string& title = out.title;
+        bool has_title = false;
+        std::string meta_title;
+        bool has_meta_title = false;
+
+        ++p_;
+        ws();
+        if (p_ < end_ && *p_ == '}') {
+            ++p_;
+        } else {
+            for (;;) {
+                if (!read_key()) return false;
+
+                if (key_ == "title") {
+                    has_title = (*p_ == '"');
+                    title.clear();
+                    if (!(has_title ? read_string(&title) : skip_value())) return false;
+                } else if (key_ == "metadata") {
+                    if (!read_metadata(meta_title, has_meta_title)) return false;
+                } else if (key_ == "abstract") {
+                    if (!read_sections(out.abstract)) return false;
+                } else if (key_ == "body_text") {
+                    if (!read_sections(out.body)) return false;
+                } else if (!skip_value()) {
+                    return false;
+                }
+
+                ws();
+                if (p_ == end_) return false;
+                if (*p_ == ',') { ++p_; ws(); continue; }
+                if (*p_ == '}') { ++p_; break; }
+                return false;
+            }
+        }
+
+        ws();
+        if (p_ != end_) return false;
+
+        if (!has_title && has_meta_title) {
+            title = std::move(meta_title);
+            has_title = true;
+        }
+        if (has_title) title.push_back('\n');
+        else title.clear();
+        return true;
+    }
+
+private:
+    const char* p_;
+    const char* end_;
+    std::string key_;
+    std::vector<char> stack_;
+
+    void ws() {
+        while (p_ < end_ && (*p_ == ' ' || *p_ == '\t' || *p_ == '\n' || *p_ == '\r')) ++p_;
+    }
+
+    // Read `"key" :` and stop at the value
+    bool read_key() {
+        if (p_ == end_ || *p_ != '"') return false;
+        key_.clear();
+        if (!read_string(&key_)) return false;
+        ws();
+        if (p_ == end_ || *p_ != ':') return false;
+        ++p_;
+        ws();
+        return p_ < end_;
+    }
+
+    // "metadata" object: decode its "title" string, skip the rest
+    bool read_metadata(std::string& title, bool& has_title) {
+        has_title = false;
+        title.clear();
+        if (*p_ != '{') return skip_value();
+        ++p_;
+        ws();
+        if (p_ < end_ && *p_ == '}') { ++p_; return true; }
+        for (;;) {
+            if (!read_key()) return false;
+            if (key_ == "title") {
+                has_title = (*p_ == '"');
+                title.clear();
+                if (!(has_title ? read_string(&title) : skip_value())) return false;
+            } else if (!skip_value()) {
+                return false;
+            }
+            ws();
+            if (p_ == end_) return false;
+            if (*p_ == ',') { ++p_; ws(); continue; }
+            if (*p_ == '}') { ++p_; return true; }
+            return false;
+        }
+    }
+
+    // Section array: append each element's "text" string plus a newline
+    bool read_sections(std::string& dest) {
+        dest.clear();
+        if (*p_ != '[') return skip_value();
+        ++p_;
+        ws();
+        if (p_ < end_ && *p_ == ']') { ++p_; return true; }
+
+        std::string text;
+        for (;;) {
+            if (p_ == end_) return false;
+            if (*p_ == '{') {
+                bool has_text = false;
+                ++p_;
+                ws();
+                if (p_ < end_ && *p_ == '}') {
+                    ++p_;
+                } else {
+                    for (;;) {
+                        if (!read_key()) return false;
+                        if (key_ == "text") {
+                            has_text = (*p_ == '"');
+                            text.clear();
+                            if (!(has_text ? read_string(&text) : skip_value())) return false;
+                        } else if (!skip_value()) {
+                            return false;
+                        }
+                        ws();
+                        if (p_ == end_) return false;
+                        if (*p_ == ',') { ++p_; ws(); continue; }
+                        if (*p_ == '}') { ++p_; break; }
+                        return false;
+                    }
+                }
+                if (has_text) {
+                    dest += text;
+                    dest.push_back('\n');
+                }
+            } else if (!skip_value()) {
+                return false;
+            }
+
+            ws();
+            if (p_ == end_) return false;
+            if (*p_ == ',') { ++p_; ws(); continue; }
+            if (*p_ == ']') { ++p_; return true; }
+            return false;
+        }
+    }
+
+    // Validate one value without materializing it (iterative, no recursion limit)
+    bool skip_value() {
+        stack_.clear();
+        for (;;) {
+            ws();
+            if (p_ == end_) return false;
+
+            // One value (or the opening of a container)
+            char c = *p_;
+            if (c == '{' || c == '[') {
+                ++p_;
+                ws();
+                char close = (c == '{') ? '}' : ']';
+                if (p_ < end_ && *p_ == close) {
+                    ++p_;
+                } else {
+                    stack_.push_back(close);
+                    if (c == '{' && !read_key()) return false;
+                    continue;
+                }
+            } else if (c == '"') {
+                if (!read_string(nullptr)) return false;
+            } else if (c == 't') {
+                if (!literal("true", 4)) return false;
+            } else if (c == 'f') {
+                if (!literal("false", 5)) return false;
+            } else if (c == 'n') {
+                if (!literal("null", 4)) return false;
+            } else if (!skip_number()) {
+                return false;
+            }
+
+            // Close finished containers, or move on to the next element
+            for (;;) {
+                if (stack_.empty()) return true;
+                ws();
+                if (p_ == end_) return false;
+                if (*p_ == ',') {
+                    ++p_;
+                    ws();
+                    if (stack_.back() == '}' && !read_key()) return false;
+                    break;
+                }
+                if (*p_ != stack_.back()) return false;
+                ++p_;
+                stack_.pop_back();
+            }
+        }
+    }
+
+    bool literal(const char* word, size_t n) {
+        if ((size_t)(end_ - p_) < n || std::string_view(p_, n) != std::string_view(word, n)) return false;
+        p_ += n;
+        return true;
+    }
+
+    static bool is_digit(char c) { return c >= '0' && c <= '9'; }
+
+    // -?(0|[1-9][0-9]*)(.[0-9]+)?([eE][+-]?[0-9]+)?
+    bool skip_number() {
+        if (p_ < end_ && *p_ == '-') ++p_;
+        if (p_ == end_ || !is_digit(*p_)) return false;
+        if (*p_ == '0') ++p_;
+        else while (p_ < end_ && is_digit(*p_)) ++p_;
+
+        if (p_ < end_ && *p_ == '.') {
+            ++p_;
+            if (p_ == end_ || !is_digit(*p_)) return false;
+            while (p_ < end_ && is_digit(*p_)) ++p_;
+        }
+        if (p_ < end_ && (*p_ == 'e' || *p_ == 'E')) {
+            ++p_;
+            if (p_ < end_ && (*p_ == '+' || *p_ == '-')) ++p_;
+            if (p_ == end_ || !is_digit(*p_)) return false;
+            while (p_ < end_ && is_digit(*p_)) ++p_;
+        }
+        return true;
+    }
+
+    bool read_hex4(uint32_t& v) {
+        if (end_ - p_ < 4) return false;
+        v = 0;
+        for (int i = 0; i < 4; i++) {
+            char c = *p_++;
+            v <<= 4;
+            if (c >= '0' && c <= '9') v |= (uint32_t)(c - '0');
+            else if (c >= 'a' && c <= 'f') v |= (uint32_t)(c - 'a' + 10);
+            else if (c >= 'A' && c <= 'F') v |= (uint32_t)(c - 'A' + 10);
+            else return false;
+        }
+        return true;
+    }
+
+    static void append_utf8(std::string& out, uint32_t cp) {
+        if (cp < 0x80) {
+            out.push_back((char)cp);
+        } else if (cp < 0x800) {
+            out.push_back((char)(0xC0 | (cp >> 6)));
+            out.push_back((char)(0x80 | (cp & 0x3F)));
+        } else if (cp < 0x10000) {
+            out.push_back((char)(0xE0 | (cp >> 12)));
+            out.push_back((char)(0x80 | ((cp >> 6) & 0x3F)));
+            out.push_back((char)(0x80 | (cp & 0x3F)));
+        } else {
+            out.push_back((char)(0xF0 | (cp >> 18)));
+            out.push_back((char)(0x80 | ((cp >> 12) & 0x3F)));
+            out.push_back((char)(0x80 | ((cp >> 6) & 0x3F)));
+            out.push_back((char)(0x80 | (cp & 0x3F)));
+        }
+    }
+
+    // Length of a well-formed UTF-8 sequence at p_ (0 if ill-formed)
+    size_t utf8_len() const {
+        auto cont = [&](size_t i, unsigned char lo, unsigned char hi) {
+            if ((size_t)(end_ - p_) <= i) return false;
+            unsigned char b = (unsigned char)p_[i];
+            return b >= lo && b <= hi;
+        };
+        unsigned char c = (unsigned char)*p_;
+        if (c >= 0xC2 && c <= 0xDF) return cont(1, 0x80, 0xBF) ? 2 : 0;
+        if (c == 0xE0) return cont(1, 0xA0, 0xBF) && cont(2, 0x80, 0xBF) ? 3 : 0;
+        if ((c >= 0xE1 && c <= 0xEC) || c == 0xEE || c == 0xEF)
+            return cont(1, 0x80, 0xBF) && cont(2, 0x80, 0xBF) ? 3 : 0;
+        if (c == 0xED) return cont(1, 0x80, 0x9F) && cont(2, 0x80, 0xBF) ? 3 : 0;
+        if (c == 0xF0) return cont(1, 0x90, 0xBF) && cont(2, 0x80, 0xBF) && cont(3, 0x80, 0xBF) ? 4 : 0;
+        if (c >= 0xF1 && c <= 0xF3)
+            return cont(1, 0x80, 0xBF) && cont(2, 0x80, 0xBF) && cont(3, 0x80, 0xBF) ? 4 : 0;
+        if (c == 0xF4) return cont(1, 0x80, 0x8F) && cont(2, 0x80, 0xBF) && cont(3, 0x80, 0xBF) ? 4 : 0;
+        return 0;
+    }
+
+    // Validate a string at p_ and decode it into out (if given)
+    bool read_string(std::string* out) {
+        ++p_; // opening quote
+        for (;;) {
+            // Copy plain ASCII runs in one go
+            const char* run = p_;
+            while (p_ < end_) {
+                unsigned char c = (unsigned char)*p_;
+                if (c < 0x20 || c >= 0x80 || c == '"' || c == '\\') break;
+                ++p_;
+            }
+            if (out && p_ > run) out->append(run, (size_t)(p_ - run));
+            if (p_ == end_) return false;
+
+            unsigned char c = (unsigned char)*p_;
+            if (c == '"') { ++p_; return true; }
+            if (c < 0x20) return false;
+
+            if (c >= 0x80) {
+                size_t n = utf8_len();
+                if (n == 0) return false;
+                if (out) out->append(p_, n);
+                p_ += n;
+                continue;
+            }
+
+            // Escape sequence
+            if (++p_ == end_) return false;
+            char e = *p_++;
+            char simple = 0;
+            switch (e) {
+                case '"':  simple = '"'; break;
+                case '\\': simple = '\\'; break;
+                case '/':  simple = '/'; break;
+                case 'b':  simple = '\b'; break;
+                case 'f':  simple = '\f'; break;
+                case 'n':  simple = '\n'; break;
+                case 'r':  simple = '\r'; break;
+                case 't':  simple = '\t'; break;
+                case 'u': {
+                    uint32_t cp;
+                    if (!read_hex4(cp)) return false;
+                    if (cp >= 0xDC00 && cp <= 0xDFFF) return false;
+                    if (cp >= 0xD800 && cp <= 0xDBFF) {
+                        // High surrogate must be followed by a low one
+                        uint32_t lo;
+                        if (end_ - p_ < 2 || p_[0] != '\\' || p_[1] != 'u') return false;
+                        p_ += 2;
+                        if (!read_hex4(lo) || lo < 0xDC00 || lo > 0xDFFF) return false;
+                        cp = 0x10000 + ((cp - 0xD800) << 10) + (lo - 0xDC00);
+                    }
+                    if (out) append_utf8(*out, cp);
+                    continue;
+                }
+                default:
+                    return false;
+            }
+            if (out) out->push_back(simple);
+        }
+    }
+};
+
+// Extract searchable text straight from raw CORD-19 JSON (false if it does not parse)
+inline bool extract_text_from_cord_raw(std::string_view raw, std::string& out) {
+    out.clear();
+    CordJsonScanner scanner(raw);
+    if (scanner.extract(out)) return true;
+    out.clear();
+    return false;
+}
+
+// Same, keeping title, abstract and body apart
+inline bool extract_fields_from_cord_raw(std::string_view raw, CordFields& out) {
+    out = CordFields{};
+    CordJsonScanner scanner(raw);
+    if (scanner.extract(out)) return true;
+    out = CordFields{};
+    return false;
+}
@@ -0,0 +1,140 @@
+#pragma once
+
+#include <cstdint>
+#include <cstdio>
+#include <string>
+#include <string_view>
+#include <vector>
+
+#include "term_dict.hpp"
+#include "textutil.hpp"
+
+namespace cord19 {
+
+// Filter attributes of a segment's docs as dense columns aligned with docIds,
+// filled from metadata at reload (see Engine::load_doc_attrs)
+struct DocAttrs {
+    static constexpr int32_t NO_DAY = INT32_MIN;
+    static constexpr uint32_t NO_VALUE = UINT32_MAX;
+
+    std::vector<int32_t> publish_day; // days since 1970-01-01 (NO_DAY if unknown)
+    std::vector<uint32_t> journal;    // id in Engine::journals (NO_VALUE if unknown)
+    std::vector<uint32_t> sources;    // bit i set if the doc is listed under source id i
+
+    size_t size() const { return publish_day.size(); }
+};
+
+// Distinct values of a string attribute (journal, source). Lookups ignore
+// case and surrounding spaces; the first spelling is kept for display.
+class AttrValues {
+public:
+    uint32_t intern(std::string_view v) {
+        bool inserted;
+        uint32_t id = ids_.intern(fold(v), inserted);
+        if (inserted) names_.emplace_back(trim(v));
+        return id;
+    }
+
+    bool find(std::string_view v, uint32_t& id) const { return ids_.find(fold(v), id); }
+
+    const std::string& name(uint32_t id) const { return names_[id]; }
+    uint32_t size() const { return ids_.size(); }
+
+    void clear() {
+        ids_.clear();
+        names_.clear();
+    }
+
+    static std::string_view trim(std::string_view v) {
+        while (!v.empty() && (unsigned char)v.front() <= ' ') v.remove_prefix(1);
+        while (!v.empty() && (unsigned char)v.back() <= ' ') v.remove_suffix(1);
+        return v;
+    }
+
+    static std::string fold(std::string_view v) { return to_lower_ascii(std::string(trim(v))); }
+
+private:
+    TermDict ids_;
+    std::vector<std::string> names_;
+};
+
+// Days since 1970-01-01 of a proleptic Gregorian date
+inline int32_t days_from_civil(int32_t y, uint32_t m, uint32_t d) {
+    y -= m <= 2;
+    const int32_t era = (y >= 0 ? y : y - 399) / 400;
+    const uint32_t yoe = (uint32_t)(y - era * 400);
+    const uint32_t doy = (153 * (m + (m > 2 ? -3 : 9)) + 2) / 5 + d - 1;
+    const uint32_t doe = yoe * 365 + yoe / 4 - yoe / 100 + doy;
+    return era * 146097 + (int32_t)doe - 719468;
+}
+
+// Calendar date of a day number from days_from_civil
+inline void civil_from_days(int32_t z, int32_t& y, uint32_t& m, uint32_t& d) {
+    z += 719468;
+    const int32_t era = (z >= 0 ? z : z - 146096) / 146097;
+    const uint32_t doe = (uint32_t)(z - era * 146097);
+    const uint32_t yoe = (doe - doe / 1460 + doe / 36524 - doe / 146096) / 365;
+    const uint32_t doy = doe - (365 * yoe + yoe / 4 - yoe / 100);
+    const uint32_t mp = (5 * doy + 2) / 153;
+    d = doy - (153 * mp + 2) / 5 + 1;
+    m = mp < 10 ? mp + 3 : mp - 9;
+    y = (int32_t)yoe + era * 400 + (m <= 2 ? 1 : 0);
+}
+
+inline int32_t year_of_day(int32_t z) {
+    int32_t y;
+    uint32_t m, d;
+    civil_from_days(z, y, m, d);
+    return y;
+}
+
+// "YYYY-MM-DD" of a day number
+inline std::string format_day(int32_t z) {
+    int32_t y;
+    uint32_t m, d;
+    civil_from_days(z, y, m, d);
+    char buf[32]; // room for any int32 year, so the output is never truncated
+    std::snprintf(buf, sizeof(buf), "%04d-%02u-%02u", (int)y, m, d);
+    return buf;
+}
+
+// First and last day of a "YYYY", "YYYY-MM" or "YYYY-MM-DD" period (false if malformed)
+inline bool parse_date_period(std::string_view s, int32_t& first, int32_t& last) {
+    s = AttrValues::trim(s);
+    auto num = [&](size_t pos, size_t len, uint32_t& out) {
+        if (pos + len > s.size()) return false;
+        out = 0;
+        for (size_t i = pos; i < pos + len; i++) {
+            if (s[i] < '0' || s[i] > '9') return false;
+            out = out * 10 + (uint32_t)(s[i] - '0');
+        }
+        return true;
+    };
+
+    uint32_t y, m = 0, d = 0;
+    if (!num(0, 4, y)) return false;
+    if (s.size() == 4) {
+        first = days_from_civil((int32_t)y, 1, 1);
+        last = days_from_civil((int32_t)y + 1, 1, 1) - 1;
+        return true;
+    }
+    if (s[4] != '-' || !num(5, 2, m) || m < 1 || m > 12) return false;
+    int32_t month_start = days_from_civil((int32_t)y, m, 1);
+    int32_t next_month = (m == 12) ? days_from_civil((int32_t)y + 1, 1, 1) : days_from_civil((int32_t)y, m + 1, 1);
+    if (s.size() == 7) {
+        first = month_start;
+        last = next_month - 1;
+        return true;
+    }
+    if (s.size() != 10 || s[7] != '-' || !num(8, 2, d) || d < 1 || month_start + (int32_t)d > next_month) return false;
+    first = last = month_start + (int32_t)d - 1;
+    return true;
+}
+
+// Day of a metadata publish_time (partial dates count from the start of the period)
+inline int32_t parse_publish_day(std::string_view s) {
+    int32_t first, last;
+    return parse_date_period(s, first, last) ? first : DocAttrs::NO_DAY;
+}
+
+} // namespace cord19
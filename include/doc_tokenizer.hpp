@@ -0,0 +1,155 @@
+#pragma once
+#include <algorithm>
+#include <string>
+#include <string_view>
+#include <utility>
+#include <vector>
+
+#include "cordjson.hpp"
+#include "fields.hpp"
+#include "positions.hpp"
+#include "term_dict.hpp"
+#include "textutil.hpp"
+
+// Field-aware tokenization of one CORD-19 JSON document, shared by every
+// segment builder so all segments carry the same postings, positions and
+// field tfs for the same text.
+
+// What tokenize_document records besides term frequencies
+struct TokenizeOptions {
+    bool positions = true;
+    bool fields = true;
+    bool abstract_only = false; // index title and abstract, skip the body
+};
+
+// Buffers reused across documents (one per thread)
+struct TokenizeScratch {
+    TermCounter tf;
+    TokenBuffer tokbuf;
+    std::vector<uint32_t> ids;  // termId of each index token
+    std::vector<uint32_t> next; // termId -> next free slot in TokenizedDoc::positions
+    std::vector<uint32_t> slot; // termId -> index in TokenizedDoc::postings
+    std::vector<uint32_t> field_counts;
+};
+
+// One tokenized document; termIds come from the dictionary it was tokenized against
+struct TokenizedDoc {
+    std::vector<std::pair<uint32_t, uint32_t>> postings; // (termId, tf) in first-occurrence order
+    std::vector<uint32_t> positions;                     // each posting's tf positions, in postings order
+    std::vector<uint16_t> field_tfs;                     // each posting's packed title/abstract tfs
+    uint32_t doc_len = 0;
+    uint32_t title_len = 0;
+    uint32_t abstract_len = 0;
+};
+
+// Extract and tokenize one document against `terms`, title, abstract and body in
+// that order. JSON without a title falls back to fallback_title. Terms first
+// interned by this doc are appended to new_terms if given. Returns false if the
+// JSON is unreadable or has no index terms.
+inline bool tokenize_document(std::string_view raw,
+                              const std::string& fallback_title,
+                              TermDict& terms,
+                              TokenizeScratch& ws,
+                              const TokenizeOptions& opt,
+                              TokenizedDoc& out,
+                              std::vector<std::string_view>* new_terms = nullptr) {
+    out = TokenizedDoc{};
+
+    // Extract text by field without building a JSON DOM
+    CordFields fields;
+    if (!extract_fields_from_cord_raw(raw, fields)) return false;
+    if (opt.abstract_only) fields.body.clear();
+    if (fields.title.empty() && !fallback_title.empty()) fields.title = fallback_title + '\n';
+
+    // Count term frequencies, remembering terms the dictionary has not seen yet.
+    // Fields are tokenized in text order, so token ordinals run across them.
+    TermCounter& tf = ws.tf;
+    tf.clear();
+    ws.ids.clear();
+    const bool keep_ids = opt.positions || opt.fields;
+    uint32_t doc_len = 0;
+    uint32_t field_end[FIELD_COUNT];
+    const std::string* field_text[FIELD_COUNT] = {&fields.title, &fields.abstract, &fields.body};
+    for (uint32_t f = 0; f < FIELD_COUNT; f++) {
+        for (auto t : tokenize(*field_text[f], ws.tokbuf)) {
+            if (!is_index_term(t)) continue;
+            bool inserted;
+            uint32_t id = terms.intern(t, inserted);
+            if (inserted && new_terms) new_terms->push_back(terms.term(id));
+            tf.add(id);
+            if (keep_ids) ws.ids.push_back(id);
+            doc_len += 1;
+        }
+        field_end[f] = doc_len;
+    }
+    if (doc_len == 0) return false;
+
+    out.postings.reserve(tf.ids().size());
+    for (uint32_t id : tf.ids())
+        out.postings.push_back({id, tf.count(id)});
+
+    // Title and abstract tfs of each posting (the body has the rest)
+    if (opt.fields) {
+        if (ws.slot.size() < terms.size()) ws.slot.resize(terms.size());
+        for (uint32_t i = 0; i < (uint32_t)out.postings.size(); i++) ws.slot[out.postings[i].first] = i;
+        ws.field_counts.assign(out.postings.size() * 2, 0);
+        for (uint32_t i = 0; i < field_end[FIELD_ABSTRACT]; i++)
+            ws.field_counts[ws.slot[ws.ids[i]] * 2 + (i < field_end[FIELD_TITLE] ? 0 : 1)]++;
+        out.field_tfs.resize(out.postings.size());
+        for (size_t i = 0; i < out.postings.size(); i++)
+            out.field_tfs[i] = pack_field_tf(ws.field_counts[i * 2], ws.field_counts[i * 2 + 1]);
+        out.title_len = field_end[FIELD_TITLE];
+        out.abstract_len = field_end[FIELD_ABSTRACT] - field_end[FIELD_TITLE];
+    }
+
+    // Group token positions by term, in postings order; a token's position is its
+    // ordinal plus FIELD_POSITION_GAP for each field boundary before it
+    if (opt.positions) {
+        if (ws.next.size() < terms.size()) ws.next.resize(terms.size());
+        uint32_t at = 0;
+        for (auto& [id, cnt] : out.postings) {
+            ws.next[id] = at;
+            at += cnt;
+        }
+        out.positions.resize(doc_len);
+        uint32_t f = 0;
+        for (uint32_t i = 0; i < doc_len; i++) {
+            while (i >= field_end[f]) f++;
+            out.positions[ws.next[ws.ids[i]]++] = i + f * FIELD_POSITION_GAP;
+        }
+    }
+
+    out.doc_len = doc_len;
+    return true;
+}
+
+// Postings of a tokenized doc ordered by termId, as SpimiWriter::add_document takes
+// them: termIds mapped through xlat if given, positions encoded with encode_positions
+// and field tfs in the same order
+inline void sorted_postings(const TokenizedDoc& d,
+                            const std::vector<uint32_t>* xlat,
+                            const TokenizeOptions& opt,
+                            std::vector<std::pair<uint32_t, uint32_t>>& postings,
+                            std::vector<uint8_t>& positions,
+                            std::vector<uint16_t>& field_tfs) {
+    auto id_of = [&](uint32_t i) { return xlat ? (*xlat)[d.postings[i].first] : d.postings[i].first; };
+
+    std::vector<uint32_t> order(d.postings.size());
+    std::vector<uint32_t> pos_start(d.postings.size());
+    for (uint32_t i = 0, at = 0; i < (uint32_t)order.size(); i++) {
+        order[i] = i;
+        pos_start[i] = at;
+        at += d.postings[i].second;
+    }
+    std::sort(order.begin(), order.end(), [&](uint32_t a, uint32_t b) { return id_of(a) < id_of(b); });
+
+    postings.clear();
+    positions.clear();
+    field_tfs.clear();
+    postings.reserve(order.size());
+    for (uint32_t i : order) {
+        postings.push_back({id_of(i), d.postings[i].second});
+        if (opt.positions) encode_positions(&d.positions[pos_start[i]], d.postings[i].second, positions);
+        if (opt.fields) field_tfs.push_back(d.field_tfs[i]);
+    }
+}
@@ -0,0 +1,42 @@
+#pragma once
+#include <algorithm>
+#include <cstdint>
+#include <filesystem>
+#include <string>
+#include "barrels.hpp"
+
+namespace fs = std::filesystem;
+
+// Optional per-field data of a segment, used for BM25F scoring:
+//   fields.bin        magic "NSFLD001", u32 N, then per doc u32 title_len, u32 abstract_len
+//                     (index terms; the body length is doc_len minus both)
+//   fieldtf_bNNN.bin  one u16 per posting, parallel to inverted_bNNN.bin (so a posting at
+//                     inverted byte offset X has its field tfs at X / 4): low byte title tf,
+//                     high byte abstract tf, both saturating at 255. The body tf is the rest
+//                     of the posting's tf, so no tf is stored twice.
+enum DocField : uint32_t { FIELD_TITLE = 0, FIELD_ABSTRACT = 1, FIELD_BODY = 2, FIELD_COUNT = 3 };
+static constexpr char FIELDS_MAGIC[8] = {'N', 'S', 'F', 'L', 'D', '0', '0', '1'};
+
+inline fs::path field_lens_path(const fs::path& segdir) {
+    return segdir / "fields.bin";
+}
+
+// Path for one field tf barrel file
+inline fs::path field_tf_barrel_path(const fs::path& segdir, uint32_t barrel_id) {
+    return segdir / ("fieldtf_b" + barrel_suffix(barrel_id) + ".bin");
+}
+
+inline bool has_fields(const fs::path& segdir) {
+    return fs::exists(field_lens_path(segdir)) && fs::exists(field_tf_barrel_path(segdir, 0));
+}
+
+inline uint16_t pack_field_tf(uint32_t title_tf, uint32_t abstract_tf) {
+    return (uint16_t)(std::min<uint32_t>(title_tf, 255) | (std::min<uint32_t>(abstract_tf, 255) << 8));
+}
+
+// Split a posting's tf into title / abstract / body tfs
+inline void unpack_field_tf(uint16_t packed, uint32_t tf, uint32_t out[FIELD_COUNT]) {
+    out[FIELD_TITLE] = std::min<uint32_t>(packed & 0xFF, tf);
+    out[FIELD_ABSTRACT] = std::min<uint32_t>(packed >> 8, tf - out[FIELD_TITLE]);
+    out[FIELD_BODY] = tf - out[FIELD_TITLE] - out[FIELD_ABSTRACT];
+}
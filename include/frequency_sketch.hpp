@@ -0,0 +1,72 @@
+#pragma once
+
+#include <algorithm>
+#include <cstddef>
+#include <cstdint>
+#include <vector>
+
+namespace cord19 {
+
+// Count-min sketch of recent access frequencies (the TinyLFU estimator).
+//
+// Four rows of small saturating counters (max 15). After a sample of
+// 10 * width increments every counter is halved, so old popularity decays
+// and the estimate tracks the recent request distribution. Not thread-safe.
+class FrequencySketch {
+public:
+    explicit FrequencySketch(size_t expected_entries = 0) { resize(expected_entries); }
+
+    // Size the table for about expected_entries distinct keys (clears all counts)
+    void resize(size_t expected_entries) {
+        size_t w = 64;
+        while (w < expected_entries && w < (size_t(1) << 24)) w <<= 1;
+        width_ = w;
+        counters_.assign(ROWS * width_, 0);
+        additions_ = 0;
+        sample_size_ = 10 * width_;
+    }
+
+    // Record one access of the key with this hash
+    void increment(uint64_t hash) {
+        bool added = false;
+        for (size_t r = 0; r < ROWS; r++) {
+            uint8_t& c = counters_[r * width_ + index_of(hash, r)];
+            if (c < MAX_COUNT) { c++; added = true; }
+        }
+        if (added && ++additions_ >= sample_size_) age();
+    }
+
+    // Estimated access count of the key with this hash (0..15)
+    uint8_t frequency(uint64_t hash) const {
+        uint8_t f = MAX_COUNT;
+        for (size_t r = 0; r < ROWS; r++)
+            f = std::min(f, counters_[r * width_ + index_of(hash, r)]);
+        return f;
+    }
+
+private:
+    static constexpr size_t ROWS = 4;
+    static constexpr uint8_t MAX_COUNT = 15;
+
+    std::vector<uint8_t> counters_;
+    size_t width_ = 0;
+    size_t additions_ = 0;
+    size_t sample_size_ = 0;
+
+    size_t index_of(uint64_t hash, size_t row) const {
+        // One multiply-shift hash per row, each with its own odd seed
+        static constexpr uint64_t SEEDS[ROWS] = {
+            0x9E3779B97F4A7C15ull, 0xC2B2AE3D27D4EB4Full,
+            0x165667B19E3779F9ull, 0xD6E8FEB86659FD93ull};
+        uint64_t h = (hash + row) * SEEDS[row];
+        return (size_t)(h >> 32) & (width_ - 1);
+    }
+
+    // Halve all counters (keeps the relative order of popular keys)
+    void age() {
+        for (auto& c : counters_) c >>= 1;
+        additions_ /= 2;
+    }
+};
+
+} // namespace cord19
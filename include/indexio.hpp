@@ -2,6 +2,7 @@
 #include <cstdint>
 #include <fstream>
 #include <string>
+#include <string_view>
 #include <vector>
 
 // Binary write helpers
@@ -15,9 +16,9 @@ inline uint64_t read_u64(std::ifstream& in) { uint64_t v; in.read((char*)&v, siz
 inline float read_f32(std::ifstream& in) { float v; in.read((char*)&v, sizeof(v)); return v; }
 
 // Write length-prefixed string
-inline void write_string(std::ofstream& out, const std::string& s) {
+inline void write_string(std::ofstream& out, std::string_view s) {
     write_u32(out, (uint32_t)s.size());
-    out.write(s.data(), s.size());
+    out.write(s.data(), (std::streamsize)s.size());
 }
 
 // Read length-prefixed string
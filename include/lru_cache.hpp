@@ -0,0 +1,297 @@
+#pragma once
+
+#include <atomic>
+#include <cstddef>
+#include <cstdint>
+#include <functional>
+#include <list>
+#include <memory>
+#include <mutex>
+#include <string>
+#include <unordered_map>
+#include <vector>
+
+#include "frequency_sketch.hpp"
+
+namespace cord19 {
+
+// Replacement policy of a ShardedLruCache
+enum class CachePolicy {
+    Lru,     // plain LRU: every insert is admitted
+    TinyLfu  // W-TinyLFU: small LRU window, then frequency-based admission into the main LRU
+};
+
+inline const char* cache_policy_name(CachePolicy p) {
+    return p == CachePolicy::TinyLfu ? "tinylfu" : "lru";
+}
+
+// Parse "lru" / "tinylfu" (returns fallback for anything else)
+inline CachePolicy parse_cache_policy(const std::string& s, CachePolicy fallback) {
+    if (s == "lru") return CachePolicy::Lru;
+    if (s == "tinylfu") return CachePolicy::TinyLfu;
+    return fallback;
+}
+
+// Counters since construction (lookups, and what happened to inserts)
+struct CacheStats {
+    uint64_t hits = 0;
+    uint64_t misses = 0;
+    uint64_t admitted = 0;  // entries that made it into the main area
+    uint64_t rejected = 0;  // TinyLFU candidates dropped in favour of the main-area victim
+    uint64_t evicted = 0;   // entries pushed out to make room
+
+    double hit_ratio() const {
+        uint64_t total = hits + misses;
+        return total ? (double)hits / (double)total : 0.0;
+    }
+};
+
+// Thread-safe LRU cache split into independently locked shards.
+//
+// Values are immutable and shared: a hit hands out a shared_ptr instead of
+// copying the value. Capacity is a byte budget; every entry is charged the
+// size passed to put() plus its key length. Recency is tracked per shard,
+// so eviction is approximately LRU across the whole cache.
+//
+// With CachePolicy::TinyLfu, new entries first go to a window holding ~1% of
+// each shard. Entries leaving the window only enter the main area if the
+// frequency sketch says they are requested more often than the main-area
+// LRU victim, so bursts of one-off keys cannot flush out popular ones.
+template <class V>
+class ShardedLruCache {
+public:
+    using Ptr = std::shared_ptr<const V>;
+
+    explicit ShardedLruCache(size_t capacity_bytes, CachePolicy policy = CachePolicy::Lru,
+                             size_t shard_count = 16)
+        : shards_(shard_count ? shard_count : 1), policy_(policy) {
+        set_capacity(capacity_bytes);
+    }
+
+    ShardedLruCache(const ShardedLruCache&) = delete;
+    ShardedLruCache& operator=(const ShardedLruCache&) = delete;
+
+    // Look up a key and mark it most recently used (nullptr if absent)
+    Ptr get(const std::string& key) {
+        uint64_t h = hash_of(key);
+        Shard& sh = shard_for(h);
+        std::lock_guard<std::mutex> lock(sh.mtx);
+        if (policy_ == CachePolicy::TinyLfu) sh.sketch.increment(h);
+
+        auto it = sh.index.find(key);
+        if (it == sh.index.end()) {
+            misses_.fetch_add(1, std::memory_order_relaxed);
+            return nullptr;
+        }
+        hits_.fetch_add(1, std::memory_order_relaxed);
+        auto& list = it->second->in_window ? sh.window : sh.lru;
+        list.splice(list.begin(), list, it->second);
+        return it->second->value;
+    }
+
+    // Insert or replace a value, evicting least recently used entries of the shard.
+    // Values larger than a shard's main area are not cached.
+    void put(const std::string& key, Ptr value, size_t charge) {
+        charge += key.size();
+        uint64_t h = hash_of(key);
+        Shard& sh = shard_for(h);
+        std::lock_guard<std::mutex> lock(sh.mtx);
+
+        auto it = sh.index.find(key);
+        if (it != sh.index.end()) remove(sh, it);
+        if (charge > sh.capacity - sh.window_capacity) return;
+
+        if (policy_ == CachePolicy::Lru) {
+            while (!sh.lru.empty() && sh.bytes + charge > sh.capacity) evict_one(sh, sh.lru);
+            sh.lru.push_front(Node{key, std::move(value), charge, h, false});
+            sh.index.emplace(key, sh.lru.begin());
+            sh.bytes += charge;
+            admitted_.fetch_add(1, std::memory_order_relaxed);
+            return;
+        }
+
+        // TinyLFU: insert into the window, then move window overflow to the main area
+        sh.window.push_front(Node{key, std::move(value), charge, h, true});
+        sh.index.emplace(key, sh.window.begin());
+        sh.bytes += charge;
+        sh.window_bytes += charge;
+        while (sh.window_bytes > sh.window_capacity && !sh.window.empty()) promote_candidate(sh);
+    }
+
+    // Remove a key (returns true if it was present)
+    bool erase(const std::string& key) {
+        Shard& sh = shard_for(hash_of(key));
+        std::lock_guard<std::mutex> lock(sh.mtx);
+        auto it = sh.index.find(key);
+        if (it == sh.index.end()) return false;
+        remove(sh, it);
+        return true;
+    }
+
+    // Drop all entries (access frequencies are kept)
+    void clear() {
+        for (auto& sh : shards_) {
+            std::lock_guard<std::mutex> lock(sh.mtx);
+            sh.lru.clear();
+            sh.window.clear();
+            sh.index.clear();
+            sh.bytes = 0;
+            sh.window_bytes = 0;
+        }
+    }
+
+    // Change the byte budget (shrinks shards immediately if needed).
+    // Each shard's budget is updated under its own lock, so this is safe
+    // while other threads use the cache.
+    void set_capacity(size_t capacity_bytes) {
+        capacity_.store(capacity_bytes, std::memory_order_relaxed);
+        size_t shard_capacity = capacity_bytes / shards_.size();
+        size_t window_capacity = (policy_ == CachePolicy::TinyLfu) ? shard_capacity / 100 : 0;
+        for (auto& sh : shards_) {
+            std::lock_guard<std::mutex> lock(sh.mtx);
+            sh.capacity = shard_capacity;
+            sh.window_capacity = window_capacity;
+            // Sketch width assumes entries of ~1 KB
+            if (policy_ == CachePolicy::TinyLfu) sh.sketch.resize(shard_capacity / 1024);
+            while (!sh.window.empty() && sh.window_bytes > sh.window_capacity) evict_one(sh, sh.window);
+            while (!sh.lru.empty() && sh.bytes > sh.capacity) evict_one(sh, sh.lru);
+        }
+    }
+
+    // Visit all entries, least recently used first within each shard.
+    // Each shard is locked while it is visited; fn must not call back into the cache.
+    void for_each(const std::function<void(const std::string&, const Ptr&)>& fn) const {
+        for (auto& sh : shards_) {
+            std::lock_guard<std::mutex> lock(sh.mtx);
+            for (auto it = sh.lru.rbegin(); it != sh.lru.rend(); ++it) fn(it->key, it->value);
+            for (auto it = sh.window.rbegin(); it != sh.window.rend(); ++it) fn(it->key, it->value);
+        }
+    }
+
+    CachePolicy policy() const { return policy_; }
+    size_t capacity() const { return capacity_.load(std::memory_order_relaxed); }
+
+    size_t size() const {
+        size_t n = 0;
+        for (auto& sh : shards_) {
+            std::lock_guard<std::mutex> lock(sh.mtx);
+            n += sh.index.size();
+        }
+        return n;
+    }
+
+    size_t bytes() const {
+        size_t n = 0;
+        for (auto& sh : shards_) {
+            std::lock_guard<std::mutex> lock(sh.mtx);
+            n += sh.bytes;
+        }
+        return n;
+    }
+
+    bool empty() const { return size() == 0; }
+
+    CacheStats stats() const {
+        CacheStats s;
+        s.hits = hits_.load(std::memory_order_relaxed);
+        s.misses = misses_.load(std::memory_order_relaxed);
+        s.admitted = admitted_.load(std::memory_order_relaxed);
+        s.rejected = rejected_.load(std::memory_order_relaxed);
+        s.evicted = evicted_.load(std::memory_order_relaxed);
+        return s;
+    }
+
+private:
+    struct Node {
+        std::string key;
+        Ptr value;
+        size_t charge = 0;
+        uint64_t hash = 0;
+        bool in_window = false;
+    };
+
+    using NodeList = std::list<Node>;
+
+    struct Shard {
+        mutable std::mutex mtx;
+        NodeList lru;    // main area, most recently used at front
+        NodeList window; // TinyLFU admission window, most recently used at front
+        std::unordered_map<std::string, typename NodeList::iterator> index;
+        FrequencySketch sketch;
+        size_t bytes = 0;        // window + main
+        size_t window_bytes = 0;
+        size_t capacity = 0;        // byte budget of window + main
+        size_t window_capacity = 0; // part of the budget held by the window
+    };
+
+    std::vector<Shard> shards_;
+    CachePolicy policy_;
+    std::atomic<size_t> capacity_{0};
+
+    std::atomic<uint64_t> hits_{0};
+    std::atomic<uint64_t> misses_{0};
+    std::atomic<uint64_t> admitted_{0};
+    std::atomic<uint64_t> rejected_{0};
+    std::atomic<uint64_t> evicted_{0};
+
+    static uint64_t hash_of(const std::string& key) {
+        return (uint64_t)std::hash<std::string>{}(key);
+    }
+
+    Shard& shard_for(uint64_t hash) {
+        // Mix the hash so shard choice is independent of the map's bucket choice
+        uint64_t h = hash * 0x9E3779B97F4A7C15ull;
+        return shards_[(size_t)((h >> 32) % shards_.size())];
+    }
+
+    static void remove(Shard& sh, typename std::unordered_map<std::string, typename NodeList::iterator>::iterator it) {
+        Node& n = *it->second;
+        sh.bytes -= n.charge;
+        if (n.in_window) {
+            sh.window_bytes -= n.charge;
+            sh.window.erase(it->second);
+        } else {
+            sh.lru.erase(it->second);
+        }
+        sh.index.erase(it);
+    }
+
+    void evict_one(Shard& sh, NodeList& list) {
+        Node& victim = list.back();
+        sh.bytes -= victim.charge;
+        if (victim.in_window) sh.window_bytes -= victim.charge;
+        sh.index.erase(victim.key);
+        list.pop_back();
+        evicted_.fetch_add(1, std::memory_order_relaxed);
+    }
+
+    // Move the window's LRU entry into the main area if it wins admission
+    void promote_candidate(Shard& sh) {
+        auto cand = std::prev(sh.window.end());
+        size_t main_capacity = sh.capacity - sh.window_capacity;
+        size_t main_bytes = sh.bytes - sh.window_bytes;
+
+        if (main_bytes + cand->charge > main_capacity && !sh.lru.empty()) {
+            // Ties go to the incumbent: a new key must have been seen more often
+            if (sh.sketch.frequency(cand->hash) <= sh.sketch.frequency(sh.lru.back().hash)) {
+                rejected_.fetch_add(1, std::memory_order_relaxed);
+                sh.bytes -= cand->charge;
+                sh.window_bytes -= cand->charge;
+                sh.index.erase(cand->key);
+                sh.window.erase(cand);
+                return;
+            }
+            while (!sh.lru.empty() && main_bytes + cand->charge > main_capacity) {
+                main_bytes -= sh.lru.back().charge;
+                evict_one(sh, sh.lru);
+            }
+        }
+
+        sh.window_bytes -= cand->charge;
+        cand->in_window = false;
+        sh.lru.splice(sh.lru.begin(), sh.window, cand);
+        admitted_.fetch_add(1, std::memory_order_relaxed);
+    }
+};
+
+} // namespace cord19
@@ -0,0 +1,81 @@
+#pragma once
+
+#include <cstdint>
+#include <filesystem>
+#include <memory>
+#include <string>
+#include <string_view>
+
+#include "api_types.hpp"
+#include "mmap_file.hpp"
+
+namespace cord19 {
+
+// Read-only columnar copy of metadata.csv, memory-mapped and read zero-copy.
+//
+// Built at index time by `metadataconvert`. Each row is one unique cord_uid;
+// every column is a string heap plus a fixed-width offset table, so a field
+// lookup is two array reads. Rows are looked up by cord_uid through a sorted
+// row table (binary search).
+class MetadataStore {
+public:
+    enum Column : uint32_t {
+        CordUid = 0,
+        Title,
+        Url,
+        PublishTime,
+        Author,   // first author display form ("Smith et al."), precomputed
+        Abstract,
+        Journal,
+        Source,   // source_x: "; "-separated source list
+        COLUMN_COUNT
+    };
+
+    // Map a store file (returns false if missing or not a valid store)
+    bool open(const fs::path& path);
+    void close();
+
+    bool valid() const { return file_ != nullptr; }
+    uint32_t size() const { return rows_; }
+
+    // Identifies the store layout (hash of the header and the cord_uid column)
+    uint64_t fingerprint() const { return fingerprint_; }
+
+    // Field of a row (row must be < size())
+    std::string_view field(uint32_t row, Column c) const {
+        const uint64_t* offs = offsets_[c];
+        return std::string_view(heaps_[c] + offs[row], (size_t)(offs[row + 1] - offs[row]));
+    }
+
+    // Find the row of a cord_uid (returns false if not present)
+    bool find(std::string_view cord_uid, uint32_t& row) const;
+
+    // Copy all display fields of a row
+    MetaData get(uint32_t row) const;
+
+private:
+    std::shared_ptr<const MappedFile> file_;
+    uint32_t rows_ = 0;
+    uint64_t fingerprint_ = 0;
+    const uint64_t* offsets_[COLUMN_COUNT] = {};
+    const char* heaps_[COLUMN_COUNT] = {};
+    const uint32_t* uid_order_ = nullptr; // rows sorted by cord_uid
+};
+
+// Per-segment side file mapping segment docIds to store rows
+inline fs::path doc_rows_path(const fs::path& segdir) {
+    return segdir / "docrows.bin";
+}
+
+// Set docs[i].meta_row for every doc of a segment by cord_uid lookup (returns unresolved count)
+size_t resolve_doc_rows(const MetadataStore& store, Segment& seg);
+
+// Save / load resolved rows. Loading fails if the file was built against a different store.
+bool write_doc_rows(const fs::path& segdir, const MetadataStore& store, const Segment& seg);
+bool read_doc_rows(const fs::path& segdir, const MetadataStore& store, Segment& seg);
+
+// Convert metadata.csv into a MetadataStore file.
+// Rows without a cord_uid are skipped; for repeated cord_uids the first row wins.
+bool write_metadata_store(const fs::path& metadata_csv, const fs::path& out_path);
+
+} // namespace cord19
@@ -0,0 +1,146 @@
+#pragma once
+#include <cstddef>
+#include <cstdint>
+#include <cstring>
+#include <filesystem>
+#include <string>
+
+#ifdef _WIN32
+#ifndef WIN32_LEAN_AND_MEAN
+#define WIN32_LEAN_AND_MEAN
+#endif
+#ifndef NOMINMAX
+#define NOMINMAX
+#endif
+#include <windows.h>
+#else
+#include <fcntl.h>
+#include <sys/mman.h>
+#include <sys/stat.h>
+#include <unistd.h>
+#endif
+
+// Read-only memory mapping of a whole file.
+// Move-only; the mapping is released when the object is destroyed.
+class MappedFile {
+public:
+    MappedFile() = default;
+    explicit MappedFile(const std::filesystem::path& p) { open(p); }
+    ~MappedFile() { close(); }
+
+    MappedFile(const MappedFile&) = delete;
+    MappedFile& operator=(const MappedFile&) = delete;
+
+    MappedFile(MappedFile&& o) noexcept { steal(o); }
+    MappedFile& operator=(MappedFile&& o) noexcept {
+        if (this != &o) { close(); steal(o); }
+        return *this;
+    }
+
+    // Map file into memory (returns false if missing, empty, or mapping failed)
+    bool open(const std::filesystem::path& p) {
+        close();
+#ifdef _WIN32
+        file_ = CreateFileW(p.wstring().c_str(), GENERIC_READ, FILE_SHARE_READ, nullptr,
+                            OPEN_EXISTING, FILE_ATTRIBUTE_NORMAL, nullptr);
+        if (file_ == INVALID_HANDLE_VALUE) return false;
+
+        LARGE_INTEGER sz;
+        if (!GetFileSizeEx(file_, &sz) || sz.QuadPart == 0) { close(); return false; }
+        size_ = (size_t)sz.QuadPart;
+
+        mapping_ = CreateFileMappingW(file_, nullptr, PAGE_READONLY, 0, 0, nullptr);
+        if (!mapping_) { close(); return false; }
+
+        data_ = (const char*)MapViewOfFile(mapping_, FILE_MAP_READ, 0, 0, 0);
+        if (!data_) { close(); return false; }
+#else
+        fd_ = ::open(p.c_str(), O_RDONLY);
+        if (fd_ < 0) return false;
+
+        struct stat st;
+        if (fstat(fd_, &st) != 0 || st.st_size == 0) { close(); return false; }
+        size_ = (size_t)st.st_size;
+
+        void* m = mmap(nullptr, size_, PROT_READ, MAP_SHARED, fd_, 0);
+        if (m == MAP_FAILED) { close(); return false; }
+        data_ = (const char*)m;
+#endif
+        return true;
+    }
+
+    // Unmap and close the file
+    void close() {
+#ifdef _WIN32
+        if (data_) UnmapViewOfFile(data_);
+        if (mapping_) CloseHandle(mapping_);
+        if (file_ != INVALID_HANDLE_VALUE) CloseHandle(file_);
+        mapping_ = nullptr;
+        file_ = INVALID_HANDLE_VALUE;
+#else
+        if (data_) munmap((void*)data_, size_);
+        if (fd_ >= 0) ::close(fd_);
+        fd_ = -1;
+#endif
+        data_ = nullptr;
+        size_ = 0;
+    }
+
+    // Hint that the mapping will be read sequentially (no-op where unsupported)
+    void advise_sequential() const {
+#if !defined(_WIN32) && defined(MADV_SEQUENTIAL)
+        if (data_) madvise((void*)data_, size_, MADV_SEQUENTIAL);
+#endif
+    }
+
+    bool valid() const { return data_ != nullptr; }
+    const char* data() const { return data_; }
+    size_t size() const { return size_; }
+
+private:
+    const char* data_ = nullptr;
+    size_t size_ = 0;
+#ifdef _WIN32
+    HANDLE file_ = INVALID_HANDLE_VALUE;
+    HANDLE mapping_ = nullptr;
+#else
+    int fd_ = -1;
+#endif
+
+    void steal(MappedFile& o) {
+        data_ = o.data_; size_ = o.size_;
+#ifdef _WIN32
+        file_ = o.file_; mapping_ = o.mapping_;
+        o.file_ = INVALID_HANDLE_VALUE; o.mapping_ = nullptr;
+#else
+        fd_ = o.fd_;
+        o.fd_ = -1;
+#endif
+        o.data_ = nullptr; o.size_ = 0;
+    }
+};
+
+// Index file for random reads from many threads at once: mapped, so readers
+// never share a file position. Unlike MappedFile, an empty file opens fine.
+class RandomAccessFile {
+public:
+    bool open(const std::filesystem::path& p) {
+        map_.close();
+        std::error_code ec;
+        auto size = std::filesystem::file_size(p, ec);
+        if (ec) return false;
+        return size == 0 || map_.open(p);
+    }
+
+    size_t size() const { return map_.size(); }
+
+    // Copy n bytes at offset off (false if the range runs past the end)
+    bool read_at(uint64_t off, void* dst, size_t n) const {
+        if (off > map_.size() || n > map_.size() - off) return false;
+        if (n) std::memcpy(dst, map_.data() + off, n);
+        return true;
+    }
+
+private:
+    MappedFile map_;
+};
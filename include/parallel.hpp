@@ -0,0 +1,101 @@
+#pragma once
+#include <algorithm>
+#include <chrono>
+#include <condition_variable>
+#include <cstddef>
+#include <deque>
+#include <mutex>
+#include <thread>
+#include <vector>
+
+// Run fn(i) for i in [0, n) with one thread per index
+template <class Fn>
+void run_parallel(size_t n, Fn&& fn) {
+    if (n <= 1) {
+        if (n == 1) fn((size_t)0);
+        return;
+    }
+    std::vector<std::thread> pool;
+    pool.reserve(n);
+    for (size_t i = 0; i < n; ++i) pool.emplace_back([&fn, i] { fn(i); });
+    for (auto& t : pool) t.join();
+}
+
+// Worker count for `bytes` of input: one per `bytes_per_thread`, capped by the hardware
+inline size_t worker_count(size_t bytes, size_t bytes_per_thread) {
+    size_t hw = std::max<size_t>(1, std::thread::hardware_concurrency());
+    return std::max<size_t>(1, std::min(hw, bytes / bytes_per_thread + 1));
+}
+
+// Blocking FIFO with a fixed capacity, for producer/consumer pipelines
+template <class T>
+class BoundedQueue {
+public:
+    enum class PopResult { Item, Closed, Timeout };
+
+    explicit BoundedQueue(size_t capacity) : capacity_(std::max<size_t>(1, capacity)) {}
+
+    // Wait for room, then enqueue (returns false once closed)
+    bool push(T v) {
+        std::unique_lock<std::mutex> lk(mtx_);
+        not_full_.wait(lk, [&] { return closed_ || items_.size() < capacity_; });
+        if (closed_) return false;
+        items_.push_back(std::move(v));
+        not_empty_.notify_one();
+        return true;
+    }
+
+    // Enqueue only if there is room right now (returns false if full or closed)
+    bool try_push(T v) {
+        std::lock_guard<std::mutex> lk(mtx_);
+        if (closed_ || items_.size() >= capacity_) return false;
+        items_.push_back(std::move(v));
+        not_empty_.notify_one();
+        return true;
+    }
+
+    size_t size() const {
+        std::lock_guard<std::mutex> lk(mtx_);
+        return items_.size();
+    }
+
+    // Wait for an item (returns false once closed and drained)
+    bool pop(T& out) {
+        std::unique_lock<std::mutex> lk(mtx_);
+        not_empty_.wait(lk, [&] { return closed_ || !items_.empty(); });
+        if (items_.empty()) return false;
+        out = std::move(items_.front());
+        items_.pop_front();
+        not_full_.notify_one();
+        return true;
+    }
+
+    // pop, giving up at `deadline` (Closed once closed and drained, Timeout if nothing arrived in time)
+    template <class Clock, class Duration>
+    PopResult pop_until(T& out, const std::chrono::time_point<Clock, Duration>& deadline) {
+        std::unique_lock<std::mutex> lk(mtx_);
+        if (!not_empty_.wait_until(lk, deadline, [&] { return closed_ || !items_.empty(); }))
+            return PopResult::Timeout;
+        if (items_.empty()) return PopResult::Closed;
+        out = std::move(items_.front());
+        items_.pop_front();
+        not_full_.notify_one();
+        return PopResult::Item;
+    }
+
+    // No more pushes; pending items can still be popped
+    void close() {
+        std::lock_guard<std::mutex> lk(mtx_);
+        closed_ = true;
+        not_full_.notify_all();
+        not_empty_.notify_all();
+    }
+
+private:
+    size_t capacity_;
+    std::deque<T> items_;
+    bool closed_ = false;
+    mutable std::mutex mtx_;
+    std::condition_variable not_full_;
+    std::condition_variable not_empty_;
+};
@@ -0,0 +1,224 @@
+#pragma once
+#include <cstdint>
+#include <cstring>
+#include <filesystem>
+#include <fstream>
+#include <string>
+#include <vector>
+#include "barrels.hpp"
+#include "indexio.hpp"
+#include "mmap_file.hpp"
+
+namespace fs = std::filesystem;
+
+// Optional positions barrel (positions_bNNN.bin), companion of inverted_bNNN.bin:
+//   magic "NSPOS001", u32 first_tid, u32 nterms, u64 term_offsets[nterms + 1] (absolute)
+//   per term, postings in the same order as the inverted barrel:
+//     u32 nblocks, u32 block_offsets[nblocks] (relative to the end of this table),
+//     then for each posting its tf positions as varints (first absolute, then deltas)
+// A block covers POSITION_BLOCK postings, so reading one doc's positions decodes
+// at most one block. Positions count index terms only (stopwords are skipped), and
+// each field starts FIELD_POSITION_GAP past the end of the one before it.
+static constexpr uint32_t POSITION_BLOCK = 128;
+
+// Position gap at each field boundary, so a phrase never spans the end of the title
+// and the start of the abstract, and terms across it earn almost no proximity boost
+static constexpr uint32_t FIELD_POSITION_GAP = 100;
+static constexpr char POSITIONS_MAGIC[8] = {'N', 'S', 'P', 'O', 'S', '0', '0', '1'};
+
+// Path for one positions barrel file
+inline fs::path pos_barrel_path(const fs::path& segdir, uint32_t barrel_id) {
+    return segdir / ("positions_b" + barrel_suffix(barrel_id) + ".bin");
+}
+
+inline bool has_positions(const fs::path& segdir) {
+    return fs::exists(pos_barrel_path(segdir, 0));
+}
+
+inline void put_varint(std::vector<uint8_t>& out, uint32_t v) {
+    while (v >= 0x80) {
+        out.push_back((uint8_t)(v | 0x80));
+        v >>= 7;
+    }
+    out.push_back((uint8_t)v);
+}
+
+inline bool get_varint(const uint8_t*& p, const uint8_t* end, uint32_t& v) {
+    v = 0;
+    for (int shift = 0; shift < 35 && p < end; shift += 7) {
+        uint8_t b = *p++;
+        v |= (uint32_t)(b & 0x7F) << shift;
+        if (!(b & 0x80)) return true;
+    }
+    return false;
+}
+
+// Append ascending positions of one posting, delta-coded
+inline void encode_positions(const uint32_t* pos, uint32_t n, std::vector<uint8_t>& out) {
+    uint32_t prev = 0;
+    for (uint32_t i = 0; i < n; i++) {
+        put_varint(out, pos[i] - prev);
+        prev = pos[i];
+    }
+}
+
+// Skip the positions of one posting (returns false on truncated data)
+inline bool skip_positions(const uint8_t*& p, const uint8_t* end, uint32_t tf) {
+    for (uint32_t i = 0; i < tf; i++) {
+        while (p < end && (*p & 0x80)) ++p;
+        if (p == end) return false;
+        ++p;
+    }
+    return true;
+}
+
+// Writes one positions barrel; terms must be added in ascending termId order
+class PositionsBarrelWriter {
+public:
+    bool open(const fs::path& path, uint32_t first_tid, uint32_t nterms) {
+        out_.open(path, std::ios::binary);
+        if (!out_) return false;
+        first_tid_ = first_tid;
+        offsets_.assign((size_t)nterms + 1, 0);
+        next_ = 0;
+
+        out_.write(POSITIONS_MAGIC, sizeof(POSITIONS_MAGIC));
+        write_u32(out_, first_tid);
+        write_u32(out_, nterms);
+        for (size_t i = 0; i < offsets_.size(); i++) write_u64(out_, 0); // patched in close()
+        pos_ = sizeof(POSITIONS_MAGIC) + 8 + offsets_.size() * 8;
+        return (bool)out_;
+    }
+
+    // Positions of all postings of one term; bytes holds each posting's encode_positions() output
+    template <class P>
+    void add_term(uint32_t tid, const P* postings, size_t n, const uint8_t* bytes, size_t len) {
+        fill_to(tid - first_tid_);
+
+        // Block offsets, found by skipping each posting's tf varints
+        std::vector<uint32_t> blocks;
+        blocks.reserve(n / POSITION_BLOCK + 1);
+        const uint8_t* p = bytes;
+        const uint8_t* end = bytes + len;
+        for (size_t i = 0; i < n; i++) {
+            if (i % POSITION_BLOCK == 0) blocks.push_back((uint32_t)(p - bytes));
+            skip_positions(p, end, postings[i].tf);
+        }
+
+        write_u32(out_, (uint32_t)blocks.size());
+        out_.write((const char*)blocks.data(), (std::streamsize)(blocks.size() * sizeof(uint32_t)));
+        out_.write((const char*)bytes, (std::streamsize)len);
+        pos_ += 4 + blocks.size() * sizeof(uint32_t) + len;
+    }
+
+    bool close() {
+        fill_to((uint32_t)offsets_.size());
+        out_.seekp(sizeof(POSITIONS_MAGIC) + 8, std::ios::beg);
+        for (uint64_t off : offsets_) write_u64(out_, off);
+        out_.close();
+        return (bool)out_;
+    }
+
+private:
+    std::ofstream out_;
+    uint32_t first_tid_ = 0;
+    std::vector<uint64_t> offsets_;
+    uint32_t next_ = 0;   // next term slot without an offset
+    uint64_t pos_ = 0;    // current file offset
+
+    // Terms up to `slot` start here (empty terms share the next term's offset)
+    void fill_to(uint32_t slot) {
+        while (next_ <= slot && next_ < offsets_.size()) offsets_[next_++] = pos_;
+    }
+};
+
+// Read side of a positions barrel (the term offset table is kept in memory).
+// Reads are positional, so any number of TermPositions can use one barrel at once.
+struct PositionsBarrel {
+    RandomAccessFile file;
+    uint32_t first_tid = 0;
+    std::vector<uint64_t> term_offsets;
+
+    bool open(const fs::path& path) {
+        if (!file.open(path)) return false;
+        char magic[sizeof(POSITIONS_MAGIC)] = {};
+        uint32_t nterms = 0;
+        if (!file.read_at(0, magic, sizeof(magic)) || std::memcmp(magic, POSITIONS_MAGIC, sizeof(magic)) != 0)
+            return false;
+        if (!file.read_at(sizeof(magic), &first_tid, 4) || !file.read_at(sizeof(magic) + 4, &nterms, 4)) return false;
+        term_offsets.resize((size_t)nterms + 1);
+        return file.read_at(sizeof(magic) + 8, term_offsets.data(), term_offsets.size() * sizeof(uint64_t));
+    }
+};
+
+// Positions of one term's postings, loaded one block at a time
+class TermPositions {
+public:
+    // Read the block table of a term (false if the barrel has no data for it)
+    bool open(PositionsBarrel& pb, uint32_t termId) {
+        pb_ = &pb;
+        block_ = UINT32_MAX;
+        if (termId < pb.first_tid || termId - pb.first_tid + 1 >= pb.term_offsets.size()) return false;
+        uint64_t start = pb.term_offsets[termId - pb.first_tid];
+        uint64_t end = pb.term_offsets[termId - pb.first_tid + 1];
+        if (end <= start) return false;
+
+        uint32_t nblocks = 0;
+        if (!pb.file.read_at(start, &nblocks, 4)) return false;
+        blocks_.resize(nblocks);
+        if (!pb.file.read_at(start + 4, blocks_.data(), (size_t)nblocks * sizeof(uint32_t))) return false;
+        data_start_ = start + 4 + (uint64_t)nblocks * sizeof(uint32_t);
+        data_end_ = end;
+        return nblocks > 0;
+    }
+
+    // Positions of the idx-th posting of the term's posting list
+    template <class P>
+    bool get(const P* postings, size_t n, size_t idx, std::vector<uint32_t>& out) {
+        out.clear();
+        if (idx >= n) return false;
+        size_t first = idx - idx % POSITION_BLOCK;
+        return get_in_block((uint32_t)(idx / POSITION_BLOCK), postings + first, idx - first, out);
+    }
+
+    // Positions of the i-th posting of block b (block points at the block's first posting)
+    template <class P>
+    bool get_in_block(uint32_t b, const P* block, size_t i, std::vector<uint32_t>& out) {
+        out.clear();
+        if (!pb_ || b >= blocks_.size() || i >= POSITION_BLOCK) return false;
+
+        // Load the block
+        if (b != block_) {
+            uint64_t from = data_start_ + blocks_[b];
+            uint64_t to = (b + 1 < blocks_.size()) ? data_start_ + blocks_[b + 1] : data_end_;
+            if (to < from) return false;
+            bytes_.resize((size_t)(to - from));
+            if (!pb_->file.read_at(from, bytes_.data(), bytes_.size())) return false;
+            block_ = b;
+        }
+
+        // Skip earlier postings of the block, then decode this one
+        const uint8_t* p = bytes_.data();
+        const uint8_t* end = p + bytes_.size();
+        for (size_t j = 0; j < i; j++)
+            if (!skip_positions(p, end, block[j].tf)) return false;
+
+        uint32_t pos = 0;
+        out.reserve(block[i].tf);
+        for (uint32_t j = 0; j < block[i].tf; j++) {
+            uint32_t d;
+            if (!get_varint(p, end, d)) return false;
+            pos += d;
+            out.push_back(pos);
+        }
+        return true;
+    }
+
+private:
+    PositionsBarrel* pb_ = nullptr;
+    std::vector<uint32_t> blocks_;
+    uint64_t data_start_ = 0;
+    uint64_t data_end_ = 0;
+    uint32_t block_ = UINT32_MAX;
+    std::vector<uint8_t> bytes_;
+};
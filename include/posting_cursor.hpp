@@ -0,0 +1,177 @@
+#pragma once
+
+#include <algorithm>
+#include <cstdint>
+#include <fstream>
+#include <memory>
+#include <vector>
+
+#include "api_types.hpp"
+#include "fields.hpp"
+#include "positions.hpp"
+
+namespace cord19 {
+
+// Forward-only cursor over one term's posting list in one segment.
+//
+// Postings are loaded one block (POSTING_BLOCK entries) at a time, either from
+// a cached list or from the inverted file. advance() gallops over the first
+// docIds of later blocks (skip pointers, read on demand) and only loads the
+// block that can hold the target, so intersecting a rare term with a frequent
+// one reads a small fraction of the frequent term's postings.
+class PostingCursor {
+public:
+    // Blocks line up with positions blocks, so a loaded block also indexes its positions
+    static constexpr uint32_t POSTING_BLOCK = POSITION_BLOCK;
+    static constexpr uint32_t END = UINT32_MAX;
+
+    // Movable only: the current block may point into buf_
+    PostingCursor() = default;
+    PostingCursor(PostingCursor&&) = default;
+    PostingCursor& operator=(PostingCursor&&) = default;
+    PostingCursor(const PostingCursor&) = delete;
+    PostingCursor& operator=(const PostingCursor&) = delete;
+
+    // Start at the first posting; `cached` is the full list if it is already in memory,
+    // `ftf` the segment's field tf barrel (null without field data)
+    void open(const RandomAccessFile& inv, const LexEntry& e, std::shared_ptr<const PostingList> cached,
+              PositionsBarrel* pb, const RandomAccessFile* ftf = nullptr) {
+        inv_ = &inv;
+        base_ = e.offset;
+        n_ = e.count;
+        mem_ = std::move(cached);
+        if (mem_) n_ = (uint32_t)mem_->postings.size();
+        ftf_ = ftf;
+        fbase_ = e.offset / sizeof(Posting) * sizeof(uint16_t);
+        has_fields_ = mem_ ? !mem_->field_tfs.empty() : ftf_ != nullptr;
+        nblocks_ = (n_ + POSTING_BLOCK - 1) / POSTING_BLOCK;
+        firsts_.assign(nblocks_, UNKNOWN);
+        has_positions_ = pb && positions_.open(*pb, e.termId);
+        load_block(0);
+    }
+
+    uint32_t df() const { return n_; }
+    bool has_positions() const { return has_positions_; }
+    uint32_t doc() const { return block_ < nblocks_ ? cur_[i_].docId : END; }
+    uint32_t tf() const { return cur_[i_].tf; }
+
+    // Packed title/abstract tfs of the current posting (see pack_field_tf)
+    bool has_fields() const { return has_fields_; }
+    uint16_t field_tf() const { return fcur_[i_]; }
+
+    void next() {
+        if (block_ >= nblocks_) return;
+        if (++i_ == len_) load_block(block_ + 1);
+    }
+
+    // Move to the first posting with docId >= target and return its docId (or END)
+    uint32_t advance(uint32_t target) {
+        if (doc() >= target) return doc();
+        if (target == END) {
+            load_block(nblocks_);
+            return END;
+        }
+
+        // Past this block: gallop to the last block starting at or before target
+        if (cur_[len_ - 1].docId < target) {
+            uint32_t lo = block_, hi = block_ + 1, step = 1;
+            while (hi < nblocks_ && block_first(hi) <= target) {
+                lo = hi;
+                step *= 2;
+                hi = (nblocks_ - lo > step) ? lo + step : nblocks_;
+            }
+            while (hi - lo > 1) {
+                uint32_t mid = lo + (hi - lo) / 2;
+                if (block_first(mid) <= target) lo = mid;
+                else hi = mid;
+            }
+
+            // This block ends before target, so the answer opens the next block
+            if (lo == block_) {
+                load_block(block_ + 1);
+                return doc();
+            }
+            load_block(lo);
+        }
+
+        const Posting* it = std::lower_bound(cur_ + i_, cur_ + len_, target,
+                                             [](const Posting& p, uint32_t d) { return p.docId < d; });
+        i_ = (uint32_t)(it - cur_);
+        if (i_ == len_) load_block(block_ + 1);
+        return doc();
+    }
+
+    // Positions of the current posting (false if the segment has none for this term)
+    bool positions(std::vector<uint32_t>& out) {
+        if (!has_positions_ || block_ >= nblocks_) return false;
+        return positions_.get_in_block(block_, cur_, i_, out);
+    }
+
+private:
+    static constexpr uint32_t UNKNOWN = UINT32_MAX;
+
+    const RandomAccessFile* inv_ = nullptr;
+    uint64_t base_ = 0;                    // byte offset of the list in the inverted file
+    uint32_t n_ = 0;
+    uint32_t nblocks_ = 0;
+    std::shared_ptr<const PostingList> mem_;
+    std::vector<uint32_t> firsts_;         // first docId per block, loaded on demand
+    std::vector<Posting> buf_;
+
+    const RandomAccessFile* ftf_ = nullptr;
+    uint64_t fbase_ = 0;                   // byte offset of the list in the field tf file
+    bool has_fields_ = false;
+    std::vector<uint16_t> fbuf_;
+    const uint16_t* fcur_ = nullptr;
+
+    uint32_t block_ = 0;
+    const Posting* cur_ = nullptr;
+    uint32_t len_ = 0;
+    uint32_t i_ = 0;
+
+    TermPositions positions_;
+    bool has_positions_ = false;
+
+    uint32_t block_first(uint32_t b) {
+        if (firsts_[b] == UNKNOWN) {
+            if (mem_) firsts_[b] = mem_->postings[(size_t)b * POSTING_BLOCK].docId;
+            else if (!inv_->read_at(base_ + (uint64_t)b * POSTING_BLOCK * sizeof(Posting), &firsts_[b], 4))
+                firsts_[b] = END;
+        }
+        return firsts_[b];
+    }
+
+    void load_block(uint32_t b) {
+        block_ = std::min(b, nblocks_);
+        i_ = 0;
+        len_ = 0;
+        if (block_ == nblocks_) return;
+
+        size_t first = (size_t)block_ * POSTING_BLOCK;
+        len_ = (uint32_t)std::min<size_t>(POSTING_BLOCK, n_ - first);
+        if (mem_) {
+            cur_ = mem_->postings.data() + first;
+            if (has_fields_) fcur_ = mem_->field_tfs.data() + first;
+        } else {
+            buf_.resize(len_);
+            if (!inv_->read_at(base_ + first * sizeof(Posting), buf_.data(), (size_t)len_ * sizeof(Posting))) {
+                // Truncated list: stop here
+                block_ = nblocks_ = (uint32_t)b;
+                len_ = 0;
+                return;
+            }
+            cur_ = buf_.data();
+
+            if (has_fields_) {
+                fbuf_.resize(len_);
+                // Unreadable field tfs: fall back to the total tf for the rest of the list
+                if (!ftf_->read_at(fbase_ + first * sizeof(uint16_t), fbuf_.data(), (size_t)len_ * sizeof(uint16_t)))
+                    has_fields_ = false;
+                fcur_ = fbuf_.data();
+            }
+        }
+        firsts_[block_] = cur_[0].docId;
+    }
+};
+
+} // namespace cord19
@@ -1,5 +1,4 @@
 #pragma once
-#include <unordered_map>
 #include <vector>
 #include <string>
 #include <algorithm>
@@ -8,6 +7,7 @@
 
 #include "indexio.hpp"
 #include "barrels.hpp"
+#include "term_dict.hpp"
 
 namespace fs = std::filesystem;
 
@@ -18,13 +18,14 @@ struct DocMeta {
     std::string title;
     std::string json_relpath;
     uint32_t doc_len;
+    uint32_t title_len = 0;    // index terms in the title (field segments only)
+    uint32_t abstract_len = 0; // index terms in the abstract (field segments only)
 };
 
 class SegmentWriter {
 public:
-    // term -> termId
-    std::unordered_map<std::string, uint32_t> term_to_id;
-    std::vector<std::string> id_to_term;
+    // term <-> termId
+    TermDict terms;
 
     // forward[docId] = list of (termId, tf)
     std::vector<std::vector<std::pair<uint32_t,uint32_t>>> forward;
@@ -35,13 +36,10 @@ public:
     std::vector<DocMeta> docs;
     uint64_t total_len = 0;
 
-    uint32_t intern_term(const std::string& term) {
-        auto it = term_to_id.find(term);
-        if (it != term_to_id.end()) return it->second;
-        uint32_t id = (uint32_t)id_to_term.size();
-        term_to_id.emplace(term, id);
-        id_to_term.push_back(term);
-        inverted.emplace_back();
+    uint32_t intern_term(std::string_view term) {
+        bool inserted;
+        uint32_t id = terms.intern(term, inserted);
+        if (inserted) inverted.emplace_back();
         return id;
     }
 
@@ -103,8 +101,8 @@ public:
         // terms.bin
         {
             std::ofstream out(segdir / "terms.bin", std::ios::binary);
-            write_u32(out, (uint32_t)id_to_term.size());
-            for (auto& t : id_to_term) write_string(out, t);
+            write_u32(out, terms.size());
+            for (uint32_t tid = 0; tid < terms.size(); tid++) write_string(out, terms.term(tid));
         }
 
         // BARRELIZED inverted + lexicon
@@ -113,7 +111,7 @@ public:
         {
             BarrelParams bp;
             bp.barrel_count = BARREL_COUNT;
-            uint32_t tcount = (uint32_t)id_to_term.size();
+            uint32_t tcount = terms.size();
             bp.terms_per_barrel = (tcount + bp.barrel_count - 1) / bp.barrel_count;
             if (bp.terms_per_barrel == 0) bp.terms_per_barrel = 1;
 
@@ -142,7 +140,7 @@ public:
 
                 barrel_term_counts[b]++;
 
-                write_string(lex[b], id_to_term[tid]);
+                write_string(lex[b], terms.term(tid));
                 write_u32(lex[b], tid);
                 write_u32(lex[b], df);
                 write_u64(lex[b], offsets[b]);
@@ -1,12 +1,17 @@
 #pragma once
 
+#include <cstdint>
 #include <filesystem>
+#include <memory>
 #include <string>
+#include <string_view>
 #include <unordered_map>
 #include <unordered_set>
 #include <utility>
 #include <vector>
 
+class MappedFile;
+
 namespace cord19 {
 
 namespace fs = std::filesystem;
@@ -16,6 +21,9 @@ namespace fs = std::filesystem;
 // This is intentionally NOT transformer/LLM-based. It expects classic static
 // embeddings (Word2Vec / GloVe / FastText-exported .vec/.txt). The semantic
 // matching logic (cosine similarity + weighted expansion) is implemented here.
+//
+// Vectors come either from a text file (parsed into the owned vectors below)
+// or from a binary file written by `embeddingconvert` (memory-mapped as-is).
 struct SemanticIndex {
     bool enabled = false;
     int dim = 0;
@@ -25,14 +33,46 @@ struct SemanticIndex {
     std::vector<float> vecs;                    // row*dim + j
     std::unordered_map<std::string, uint32_t> term_to_row;
 
+    // Term table entry of the binary format (offset/length into the string heap)
+    struct BinTerm {
+        uint32_t off;
+        uint32_t len;
+    };
+
+    // Binary storage: term table sorted by term, vectors already normalized.
+    // Shared so copies of the index keep the mapping alive.
+    std::shared_ptr<const MappedFile> mapped;
+    const BinTerm* mapped_terms = nullptr;
+    const char* mapped_strings = nullptr;
+    const float* mapped_vecs = nullptr;
+    size_t mapped_rows = 0;
+
     // Load vectors from a text embedding file with lines:
     //   word v1 v2 ... vD
     // Supports optional header line: "<vocab> <dim>".
     //
     // To keep memory low, this loads vectors ONLY for `needed_terms`.
+    // The file is parsed in parallel chunks; rows come out sorted by term.
     bool load_from_text(const fs::path& path,
                         const std::unordered_set<std::string>& needed_terms);
 
+    // Memory-map a binary embedding file (see save_binary for the layout).
+    bool load_binary(const fs::path& path);
+
+    // Write the loaded vectors as a binary embedding file:
+    //   header: magic "NSEMB001", u32 version, u32 dim, u64 rows,
+    //           u64 terms_off, u64 strings_off, u64 strings_size, u64 vecs_off
+    //   terms:  rows * BinTerm, sorted by term bytes
+    //   strings: concatenated term bytes
+    //   vecs:   rows * dim float32 (L2-normalized), 64-byte aligned
+    bool save_binary(const fs::path& path) const;
+
+    // Row accessors (work for both text-loaded and mapped storage)
+    size_t size() const;
+    std::string_view term_at(uint32_t row) const;
+    const float* row_vec(uint32_t row) const;
+    bool find_row(std::string_view term, uint32_t& row) const;
+
     // Expand query tokens by nearest neighbors in embedding space.
     // Returns (term, weight) pairs. Original query terms always have weight 1.0.
     // Neighbors get weight ~= alpha * cosine_sim.
@@ -45,6 +85,7 @@ struct SemanticIndex {
         int max_total_terms = 40) const;
 
 private:
+    void reset();
     const float* get_vec_ptr(const std::string& term) const;
     static void l2_normalize(std::vector<float>& v);
 
@@ -0,0 +1,65 @@
+#pragma once
+
+#include <future>
+#include <mutex>
+#include <string>
+#include <unordered_map>
+#include <utility>
+
+namespace cord19 {
+
+// Coalesces concurrent calls for the same key: the first caller (the leader)
+// runs the work, and callers arriving while it runs wait on its shared future
+// instead of repeating the work. Keys are forgotten as soon as the leader is
+// done, so later calls start a new flight (results belong in a cache).
+template <class V>
+class SingleFlight {
+public:
+    // Run fn() for `key`, or wait for the call already running for it.
+    // `shared` is set if the result came from another caller's flight.
+    // An exception thrown by the leader's fn() is rethrown to every waiter.
+    template <class Fn>
+    V run(const std::string& key, Fn&& fn, bool* shared = nullptr) {
+        std::promise<V> promise;
+        {
+            std::unique_lock<std::mutex> lock(mtx_);
+            auto it = flights_.find(key);
+            if (it != flights_.end()) {
+                std::shared_future<V> f = it->second;
+                lock.unlock();
+                if (shared) *shared = true;
+                return f.get();
+            }
+            flights_.emplace(key, promise.get_future().share());
+        }
+        if (shared) *shared = false;
+
+        try {
+            V v = fn();
+            promise.set_value(v);
+            finish(key);
+            return v;
+        } catch (...) {
+            finish(key);
+            promise.set_exception(std::current_exception());
+            throw;
+        }
+    }
+
+    // Keys with a call in progress
+    size_t in_flight() const {
+        std::lock_guard<std::mutex> lock(mtx_);
+        return flights_.size();
+    }
+
+private:
+    mutable std::mutex mtx_;
+    std::unordered_map<std::string, std::shared_future<V>> flights_;
+
+    void finish(const std::string& key) {
+        std::lock_guard<std::mutex> lock(mtx_);
+        flights_.erase(key);
+    }
+};
+
+} // namespace cord19
@@ -0,0 +1,553 @@
+#pragma once
+#include <vector>
+#include <string>
+#include <algorithm>
+#include <fstream>
+#include <filesystem>
+#include <iostream>
+
+#include "indexio.hpp"
+#include "barrels.hpp"
+#include "fields.hpp"
+#include "positions.hpp"
+#include "segment_writer.hpp"
+#include "term_dict.hpp"
+
+namespace fs = std::filesystem;
+
+// Default in-memory postings budget before a run is spilled
+static constexpr size_t SPIMI_DEFAULT_BUDGET_MB = 256;
+
+// Most runs read at once by a merge. Each open run holds a file descriptor, and the
+// final merge also keeps up to 4 files per barrel open (inverted, lexicon, positions,
+// field tfs), so 64 runs + 256 barrel files stay well under the usual 1024 fd limit.
+// More runs are first merged in groups of this size into larger runs.
+static constexpr size_t SPIMI_MAX_MERGE_FANIN = 64;
+
+// Share of the budget reserved for buffered positions bytes when positions are on.
+// A RunPosting is 32 bytes and its encoded positions a few bytes on average.
+static constexpr size_t SPIMI_POSITIONS_BUDGET_DIV = 4;
+
+// Single-pass segment builder with bounded memory (SPIMI).
+//
+// docs.bin and forward.bin are streamed as documents arrive. Postings are
+// buffered until the memory budget is reached, then sorted by termId in
+// place and spilled as a run file. finish() k-way merges all runs straight
+// into the barrel files (at most SPIMI_MAX_MERGE_FANIN at a time), so no
+// step ever holds the whole collection in memory.
+// With positions enabled, each posting's encoded positions travel with it
+// through the runs and are merged into the positions barrels; with fields
+// enabled, so do its packed title/abstract tfs (see fields.hpp).
+class SpimiWriter {
+public:
+    // Global term dictionary (termIds are assigned in first-seen order)
+    TermDict terms;
+
+    SpimiWriter(const fs::path& segdir, size_t budget_bytes, bool with_positions = false,
+                bool with_fields = false)
+        : segdir_(segdir), budget_bytes_(budget_bytes), with_positions_(with_positions),
+          with_fields_(with_fields) {}
+
+    // Create the segment folder and start docs.bin / forward.bin (and fields.bin)
+    bool open() {
+        fs::create_directories(segdir_);
+        fs::create_directories(run_dir());
+
+        docs_out_.open(segdir_ / "docs.bin", std::ios::binary);
+        fwd_out_.open(segdir_ / "forward.bin", std::ios::binary);
+        if (!docs_out_ || !fwd_out_) {
+            std::cerr << "[spimi] failed to open segment files in: " << segdir_ << "\n";
+            return false;
+        }
+
+        // Doc counts are patched in finish()
+        write_u32(docs_out_, 0);
+        write_u32(fwd_out_, 0);
+
+        // Split the budget between the buffers once; they never grow past it
+        size_t pos_budget = with_positions_ ? budget_bytes_ / SPIMI_POSITIONS_BUDGET_DIV : 0;
+        pending_cap_ = std::max<size_t>(1, (budget_bytes_ - pos_budget) / sizeof(RunPosting));
+        pending_pos_cap_ = pos_budget;
+        reserve_pending();
+
+        if (with_fields_) {
+            fields_out_.open(field_lens_path(segdir_), std::ios::binary);
+            if (!fields_out_) {
+                std::cerr << "[spimi] failed to open: " << field_lens_path(segdir_) << "\n";
+                return false;
+            }
+            fields_out_.write(FIELDS_MAGIC, sizeof(FIELDS_MAGIC));
+            write_u32(fields_out_, 0);
+        }
+        return true;
+    }
+
+    uint32_t intern_term(std::string_view term) { return terms.intern(term); }
+
+    // Append one document; fwd holds (termId, tf) sorted by termId, positions (if enabled)
+    // the encode_positions() bytes of each fwd entry in the same order, and field_tfs
+    // (if enabled) the pack_field_tf() value of each fwd entry
+    bool add_document(const DocMeta& meta, const std::vector<std::pair<uint32_t,uint32_t>>& fwd,
+                      const std::vector<uint8_t>* positions = nullptr,
+                      const std::vector<uint16_t>* field_tfs = nullptr) {
+        uint32_t docId = doc_count_++;
+        total_len_ += meta.doc_len;
+
+        write_string(docs_out_, meta.cord_uid);
+        write_string(docs_out_, meta.title);
+        write_string(docs_out_, meta.json_relpath);
+        write_u32(docs_out_, meta.doc_len);
+
+        if (with_fields_) {
+            if (!field_tfs || field_tfs->size() != fwd.size()) {
+                std::cerr << "[spimi] missing field tfs for doc " << docId << "\n";
+                return false;
+            }
+            write_u32(fields_out_, meta.title_len);
+            write_u32(fields_out_, meta.abstract_len);
+        }
+
+        // Positions of each entry, split by skipping tf varints
+        const uint8_t* pp = nullptr;
+        const uint8_t* pend = nullptr;
+        if (with_positions_ && positions) {
+            pp = positions->data();
+            pend = pp + positions->size();
+        }
+
+        // Spill first if this document does not fit in the reserved buffers
+        size_t pos_bytes = (size_t)(pend - pp);
+        if (!pending_.empty() && (pending_.size() + fwd.size() > pending_cap_ ||
+                                  pending_pos_.size() + pos_bytes > pending_pos_cap_) && !spill_run())
+            return false;
+
+        write_u32(fwd_out_, (uint32_t)fwd.size());
+        for (size_t i = 0; i < fwd.size(); i++) {
+            auto [tid, tf] = fwd[i];
+            write_u32(fwd_out_, tid);
+            write_u32(fwd_out_, tf);
+
+            RunPosting rp{tid, docId, tf, 0, (uint64_t)pending_pos_.size(),
+                          with_fields_ ? (*field_tfs)[i] : (uint16_t)0};
+            if (with_positions_) {
+                const uint8_t* from = pp;
+                if (!pp || !skip_positions(pp, pend, tf)) {
+                    std::cerr << "[spimi] missing positions for doc " << docId << "\n";
+                    return false;
+                }
+                pending_pos_.insert(pending_pos_.end(), from, pp);
+                rp.pos_len = (uint32_t)(pp - from);
+            }
+            pending_.push_back(rp);
+        }
+        return true;
+    }
+
+    uint32_t doc_count() const { return doc_count_; }
+    size_t run_count() const { return runs_.size(); }
+
+    // Spill the last run, write stats/terms and merge all runs into barrels
+    bool finish() {
+        if (!pending_.empty() && !spill_run()) return false;
+
+        // Patch doc counts
+        docs_out_.seekp(0, std::ios::beg);
+        write_u32(docs_out_, doc_count_);
+        docs_out_.close();
+        fwd_out_.seekp(0, std::ios::beg);
+        write_u32(fwd_out_, doc_count_);
+        fwd_out_.close();
+        if (!docs_out_ || !fwd_out_) {
+            std::cerr << "[spimi] failed to write docs.bin / forward.bin\n";
+            return false;
+        }
+        if (with_fields_) {
+            fields_out_.seekp(sizeof(FIELDS_MAGIC), std::ios::beg);
+            write_u32(fields_out_, doc_count_);
+            fields_out_.close();
+            if (!fields_out_) {
+                std::cerr << "[spimi] failed to write: " << field_lens_path(segdir_) << "\n";
+                return false;
+            }
+        }
+
+        // stats.bin
+        {
+            float avgdl = doc_count_ == 0 ? 0.0f : (float)total_len_ / (float)doc_count_;
+            std::ofstream out(segdir_ / "stats.bin", std::ios::binary);
+            write_u32(out, doc_count_);
+            write_f32(out, avgdl);
+        }
+
+        // terms.bin
+        {
+            std::ofstream out(segdir_ / "terms.bin", std::ios::binary);
+            write_u32(out, terms.size());
+            for (uint32_t tid = 0; tid < terms.size(); tid++) write_string(out, terms.term(tid));
+        }
+
+        bool ok = merge_runs();
+
+        // Drop run files
+        std::error_code ec;
+        fs::remove_all(run_dir(), ec);
+        return ok;
+    }
+
+private:
+    struct RunPosting {
+        uint32_t termId;
+        uint32_t docId;
+        uint32_t tf;
+        uint32_t pos_len;  // bytes of encoded positions
+        uint64_t pos_off;  // offset in pending_pos_
+        uint16_t fields;   // packed title/abstract tfs
+    };
+
+    // Sequential reader over one run: groups of (termId, count, postings[, u32 bytes, positions][, u16 fields])
+    struct RunReader {
+        std::ifstream in;
+        uint32_t groups_left = 0;
+        uint32_t termId = 0;
+        uint32_t count = 0;
+        bool done = false;
+
+        bool open(const fs::path& path) {
+            in.open(path, std::ios::binary);
+            if (!in) return false;
+            groups_left = read_u32(in);
+            next();
+            return (bool)in;
+        }
+
+        void next() {
+            if (groups_left == 0) { done = true; return; }
+            groups_left--;
+            termId = read_u32(in);
+            count  = read_u32(in);
+        }
+
+        // Append the current group's postings (and positions / field tfs if given), then advance
+        void take(std::vector<Posting>& postings, std::vector<uint8_t>* positions,
+                  std::vector<uint16_t>* fields) {
+            size_t at = postings.size();
+            postings.resize(at + count);
+            in.read((char*)&postings[at], (std::streamsize)count * sizeof(Posting));
+            if (positions) {
+                uint32_t bytes = read_u32(in);
+                size_t pat = positions->size();
+                positions->resize(pat + bytes);
+                in.read((char*)positions->data() + pat, (std::streamsize)bytes);
+            }
+            if (fields) {
+                size_t fat = fields->size();
+                fields->resize(fat + count);
+                in.read((char*)&(*fields)[fat], (std::streamsize)count * sizeof(uint16_t));
+            }
+            next();
+        }
+    };
+
+    fs::path segdir_;
+    size_t budget_bytes_;
+    bool with_positions_;
+    bool with_fields_;
+
+    std::ofstream docs_out_;
+    std::ofstream fwd_out_;
+    std::ofstream fields_out_;
+    uint32_t doc_count_ = 0;
+    uint64_t total_len_ = 0;
+
+    std::vector<RunPosting> pending_;
+    std::vector<uint8_t> pending_pos_;
+    size_t pending_cap_ = 0;     // postings reserved in pending_
+    size_t pending_pos_cap_ = 0; // bytes reserved in pending_pos_
+    std::vector<fs::path> runs_;
+    uint32_t run_seq_ = 0; // names spilled and merged run files
+
+    fs::path run_dir() const { return segdir_ / "spimi_runs"; }
+
+    fs::path next_run_path() { return run_dir() / ("run_" + barrel_suffix(run_seq_++) + ".bin"); }
+
+    // Sort buffered postings by termId and write them as one run.
+    // The sort is in place and groups are written through a small fixed buffer,
+    // so spilling needs no memory beyond the budgeted buffers.
+    bool spill_run() {
+        // Docs arrive in docId order, so (termId, docId) order keeps docIds ascending per term
+        std::sort(pending_.begin(), pending_.end(), [](const RunPosting& a, const RunPosting& b) {
+            return a.termId != b.termId ? a.termId < b.termId : a.docId < b.docId;
+        });
+
+        fs::path path = next_run_path();
+        std::ofstream out(path, std::ios::binary);
+        if (!out) {
+            std::cerr << "[spimi] failed to open run file: " << path << "\n";
+            return false;
+        }
+
+        static constexpr size_t CHUNK = 1024;
+        Posting chunk[CHUNK];
+        uint16_t field_chunk[CHUNK];
+
+        // Group count is patched after the groups are written
+        uint32_t groups = 0;
+        write_u32(out, 0);
+        for (size_t first = 0; first < pending_.size();) {
+            uint32_t tid = pending_[first].termId;
+            size_t last = first;
+            while (last < pending_.size() && pending_[last].termId == tid) last++;
+
+            write_u32(out, tid);
+            write_u32(out, (uint32_t)(last - first));
+            for (size_t i = first; i < last; i += CHUNK) {
+                size_t n = std::min(CHUNK, last - i);
+                for (size_t j = 0; j < n; j++) chunk[j] = Posting{pending_[i + j].docId, pending_[i + j].tf};
+                out.write((const char*)chunk, (std::streamsize)(n * sizeof(Posting)));
+            }
+
+            if (with_positions_) {
+                uint32_t bytes = 0;
+                for (size_t i = first; i < last; i++) bytes += pending_[i].pos_len;
+                write_u32(out, bytes);
+                for (size_t i = first; i < last; i++)
+                    out.write((const char*)&pending_pos_[pending_[i].pos_off], (std::streamsize)pending_[i].pos_len);
+            }
+            if (with_fields_) {
+                for (size_t i = first; i < last; i += CHUNK) {
+                    size_t n = std::min(CHUNK, last - i);
+                    for (size_t j = 0; j < n; j++) field_chunk[j] = pending_[i + j].fields;
+                    out.write((const char*)field_chunk, (std::streamsize)(n * sizeof(uint16_t)));
+                }
+            }
+            groups++;
+            first = last;
+        }
+        out.seekp(0, std::ios::beg);
+        write_u32(out, groups);
+        out.close();
+        if (!out) {
+            std::cerr << "[spimi] failed to write run file: " << path << "\n";
+            return false;
+        }
+
+        std::cerr << "[spimi] spilled run " << runs_.size() << " ("
+                  << pending_.size() << " postings, " << groups << " terms)\n";
+
+        runs_.push_back(path);
+        reserve_pending();
+        return true;
+    }
+
+    // Empty the buffers and hold exactly the reserved capacity. A document larger
+    // than the whole budget grows them for one run; this gives that memory back.
+    void reserve_pending() {
+        pending_.clear();
+        pending_pos_.clear();
+        if (pending_.capacity() > pending_cap_) pending_.shrink_to_fit();
+        if (pending_pos_.capacity() > pending_pos_cap_) pending_pos_.shrink_to_fit();
+        pending_.reserve(pending_cap_);
+        pending_pos_.reserve(pending_pos_cap_);
+    }
+
+    // Open a reader on each run file
+    static bool open_runs(const fs::path* runs, size_t n, std::vector<RunReader>& readers) {
+        readers = std::vector<RunReader>(n);
+        for (size_t r = 0; r < n; r++) {
+            if (!readers[r].open(runs[r])) {
+                std::cerr << "[spimi] failed to open run file: " << runs[r] << "\n";
+                return false;
+            }
+        }
+        return true;
+    }
+
+    static bool check_runs(const std::vector<RunReader>& readers) {
+        for (auto& r : readers) {
+            if (!r.in) {
+                std::cerr << "[spimi] truncated run file\n";
+                return false;
+            }
+        }
+        return true;
+    }
+
+    // Merge n consecutive runs (in docId order) into one run file with the same layout
+    bool merge_run_group(const fs::path* runs, size_t n, const fs::path& path) {
+        std::vector<RunReader> readers;
+        if (!open_runs(runs, n, readers)) return false;
+
+        std::ofstream out(path, std::ios::binary);
+        if (!out) {
+            std::cerr << "[spimi] failed to open run file: " << path << "\n";
+            return false;
+        }
+
+        uint32_t groups = 0;
+        write_u32(out, 0);
+        std::vector<Posting> postings;
+        std::vector<uint8_t> positions;
+        std::vector<uint16_t> fields;
+        for (uint32_t tid = 0; tid < terms.size(); tid++) {
+            postings.clear();
+            positions.clear();
+            fields.clear();
+            for (auto& r : readers)
+                if (!r.done && r.termId == tid)
+                    r.take(postings, with_positions_ ? &positions : nullptr, with_fields_ ? &fields : nullptr);
+            if (postings.empty()) continue;
+
+            write_u32(out, tid);
+            write_u32(out, (uint32_t)postings.size());
+            out.write((const char*)postings.data(), (std::streamsize)(postings.size() * sizeof(Posting)));
+            if (with_positions_) {
+                write_u32(out, (uint32_t)positions.size());
+                out.write((const char*)positions.data(), (std::streamsize)positions.size());
+            }
+            if (with_fields_) out.write((const char*)fields.data(), (std::streamsize)(fields.size() * sizeof(uint16_t)));
+            groups++;
+        }
+        if (!check_runs(readers)) return false;
+
+        out.seekp(0, std::ios::beg);
+        write_u32(out, groups);
+        out.close();
+        if (!out) {
+            std::cerr << "[spimi] failed to write run file: " << path << "\n";
+            return false;
+        }
+        return true;
+    }
+
+    // Merge all runs (in docId order) into the barrelized inverted + lexicon files
+    bool merge_runs() {
+        // Too many runs to read at once: merge groups of runs into fewer, larger runs
+        while (runs_.size() > SPIMI_MAX_MERGE_FANIN) {
+            std::vector<fs::path> merged;
+            for (size_t first = 0; first < runs_.size(); first += SPIMI_MAX_MERGE_FANIN) {
+                size_t n = std::min(SPIMI_MAX_MERGE_FANIN, runs_.size() - first);
+                if (n == 1) {
+                    merged.push_back(runs_[first]);
+                    continue;
+                }
+                fs::path path = next_run_path();
+                if (!merge_run_group(&runs_[first], n, path)) return false;
+                std::error_code ec;
+                for (size_t r = first; r < first + n; r++) fs::remove(runs_[r], ec);
+                merged.push_back(path);
+            }
+            std::cerr << "[spimi] merged " << runs_.size() << " runs into " << merged.size() << "\n";
+            runs_.swap(merged);
+        }
+
+        std::vector<RunReader> readers;
+        if (!open_runs(runs_.data(), runs_.size(), readers)) return false;
+
+        BarrelParams bp;
+        bp.barrel_count = BARREL_COUNT;
+        uint32_t tcount = terms.size();
+        bp.terms_per_barrel = (tcount + bp.barrel_count - 1) / bp.barrel_count;
+        if (bp.terms_per_barrel == 0) bp.terms_per_barrel = 1;
+
+        write_barrels_manifest(segdir_, bp);
+
+        std::vector<std::ofstream> inv(bp.barrel_count);
+        std::vector<std::ofstream> lex(bp.barrel_count);
+        std::vector<PositionsBarrelWriter> posw(with_positions_ ? bp.barrel_count : 0);
+        std::vector<std::ofstream> ftf(with_fields_ ? bp.barrel_count : 0);
+        std::vector<uint64_t> offsets(bp.barrel_count, 0);
+        std::vector<uint32_t> barrel_term_counts(bp.barrel_count, 0);
+
+        for (uint32_t b = 0; b < bp.barrel_count; b++) {
+            inv[b].open(inv_barrel_path(segdir_, b), std::ios::binary);
+            lex[b].open(lex_barrel_path(segdir_, b), std::ios::binary);
+            if (!inv[b] || !lex[b]) {
+                std::cerr << "[spimi] failed to open barrel files in: " << segdir_ << "\n";
+                return false;
+            }
+            write_u32(lex[b], 0); // placeholder
+
+            if (with_positions_) {
+                uint32_t first = std::min(tcount, b * bp.terms_per_barrel);
+                uint32_t last = (b + 1 == bp.barrel_count) ? tcount : std::min(tcount, first + bp.terms_per_barrel);
+                if (!posw[b].open(pos_barrel_path(segdir_, b), first, last - first)) {
+                    std::cerr << "[spimi] failed to open positions barrel in: " << segdir_ << "\n";
+                    return false;
+                }
+            }
+            if (with_fields_) {
+                ftf[b].open(field_tf_barrel_path(segdir_, b), std::ios::binary);
+                if (!ftf[b]) {
+                    std::cerr << "[spimi] failed to open field tf barrel in: " << segdir_ << "\n";
+                    return false;
+                }
+            }
+        }
+
+        // Runs hold ascending termIds, so one sweep over termIds is the k-way merge
+        std::vector<Posting> term_postings;
+        std::vector<uint8_t> term_positions;
+        std::vector<uint16_t> term_fields;
+        for (uint32_t tid = 0; tid < tcount; tid++) {
+            uint32_t df = 0;
+            for (auto& r : readers)
+                if (!r.done && r.termId == tid) df += r.count;
+            if (df == 0) continue;
+
+            uint32_t b = barrel_for_term(tid, bp);
+            barrel_term_counts[b]++;
+
+            write_string(lex[b], terms.term(tid));
+            write_u32(lex[b], tid);
+            write_u32(lex[b], df);
+            write_u64(lex[b], offsets[b]);
+            write_u32(lex[b], df);
+
+            // Earlier runs hold earlier docIds, so concatenation keeps postings sorted
+            term_postings.clear();
+            term_positions.clear();
+            term_fields.clear();
+            for (auto& r : readers)
+                if (!r.done && r.termId == tid)
+                    r.take(term_postings, with_positions_ ? &term_positions : nullptr,
+                           with_fields_ ? &term_fields : nullptr);
+            inv[b].write((const char*)term_postings.data(), (std::streamsize)(term_postings.size() * sizeof(Posting)));
+            if (with_fields_)
+                ftf[b].write((const char*)term_fields.data(), (std::streamsize)(term_fields.size() * sizeof(uint16_t)));
+            offsets[b] += (uint64_t)df * (sizeof(uint32_t) * 2);
+
+            if (with_positions_)
+                posw[b].add_term(tid, term_postings.data(), term_postings.size(),
+                                 term_positions.data(), term_positions.size());
+        }
+
+        if (!check_runs(readers)) return false;
+
+        // Patch header counts in each lex barrel file
+        for (uint32_t b = 0; b < bp.barrel_count; b++) {
+            lex[b].flush();
+            lex[b].close();
+            inv[b].close();
+            if (with_positions_ && !posw[b].close()) {
+                std::cerr << "[spimi] failed to write positions barrel: " << pos_barrel_path(segdir_, b) << "\n";
+                return false;
+            }
+            if (with_fields_) {
+                ftf[b].close();
+                if (!ftf[b]) {
+                    std::cerr << "[spimi] failed to write field tf barrel: " << field_tf_barrel_path(segdir_, b) << "\n";
+                    return false;
+                }
+            }
+            std::ofstream patch(lex_barrel_path(segdir_, b), std::ios::in | std::ios::out | std::ios::binary);
+            if (!patch) {
+                std::cerr << "[spimi] failed to patch lexicon barrel: " << lex_barrel_path(segdir_, b) << "\n";
+                return false;
+            }
+            patch.seekp(0, std::ios::beg);
+            write_u32(patch, barrel_term_counts[b]);
+            patch.flush();
+        }
+        return true;
+    }
+};
@@ -0,0 +1,73 @@
+#pragma once
+
+#include <string>
+#include <string_view>
+
+namespace cord19 {
+
+// Incremental parser of a text/event-stream body. Bytes may be fed in pieces
+// of any size; each complete event is passed to the callback as (event, data),
+// where event is empty unless an "event:" field was sent and data joins the
+// event's "data:" lines with '\n'. Comments and other fields are ignored.
+class SseParser {
+public:
+    template <class Fn>
+    void feed(std::string_view bytes, Fn&& on_event) {
+        for (char c : bytes) {
+            if (c == '\r') continue; // CRLF and LF line endings are the same
+            if (c != '\n') {
+                line_ += c;
+                continue;
+            }
+            if (line_.empty()) {
+                // Blank line: dispatch the event, if it had any data
+                if (has_data_) on_event(event_, data_);
+                event_.clear();
+                data_.clear();
+                has_data_ = false;
+            } else {
+                field(line_);
+            }
+            line_.clear();
+        }
+    }
+
+private:
+    std::string line_;
+    std::string event_;
+    std::string data_;
+    bool has_data_ = false;
+
+    void field(std::string_view line) {
+        if (line[0] == ':') return;
+        size_t colon = line.find(':');
+        std::string_view name = line.substr(0, colon);
+        std::string_view value = colon == std::string_view::npos ? std::string_view() : line.substr(colon + 1);
+        if (!value.empty() && value[0] == ' ') value.remove_prefix(1);
+
+        if (name == "data") {
+            if (has_data_) data_ += '\n';
+            data_ += value;
+            has_data_ = true;
+        } else if (name == "event") {
+            event_ = std::string(value);
+        }
+    }
+};
+
+// One server-sent event (data must not contain newlines, which holds for compact JSON)
+inline std::string format_sse_event(std::string_view event, std::string_view data) {
+    std::string out;
+    out.reserve(event.size() + data.size() + 16);
+    if (!event.empty()) {
+        out += "event: ";
+        out += event;
+        out += '\n';
+    }
+    out += "data: ";
+    out += data;
+    out += "\n\n";
+    return out;
+}
+
+} // namespace cord19
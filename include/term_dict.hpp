@@ -0,0 +1,179 @@
+#pragma once
+#include <algorithm>
+#include <cstdint>
+#include <cstring>
+#include <functional>
+#include <memory>
+#include <string_view>
+#include <vector>
+
+// Bump allocator for term bytes. Stored strings never move until clear().
+class StringArena {
+public:
+    static constexpr size_t BLOCK_BYTES = 64 * 1024;
+
+    std::string_view store(std::string_view s) {
+        if (s.size() > left_) {
+            size_t n = std::max(BLOCK_BYTES, s.size());
+            blocks_.emplace_back(new char[n]);
+            cur_ = blocks_.back().get();
+            left_ = n;
+            bytes_ += n;
+        }
+        std::memcpy(cur_, s.data(), s.size());
+        std::string_view out(cur_, s.size());
+        cur_ += s.size();
+        left_ -= s.size();
+        return out;
+    }
+
+    void clear() {
+        blocks_.clear();
+        cur_ = nullptr;
+        left_ = 0;
+        bytes_ = 0;
+    }
+
+    size_t bytes() const { return bytes_; }
+
+private:
+    std::vector<std::unique_ptr<char[]>> blocks_;
+    char* cur_ = nullptr;
+    size_t left_ = 0;
+    size_t bytes_ = 0;
+};
+
+// Term interning: string -> dense id in first-seen order, and id -> string.
+//
+// Each term is stored once in an arena; the hash table is open addressing
+// (linear probing) over 8-byte slots holding the id and a cached hash, so
+// most probes never touch the string bytes and growing never rehashes them.
+class TermDict {
+public:
+    explicit TermDict(size_t expected = 0) { reserve(expected); }
+
+    // Id of a term, assigning the next id if it is new
+    uint32_t intern(std::string_view term) {
+        bool inserted;
+        return intern(term, inserted);
+    }
+
+    uint32_t intern(std::string_view term, bool& inserted) {
+        if ((terms_.size() + 1) * 10 > slots_.size() * 7) grow();
+
+        uint32_t tag = hash_of(term);
+        size_t mask = slots_.size() - 1;
+        for (size_t i = tag & mask;; i = (i + 1) & mask) {
+            Slot& s = slots_[i];
+            if (s.id == EMPTY) {
+                s.id = (uint32_t)terms_.size();
+                s.tag = tag;
+                terms_.push_back(arena_.store(term));
+                inserted = true;
+                return s.id;
+            }
+            if (s.tag == tag && terms_[s.id] == term) {
+                inserted = false;
+                return s.id;
+            }
+        }
+    }
+
+    // Look up without inserting
+    bool find(std::string_view term, uint32_t& id) const {
+        if (terms_.empty()) return false;
+        uint32_t tag = hash_of(term);
+        size_t mask = slots_.size() - 1;
+        for (size_t i = tag & mask;; i = (i + 1) & mask) {
+            const Slot& s = slots_[i];
+            if (s.id == EMPTY) return false;
+            if (s.tag == tag && terms_[s.id] == term) {
+                id = s.id;
+                return true;
+            }
+        }
+    }
+
+    // Term of an id (valid until clear())
+    std::string_view term(uint32_t id) const { return terms_[id]; }
+
+    uint32_t size() const { return (uint32_t)terms_.size(); }
+    bool empty() const { return terms_.empty(); }
+
+    void reserve(size_t n) {
+        terms_.reserve(n);
+        size_t want = 16;
+        while (want * 7 < n * 10) want <<= 1;
+        if (want > slots_.size()) rehash(want);
+    }
+
+    void clear() {
+        terms_.clear();
+        arena_.clear();
+        std::fill(slots_.begin(), slots_.end(), Slot{});
+    }
+
+    // Approximate heap footprint
+    size_t bytes() const {
+        return arena_.bytes() + terms_.capacity() * sizeof(std::string_view) +
+               slots_.capacity() * sizeof(Slot);
+    }
+
+private:
+    static constexpr uint32_t EMPTY = UINT32_MAX;
+
+    struct Slot {
+        uint32_t id = EMPTY;
+        uint32_t tag = 0; // term hash (also picks the home slot)
+    };
+
+    std::vector<Slot> slots_;
+    std::vector<std::string_view> terms_;
+    StringArena arena_;
+
+    static uint32_t hash_of(std::string_view s) {
+        uint64_t h = (uint64_t)std::hash<std::string_view>{}(s);
+        return (uint32_t)(h ^ (h >> 32));
+    }
+
+    void grow() { rehash(slots_.empty() ? 16 : slots_.size() * 2); }
+
+    // Re-place slots into a bigger table from their cached hashes
+    void rehash(size_t n) {
+        std::vector<Slot> next(n);
+        size_t mask = n - 1;
+        for (const Slot& s : slots_) {
+            if (s.id == EMPTY) continue;
+            size_t i = s.tag & mask;
+            while (next[i].id != EMPTY) i = (i + 1) & mask;
+            next[i] = s;
+        }
+        slots_.swap(next);
+    }
+};
+
+// Per-document term frequencies over dense term ids.
+// Reused across documents: clear() only resets the ids that were touched.
+class TermCounter {
+public:
+    // Count one occurrence (returns true on the first occurrence in this document)
+    bool add(uint32_t id) {
+        if (id >= counts_.size()) counts_.resize(std::max<size_t>((size_t)id + 1, counts_.size() * 2), 0);
+        if (counts_[id]++ != 0) return false;
+        ids_.push_back(id);
+        return true;
+    }
+
+    // Distinct ids in first-occurrence order
+    const std::vector<uint32_t>& ids() const { return ids_; }
+    uint32_t count(uint32_t id) const { return counts_[id]; }
+
+    void clear() {
+        for (uint32_t id : ids_) counts_[id] = 0;
+        ids_.clear();
+    }
+
+private:
+    std::vector<uint32_t> counts_;
+    std::vector<uint32_t> ids_;
+};
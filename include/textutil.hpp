@@ -1,7 +1,7 @@
 #pragma once
 #include <string>
+#include <string_view>
 #include <vector>
-#include <unordered_set>
 #include <cctype>
 
 inline std::string to_lower_ascii(std::string s) {
@@ -9,29 +9,62 @@ inline std::string to_lower_ascii(std::string s) {
     return s;
 }
 
-// Very simple tokenizer: keeps [a-z0-9] runs, lowercases
-inline std::vector<std::string> tokenize(const std::string& text) {
-    std::vector<std::string> out;
-    std::string cur;
-    cur.reserve(32);
-
-    for (unsigned char uc : text) {
-        char c = (char)uc;
-        if (std::isalnum(uc)) {
-            cur.push_back((char)std::tolower(uc));
-        } else {
-            if (!cur.empty()) { out.push_back(cur); cur.clear(); }
+// Byte -> lowercase token char, or 0 for separators (ASCII [A-Za-z0-9] only, no locale)
+struct TokenCharTable {
+    unsigned char map[256] = {};
+    constexpr TokenCharTable() {
+        for (int c = '0'; c <= '9'; c++) map[c] = (unsigned char)c;
+        for (int c = 'a'; c <= 'z'; c++) map[c] = (unsigned char)c;
+        for (int c = 'A'; c <= 'Z'; c++) map[c] = (unsigned char)(c - 'A' + 'a');
+    }
+};
+inline constexpr TokenCharTable TOKEN_CHARS{};
+
+// Scratch space reused across tokenize() calls
+struct TokenBuffer {
+    std::string lowered;                 // lowercased copy of the text
+    std::vector<std::string_view> tokens; // views into `lowered`
+};
+
+// Very simple tokenizer: keeps [a-z0-9] runs, lowercases.
+// Tokens are views into buf and stay valid until buf is reused.
+inline const std::vector<std::string_view>& tokenize(std::string_view text, TokenBuffer& buf) {
+    buf.lowered.resize(text.size());
+    buf.tokens.clear();
+
+    const char* src = text.data();
+    char* dst = buf.lowered.data();
+    size_t n = text.size();
+    size_t start = 0;
+    bool in_token = false;
+
+    for (size_t i = 0; i < n; i++) {
+        unsigned char c = TOKEN_CHARS.map[(unsigned char)src[i]];
+        dst[i] = (char)c;
+        if (c) {
+            if (!in_token) { start = i; in_token = true; }
+        } else if (in_token) {
+            buf.tokens.emplace_back(dst + start, i - start);
+            in_token = false;
         }
     }
-    if (!cur.empty()) out.push_back(cur);
-    return out;
+    if (in_token) buf.tokens.emplace_back(dst + start, n - start);
+    return buf.tokens;
 }
 
 // Optional tiny stoplist (add/remove as you want)
-inline bool is_stopword(const std::string& t) {
-    static const std::unordered_set<std::string> sw = {
+inline bool is_stopword(std::string_view t) {
+    static constexpr std::string_view sw[] = {
         "the","a","an","and","or","of","to","in","for","on","with","by","as",
         "is","are","was","were","be","been","it","this","that","from","at"
     };
-    return sw.find(t) != sw.end();
+    if (t.size() > 4) return false;
+    for (auto w : sw)
+        if (w == t) return true;
+    return false;
+}
+
+// Tokens that are indexed and searched (at least 2 chars, not a stopword)
+inline bool is_index_term(std::string_view t) {
+    return t.size() >= 2 && !is_stopword(t);
 }
@@ -0,0 +1,101 @@
+#pragma once
+
+#include <atomic>
+#include <chrono>
+#include <cstddef>
+#include <functional>
+#include <future>
+#include <memory>
+#include <string>
+#include <thread>
+#include <utility>
+#include <vector>
+
+#include "parallel.hpp"
+
+namespace cord19 {
+
+// Outcome of one upstream call (status 0 if no response was received)
+struct UpstreamResult {
+    int status = 0;
+    std::string body;
+    std::string error; // why the call failed (empty on a response)
+
+    bool ok() const { return status == 200 && error.empty(); } // a cut-off stream keeps its status
+};
+
+// HTTP(S) client for slow upstream services (the LLM API).
+//
+// Calls go through a bounded queue to a fixed set of worker threads, each
+// holding one keep-alive connection that is reused across calls, so no call
+// pays a new TCP + TLS handshake and at most `connections` calls are in
+// progress at once. Every call has a deadline: it fails if it is still
+// queued at the deadline, the connection's read/write timeouts are cut to
+// the time left, and callers stop waiting once it passes. A full queue fails
+// a call at once instead of blocking the caller.
+//
+// base_url is "http://host[:port]" or "https://host[:port]" (no scheme means https),
+// so the client can be pointed at a local mock server.
+class UpstreamClient {
+public:
+    using Clock = std::chrono::steady_clock;
+    using Headers = std::vector<std::pair<std::string, std::string>>;
+
+    struct Options {
+        size_t connections = 4;     // worker threads, one keep-alive connection each
+        size_t queue_capacity = 64; // calls waiting for a connection
+        std::chrono::milliseconds connect_timeout{10000};
+    };
+
+    // Pieces of a streamed body buffered between the worker and the caller
+    static constexpr size_t STREAM_QUEUE_CHUNKS = 256;
+
+    UpstreamClient(const std::string& base_url, const Options& opt);
+    ~UpstreamClient(); // fails queued calls and joins the workers
+
+    UpstreamClient(const UpstreamClient&) = delete;
+    UpstreamClient& operator=(const UpstreamClient&) = delete;
+
+    // Queue a POST of a JSON body; the future is ready once the call has a response or has failed
+    std::future<UpstreamResult> post_async(const std::string& path, Headers headers, std::string body,
+                                           Clock::time_point deadline);
+
+    // post_async, then wait until the deadline
+    UpstreamResult post(const std::string& path, Headers headers, std::string body,
+                        std::chrono::milliseconds timeout);
+
+    // POST for a streamed response: body pieces of a 200 response are passed to on_data
+    // on the calling thread as they arrive (the result's body stays empty), and on_data
+    // returning false cancels the call. Blocks until the call is done or the deadline passes.
+    UpstreamResult post_stream(const std::string& path, Headers headers, std::string body,
+                               std::chrono::milliseconds timeout,
+                               const std::function<bool(const std::string&)>& on_data);
+
+    const std::string& base_url() const { return base_url_; }
+    size_t queued() const { return queue_.size(); }
+
+    // "scheme://host[:port]" without a trailing '/' (https:// is added if no scheme is given)
+    static std::string normalize_base_url(std::string url);
+
+private:
+    struct Call {
+        std::string path;
+        Headers headers;
+        std::string body;
+        Clock::time_point deadline;
+        std::promise<UpstreamResult> done;
+        std::shared_ptr<BoundedQueue<std::string>> chunks; // set for streamed calls
+    };
+
+    std::string base_url_;
+    Options opt_;
+    BoundedQueue<std::shared_ptr<Call>> queue_;
+    std::vector<std::thread> workers_;
+    std::atomic<bool> stopping_{false};
+
+    void worker_loop();
+    std::future<UpstreamResult> enqueue(std::shared_ptr<Call> call);
+    static void finish(Call& call, UpstreamResult r);
+};
+
+} // namespace cord19
@@ -50,6 +50,9 @@ int main(int argc, char* argv[]) {
 
     // List of files and directories to backup
     std::vector<std::string> items_to_backup = {
+        "search_cache.bin",
+        "ai_overview_cache.bin",
+        "ai_summary_cache.bin",
         "search_cache.json",
         "ai_overview_cache.json",
         "ai_summary_cache.json",
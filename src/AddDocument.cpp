@@ -6,9 +6,9 @@
 #include <vector>
 #include <string>
 
-#include "cordjson.hpp"
-#include "textutil.hpp"
+#include "doc_tokenizer.hpp"
 #include "indexio.hpp"
+#include "spimi_writer.hpp"
 
 namespace fs = std::filesystem;
 
@@ -66,102 +66,23 @@ int main(int argc, char** argv) {
     std::string raw = read_file_all(json_path);
     if (raw.empty()) return 1;
 
-    json j;
-    try { j = json::parse(raw); } catch(...) { return 1; }
-
-    std::string text = extract_text_from_cord_json(j);
-    auto toks = tokenize(text);
-
-    std::unordered_map<std::string, uint32_t> tf;
-    uint32_t doc_len = 0;
-    for (auto& t : toks) {
-        if (t.size() < 2) continue;
-        if (is_stopword(t)) continue;
-        tf[t] += 1;
-        doc_len += 1;
-    }
-    if (doc_len == 0) return 1;
-
-    // Build term list + forward for single doc
-    std::vector<std::string> id_to_term;
-    id_to_term.reserve(tf.size());
-    std::unordered_map<std::string, uint32_t> term_to_id;
-    term_to_id.reserve(tf.size()*2+1);
-
-    std::vector<std::pair<uint32_t,uint32_t>> fwd;
-    fwd.reserve(tf.size());
-
-    for (auto& kv : tf) {
-        uint32_t tid = (uint32_t)id_to_term.size();
-        term_to_id.emplace(kv.first, tid);
-        id_to_term.push_back(kv.first);
-        fwd.push_back({tid, kv.second});
-    }
-    std::sort(fwd.begin(), fwd.end());
-
-    // Write docs.bin (1 doc)
-    {
-        std::ofstream out(segdir / "docs.bin", std::ios::binary);
-        write_u32(out, 1);
-        write_string(out, cord_uid);
-        write_string(out, title);
-        write_string(out, relpath);
-        write_u32(out, doc_len);
-    }
-
-    // stats.bin
-    {
-        std::ofstream out(segdir / "stats.bin", std::ios::binary);
-        write_u32(out, 1);
-        write_f32(out, (float)doc_len);
-    }
-
-    // forward.bin
-    {
-        std::ofstream out(segdir / "forward.bin", std::ios::binary);
-        write_u32(out, 1);
-        write_u32(out, (uint32_t)fwd.size());
-        for (auto& [tid, tfv] : fwd) {
-            write_u32(out, tid);
-            write_u32(out, tfv);
-        }
-    }
-
-    // terms.bin
-    {
-        std::ofstream out(segdir / "terms.bin", std::ios::binary);
-        write_u32(out, (uint32_t)id_to_term.size());
-        for (auto& t : id_to_term) write_string(out, t);
-    }
-
-    // Now build lexicon+inverted for this segment (same logic as lexicon.cpp but inline)
-    // inverted postings: since only 1 doc, postings list per term is either empty or (doc0, tf)
-    {
-        std::ofstream inv(segdir / "inverted.bin", std::ios::binary);
-        std::ofstream lex(segdir / "lexicon.bin", std::ios::binary);
-        write_u32(lex, (uint32_t)id_to_term.size());
-
-        uint64_t offset = 0;
-        for (uint32_t tid=0; tid<(uint32_t)id_to_term.size(); tid++) {
-            uint32_t df = 0;
-            uint32_t tfv = 0;
-
-            // Find tf for tid
-            // (we can build a small array instead, but fine for 1 doc)
-            for (auto& p : fwd) if (p.first == tid) { df = 1; tfv = p.second; break; }
-
-            write_string(lex, id_to_term[tid]);
-            write_u32(lex, tid);
-            write_u32(lex, df);
-            write_u64(lex, offset);
-            write_u32(lex, df);
-
-            if (df == 1) {
-                write_u32(inv, 0);      // docId=0
-                write_u32(inv, tfv);
-                offset += (sizeof(uint32_t) * 2);
-            }
-        }
+    // Tokenize title, abstract and body as forwardindex does, with term positions
+    // and field tfs, so the segment is scored with BM25F like the main segment
+    TokenizeOptions opt;
+    SpimiWriter writer(segdir, SPIMI_DEFAULT_BUDGET_MB * 1024 * 1024, opt.positions, opt.fields);
+    TokenizeScratch ws;
+    TokenizedDoc doc;
+    if (!tokenize_document(raw, title, writer.terms, ws, opt, doc)) return 1;
+
+    // Write docs, forward, stats, terms and barrel files (positions and fields included)
+    std::vector<std::pair<uint32_t,uint32_t>> postings;
+    std::vector<uint8_t> positions;
+    std::vector<uint16_t> field_tfs;
+    sorted_postings(doc, nullptr, opt, postings, positions, field_tfs);
+    DocMeta meta{cord_uid, title, relpath, doc.doc_len, doc.title_len, doc.abstract_len};
+    if (!writer.open() || !writer.add_document(meta, postings, &positions, &field_tfs) || !writer.finish()) {
+        std::cerr << "Failed to build segment: " << segdir << "\n";
+        return 1;
     }
 
     // Update manifest
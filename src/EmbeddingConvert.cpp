@@ -0,0 +1,62 @@
+#include <filesystem>
+#include <iostream>
+#include <string>
+#include <unordered_set>
+#include <vector>
+
+#include "api_segment.hpp"
+#include "semantic_embedding.hpp"
+
+namespace fs = std::filesystem;
+
+int main(int argc, char** argv) {
+
+    // Validate command-line arguments
+    if (argc < 3) {
+        std::cerr << "Usage: embeddingconvert <INDEX_DIR> <EMBEDDINGS_TXT> [OUT_BIN]\n"
+                  << "Writes vectors for the index vocabulary to OUT_BIN "
+                  << "(default: <INDEX_DIR>/embeddings.bin)\n";
+        return 1;
+    }
+
+    fs::path index_dir = fs::path(argv[1]);
+    fs::path emb_path  = fs::path(argv[2]);
+    fs::path out_path  = (argc >= 4) ? fs::path(argv[3]) : index_dir / "embeddings.bin";
+
+    // Gather vocabulary from all segment lexicons
+    auto names = cord19::list_segment_names(index_dir);
+    if (names.empty()) {
+        std::cerr << "No segments found in: " << index_dir << "\n";
+        return 1;
+    }
+
+    std::unordered_set<std::string> needed_terms;
+    needed_terms.reserve(250000);
+    for (auto& name : names) {
+        cord19::Segment s;
+        fs::path segdir = index_dir / "segments" / name;
+        if (!cord19::load_segment(segdir, s)) {
+            std::cerr << "Failed to load segment: " << segdir << "\n";
+            return 1;
+        }
+        for (const auto& kv : s.lex) needed_terms.insert(kv.first);
+    }
+    std::cerr << "Vocabulary: " << needed_terms.size() << " terms from "
+              << names.size() << " segments\n";
+
+    // Load text vectors restricted to the vocabulary
+    cord19::SemanticIndex sem;
+    if (!sem.load_from_text(emb_path, needed_terms)) {
+        std::cerr << "No usable vectors loaded from: " << emb_path << "\n";
+        return 1;
+    }
+
+    // Write binary file
+    if (!sem.save_binary(out_path)) {
+        std::cerr << "Failed to write: " << out_path << "\n";
+        return 1;
+    }
+
+    std::cerr << "Wrote " << sem.size() << " vectors (dim=" << sem.dim << ") to: " << out_path << "\n";
+    return 0;
+}
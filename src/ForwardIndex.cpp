@@ -1,24 +1,22 @@
 #include <filesystem>
 #include <fstream>
 #include <iostream>
-#include <unordered_map>
 #include <vector>
 #include <algorithm>
+#include <atomic>
+#include <condition_variable>
+#include <map>
+#include <mutex>
+#include <thread>
 
 #include "cordjson.hpp"
-#include "textutil.hpp"
-#include "indexio.hpp"
+#include "doc_tokenizer.hpp"
+#include "spimi_writer.hpp"
+#include "term_dict.hpp"
+#include "parallel.hpp"
 
 namespace fs = std::filesystem;
 
-// Store per-document metadata
-struct DocInfo {
-    std::string cord_uid;
-    std::string title;
-    std::string json_relpath;
-    uint32_t doc_len;
-};
-
 // Split a CSV line into columns
 static std::vector<std::string> split_csv_line(const std::string& line) {
     std::vector<std::string> cols;
@@ -51,18 +49,62 @@ static std::string pick_first_path(const std::string& s) {
     return first;
 }
 
+// One indexable metadata row with its raw JSON (seq = position in file order)
+struct DocJob {
+    uint64_t seq = 0;
+    DocMeta meta;
+    std::string raw;
+};
+
+// Tokenized document; termIds are local to the worker that parsed it
+struct DocResult {
+    uint64_t seq = 0;
+    size_t worker = 0;
+    bool ok = false;
+    DocMeta meta;
+    std::vector<std::string_view> new_terms; // local termIds first assigned by this doc (worker arena)
+    TokenizedDoc doc;
+};
+
 int main(int argc, char** argv) {
 
     // Validate command-line arguments
     if (argc < 3) {
-        std::cerr << "Usage: forwardindex <CORD_ROOT> <SEGMENT_DIR>\n";
+        std::cerr << "Usage: forwardindex <CORD_ROOT> <SEGMENT_DIR> [MEMORY_MB] [THREADS]\n"
+                  << "                    [--no-positions] [--no-fields] [--abstract-only]\n"
+                  << "Builds a complete barrelized segment in one pass; postings are\n"
+                  << "spilled to sorted runs whenever MEMORY_MB (default "
+                  << SPIMI_DEFAULT_BUDGET_MB << ") is exceeded.\n"
+                  << "THREADS parse/tokenize workers (default: all cores); output does not\n"
+                  << "depend on the thread count.\n"
+                  << "Term positions (phrase queries, proximity ranking) are written unless\n"
+                  << "--no-positions is given, and per-field tfs (BM25F) unless --no-fields is.\n"
+                  << "--abstract-only indexes titles and abstracts only (smaller, faster index).\n";
+        return 1;
+    }
+
+    // Separate flags from positional arguments
+    TokenizeOptions opt;
+    std::vector<std::string> args;
+    for (int i = 1; i < argc; i++) {
+        std::string a = argv[i];
+        if (a == "--no-positions") opt.positions = false;
+        else if (a == "--no-fields") opt.fields = false;
+        else if (a == "--abstract-only") opt.abstract_only = true;
+        else args.push_back(a);
+    }
+    if (args.size() < 2) {
+        std::cerr << "Missing <CORD_ROOT> or <SEGMENT_DIR>\n";
         return 1;
     }
 
     // Setup root and segment directories
-    fs::path root = fs::path(argv[1]);
-    fs::path seg  = fs::path(argv[2]);
-    fs::create_directories(seg);
+    fs::path root = fs::path(args[0]);
+    fs::path seg  = fs::path(args[1]);
+    size_t memory_mb = (args.size() >= 3) ? (size_t)std::stoull(args[2]) : SPIMI_DEFAULT_BUDGET_MB;
+    if (memory_mb == 0) memory_mb = 1;
+    size_t nthreads = (args.size() >= 4) ? (size_t)std::stoul(args[3]) : 0;
+    if (nthreads == 0) nthreads = std::max<size_t>(1, std::thread::hardware_concurrency());
 
     // Locate metadata.csv
     fs::path meta = root / "metadata.csv";
@@ -95,139 +137,150 @@ int main(int argc, char** argv) {
         return 1;
     }
 
-    // Global term dictionary
-    std::unordered_map<std::string, uint32_t> term_to_id;
-    term_to_id.reserve(400000);
-    std::vector<std::string> id_to_term;
-
-    // Per-document storage
-    std::vector<DocInfo> docs;
-    std::vector<std::vector<std::pair<uint32_t, uint32_t>>> forward;
-    uint64_t total_len = 0;
-
-    std::string line;
-    while (std::getline(in, line)) {
-        if (line.empty()) continue;
-
-        // Parse one metadata row
-        auto cols = split_csv_line(line);
-        if ((int)cols.size() <= std::max({i_uid, i_title, i_pdf, i_pmc})) continue;
-
-        std::string cord_uid = cols[i_uid];
-        std::string title    = cols[i_title];
-
-        // Pick JSON path (PMC preferred, fallback to PDF)
-        std::string pmc_rel = pick_first_path(cols[i_pmc]);
-        std::string pdf_rel = pick_first_path(cols[i_pdf]);
-        std::string rel = !pmc_rel.empty() ? pmc_rel : pdf_rel;
-        if (rel.empty()) continue;
-
-        fs::path json_path = root / fs::path(rel);
-        if (!fs::exists(json_path)) continue;
-
-        // Read and parse JSON
-        std::string raw = read_file_all(json_path);
-        if (raw.empty()) continue;
-
-        json j;
-        try { j = json::parse(raw); } catch (...) { continue; }
-
-        // Extract and tokenize text
-        std::string text = extract_text_from_cord_json(j);
-        if (text.empty()) continue;
-
-        auto toks = tokenize(text);
-
-        // Build term frequency map
-        std::unordered_map<std::string, uint32_t> tf;
-        tf.reserve(toks.size() / 2 + 8);
-
-        uint32_t doc_len = 0;
-        for (auto& t : toks) {
-            if (t.size() < 2) continue;
-            if (is_stopword(t)) continue;
-            tf[t] += 1;
-            doc_len += 1;
-        }
-        if (doc_len == 0) continue;
-
-        // Store document info
-        uint32_t docId = (uint32_t)docs.size();
-        docs.push_back(DocInfo{cord_uid, title, rel, doc_len});
-        total_len += doc_len;
-
-        // Build forward postings for this doc
-        std::vector<std::pair<uint32_t, uint32_t>> postings;
-        postings.reserve(tf.size());
-
-        for (auto& kv : tf) {
-            auto it = term_to_id.find(kv.first);
-            uint32_t tid;
-
-            if (it == term_to_id.end()) {
-                tid = (uint32_t)id_to_term.size();
-                term_to_id.emplace(kv.first, tid);
-                id_to_term.push_back(kv.first);
-            } else {
-                tid = it->second;
+    // Single-pass segment builder (owns the global term dictionary)
+    SpimiWriter writer(seg, memory_mb * 1024 * 1024, opt.positions, opt.fields);
+    writer.terms.reserve(400000);
+    if (!writer.open()) return 1;
+
+    // Pipeline: reader -> parse/tokenize workers -> ordered merge (this thread)
+    const uint64_t window = nthreads * 8; // docs in flight between reader and merge
+    BoundedQueue<DocJob> jobs(nthreads * 2);
+    BoundedQueue<DocResult> results(window);
+    std::mutex window_mtx;
+    std::condition_variable window_cv;
+    uint64_t merged = 0;
+    bool aborted = false;
+
+    // Reader: pick indexable rows and load their JSON in file order
+    std::thread reader([&] {
+        uint64_t seq = 0;
+        std::string line;
+        while (std::getline(in, line)) {
+            if (line.empty()) continue;
+
+            // Parse one metadata row
+            auto cols = split_csv_line(line);
+            if ((int)cols.size() <= std::max({i_uid, i_title, i_pdf, i_pmc})) continue;
+
+            // Pick JSON path (PMC preferred, fallback to PDF)
+            std::string pmc_rel = pick_first_path(cols[i_pmc]);
+            std::string pdf_rel = pick_first_path(cols[i_pdf]);
+            std::string rel = !pmc_rel.empty() ? pmc_rel : pdf_rel;
+            if (rel.empty()) continue;
+
+            fs::path json_path = root / fs::path(rel);
+            if (!fs::exists(json_path)) continue;
+
+            std::string raw = read_file_all(json_path);
+            if (raw.empty()) continue;
+
+            // Stay within the reorder window of the merge stage
+            {
+                std::unique_lock<std::mutex> lk(window_mtx);
+                window_cv.wait(lk, [&] { return aborted || seq - merged < window; });
+                if (aborted) break;
             }
 
-            postings.push_back({tid, kv.second});
+            DocJob job;
+            job.seq = seq++;
+            job.meta = DocMeta{cols[i_uid], cols[i_title], rel, 0};
+            job.raw = std::move(raw);
+            if (!jobs.push(std::move(job))) break;
         }
-
-        std::sort(postings.begin(), postings.end());
-        forward.push_back(std::move(postings));
-
-        // Progress logging
-        if (docId % 1000 == 0)
-            std::cerr << "Docs: " << docId << "\n";
+        jobs.close();
+    });
+
+    // Workers: parse and tokenize with thread-local term dictionaries
+    // (owned here so new_terms views stay valid until the merge has used them)
+    std::vector<TermDict> local_terms(nthreads);
+    std::atomic<size_t> live_workers{nthreads};
+    std::vector<std::thread> workers;
+    for (size_t w = 0; w < nthreads; w++) {
+        workers.emplace_back([&, w] {
+            TokenizeScratch ws;
+            DocJob job;
+            while (jobs.pop(job)) {
+                DocResult r;
+                r.seq = job.seq;
+                r.worker = w;
+                r.meta = std::move(job.meta);
+                r.ok = tokenize_document(job.raw, r.meta.title, local_terms[w], ws, opt, r.doc, &r.new_terms);
+                r.meta.doc_len = r.doc.doc_len;
+                r.meta.title_len = r.doc.title_len;
+                r.meta.abstract_len = r.doc.abstract_len;
+                if (!results.push(std::move(r))) break;
+            }
+            if (live_workers.fetch_sub(1) == 1) results.close();
+        });
     }
 
-    // Compute average document length
-    float avgdl = docs.empty() ? 0.0f : (float)total_len / (float)docs.size();
-
-    // Write docs.bin
-    {
-        std::ofstream out(seg / "docs.bin", std::ios::binary);
-        write_u32(out, (uint32_t)docs.size());
-        for (auto& d : docs) {
-            write_string(out, d.cord_uid);
-            write_string(out, d.title);
-            write_string(out, d.json_relpath);
-            write_u32(out, d.doc_len);
-        }
-    }
+    // Merge: take docs in file order and assign global termIds and docIds
+    std::vector<std::vector<uint32_t>> local_to_global(nthreads);
+    std::map<uint64_t, DocResult> reorder;
+    uint64_t next_seq = 0;
+    bool ok = true;
+    std::vector<std::pair<uint32_t, uint32_t>> postings;
+    std::vector<uint8_t> positions;
+    std::vector<uint16_t> field_tfs;
+
+    DocResult r;
+    while (ok && results.pop(r)) {
+        uint64_t seq = r.seq;
+        reorder.emplace(seq, std::move(r));
+
+        for (auto it = reorder.find(next_seq); ok && it != reorder.end(); it = reorder.find(next_seq)) {
+            DocResult& d = it->second;
+
+            // Terms new to the worker are interned in the order the sequential path would see them
+            auto& xlat = local_to_global[d.worker];
+            for (auto& t : d.new_terms) xlat.push_back(writer.intern_term(t));
+
+            if (d.ok) {
+                // Build forward postings for this doc, ordered by global termId
+                uint32_t docId = writer.doc_count();
+                sorted_postings(d.doc, &xlat, opt, postings, positions, field_tfs);
+                ok = writer.add_document(d.meta, postings, opt.positions ? &positions : nullptr,
+                                         opt.fields ? &field_tfs : nullptr);
+
+                // Progress logging
+                if (docId % 1000 == 0)
+                    std::cerr << "Docs: " << docId << "\n";
+            }
 
-    // Write stats.bin
-    {
-        std::ofstream out(seg / "stats.bin", std::ios::binary);
-        write_u32(out, (uint32_t)docs.size());
-        write_f32(out, avgdl);
+            reorder.erase(it);
+            next_seq++;
+            {
+                std::lock_guard<std::mutex> lk(window_mtx);
+                merged = next_seq;
+            }
+            window_cv.notify_all();
+        }
     }
 
-    // Write forward.bin
-    {
-        std::ofstream out(seg / "forward.bin", std::ios::binary);
-        write_u32(out, (uint32_t)forward.size());
-        for (auto& vec : forward) {
-            write_u32(out, (uint32_t)vec.size());
-            for (auto& [tid, tfv] : vec) {
-                write_u32(out, tid);
-                write_u32(out, tfv);
-            }
+    // Unblock the other stages if the merge failed
+    if (!ok) {
+        {
+            std::lock_guard<std::mutex> lk(window_mtx);
+            aborted = true;
         }
+        window_cv.notify_all();
+        jobs.close();
+        results.close();
+    }
+    reader.join();
+    for (auto& t : workers) t.join();
+    if (!ok) {
+        std::cerr << "Failed to write segment: " << seg << "\n";
+        return 1;
     }
 
-    // Write terms.bin
-    {
-        std::ofstream out(seg / "terms.bin", std::ios::binary);
-        write_u32(out, (uint32_t)id_to_term.size());
-        for (auto& t : id_to_term)
-            write_string(out, t);
+    // Merge spilled runs into the barrel files
+    if (!writer.finish()) {
+        std::cerr << "Failed to build segment: " << seg << "\n";
+        return 1;
     }
 
-    // Final instructions
-    std::cerr << "Wrote forward+terms+docs+stats to segment: " << seg << "\n";
-    std::cerr << "Now run: lexicon.exe " << seg << "\n";
+    std::cerr << "Built " << writer.doc_count() << " docs, " << writer.terms.size()
+              << " terms from " << writer.run_count() << " run(s) in segment: " << seg << "\n";
     return 0;
 }
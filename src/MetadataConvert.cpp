@@ -0,0 +1,57 @@
+#include <filesystem>
+#include <iostream>
+
+#include "api_segment.hpp"
+#include "metadata_store.hpp"
+
+namespace fs = std::filesystem;
+
+int main(int argc, char** argv) {
+
+    // Validate command-line arguments
+    if (argc < 2) {
+        std::cerr << "Usage: metadataconvert <INDEX_DIR> [METADATA_CSV]\n"
+                  << "Writes a memory-mappable metadata store to <INDEX_DIR>/metadata.bin\n"
+                  << "(METADATA_CSV defaults to <INDEX_DIR>/metadata.csv) and resolves\n"
+                  << "every segment doc to its store row (segments/*/docrows.bin)\n";
+        return 1;
+    }
+
+    fs::path index_dir = fs::path(argv[1]);
+    fs::path csv_path = (argc >= 3) ? fs::path(argv[2]) : index_dir / "metadata.csv";
+    fs::path out_path = index_dir / "metadata.bin";
+
+    // Convert CSV rows into column heaps
+    if (!cord19::write_metadata_store(csv_path, out_path)) {
+        std::cerr << "Failed to write: " << out_path << "\n";
+        return 1;
+    }
+
+    // Reopen to check the written file
+    cord19::MetadataStore store;
+    if (!store.open(out_path)) {
+        std::cerr << "Written store failed to open: " << out_path << "\n";
+        return 1;
+    }
+    std::cerr << "Wrote " << store.size() << " metadata rows to: " << out_path << "\n";
+
+    // Resolve segment docs to store rows once, so the server does not have to
+    auto names = cord19::list_segment_names(index_dir);
+    for (auto& name : names) {
+        cord19::Segment s;
+        fs::path segdir = index_dir / "segments" / name;
+        if (!cord19::load_segment_docs(segdir, s)) {
+            std::cerr << "Failed to load docs of segment: " << segdir << "\n";
+            return 1;
+        }
+
+        size_t missing = cord19::resolve_doc_rows(store, s);
+        if (!cord19::write_doc_rows(segdir, store, s)) {
+            std::cerr << "Failed to write: " << cord19::doc_rows_path(segdir) << "\n";
+            return 1;
+        }
+        std::cerr << "Resolved " << (s.docs.size() - missing) << "/" << s.docs.size()
+                  << " docs of " << name << "\n";
+    }
+    return 0;
+}
@@ -7,7 +7,6 @@
 #include <random>
 #include <sstream>
 #include <string>
-#include <unordered_map>
 #include <vector>
 #include <algorithm>
 #include <cstdlib>
@@ -15,24 +14,13 @@
 
 #include "api_http.hpp"
 #include "api_segment.hpp"
-#include "barrels.hpp"
-#include "cordjson.hpp"
-#include "indexio.hpp"
-#include "textutil.hpp"
+#include "doc_tokenizer.hpp"
+#include "spimi_writer.hpp"
 
 namespace cord19 {
 
 namespace fs = std::filesystem;
 
-// IMPORTANT: api_types.hpp already defines cord19::DocInfo,
-// so we must NOT redefine it here.
-struct SliceDocInfo {
-    std::string cord_uid;
-    std::string title;
-    std::string json_relpath;
-    uint32_t doc_len = 0;
-};
-
 static std::string rand_hex(size_t n) {
     static thread_local std::mt19937_64 rng{std::random_device{}()};
     std::uniform_int_distribution<uint32_t> dist(0, 15);
@@ -249,7 +237,9 @@ static bool find_slice_root(const fs::path& extracted_root, fs::path& slice_root
     return false;
 }
 
-static bool build_forward_terms_docs_stats_from_slice(
+// Build a complete barrelized segment from an uploaded CORD-19 slice, tokenized
+// like forwardindex: title, abstract and body, with term positions and field tfs
+static bool build_segment_from_slice(
     const fs::path& slice_root,
     const fs::path& segdir,
     uint32_t& out_num_docs,
@@ -282,25 +272,17 @@ static bool build_forward_terms_docs_stats_from_slice(
         return false;
     }
 
-    std::unordered_map<std::string, uint32_t> term_to_id;
-    term_to_id.reserve(200000);
-    std::vector<std::string> id_to_term;
-
-    std::vector<SliceDocInfo> docs;
-    docs.reserve(50000);
-
-    std::vector<std::vector<std::pair<uint32_t,uint32_t>>> forward;
-    forward.reserve(50000);
-
-    auto get_term_id = [&](const std::string& term)->uint32_t {
-        auto it = term_to_id.find(term);
-        if (it != term_to_id.end()) return it->second;
-        uint32_t id = (uint32_t)id_to_term.size();
-        id_to_term.push_back(term);
-        term_to_id.emplace(term, id);
-        return id;
-    };
-
+    // Field tfs are written too, so the segment is scored with BM25F like the main segment
+    TokenizeOptions opt;
+    SpimiWriter writer(segdir, SPIMI_DEFAULT_BUDGET_MB * 1024 * 1024, opt.positions, opt.fields);
+    writer.terms.reserve(200000);
+    if (!writer.open()) { err = "failed to create segment files"; return false; }
+
+    TokenizeScratch ws;
+    TokenizedDoc doc;
+    std::vector<std::pair<uint32_t,uint32_t>> postings;
+    std::vector<uint8_t> positions;
+    std::vector<uint16_t> field_tfs;
     std::string line;
     while (std::getline(in, line)) {
         if (line.empty()) continue;
@@ -327,201 +309,21 @@ static bool build_forward_terms_docs_stats_from_slice(
         std::string raw = read_file_all(slice_root / fs::path(rel));
         if (raw.empty()) continue;
 
-        json jdoc;
-        try { jdoc = json::parse(raw); }
-        catch (...) { continue; }
-
-        std::string text = extract_text_from_cord_json(jdoc);
-        auto toks = tokenize(text);
+        if (!tokenize_document(raw, title, writer.terms, ws, opt, doc)) continue;
+        sorted_postings(doc, nullptr, opt, postings, positions, field_tfs);
 
-        std::unordered_map<std::string, uint32_t> tf;
-        tf.reserve(toks.size());
-
-        uint32_t doc_len = 0;
-        for (auto& t : toks) {
-            if (t.size() < 2) continue;
-            if (is_stopword(t)) continue;
-            tf[t] += 1;
-            doc_len++;
-        }
-        if (doc_len == 0) continue;
-
-        std::vector<std::pair<uint32_t,uint32_t>> fwd;
-        fwd.reserve(tf.size());
-        for (auto& kv : tf) {
-            uint32_t tid = get_term_id(kv.first);
-            fwd.push_back({tid, kv.second});
+        DocMeta meta{uid, title, rel, doc.doc_len, doc.title_len, doc.abstract_len};
+        if (!writer.add_document(meta, postings, &positions, &field_tfs)) {
+            err = "failed to write segment files";
+            return false;
         }
-        std::sort(fwd.begin(), fwd.end(),
-                  [](auto& a, auto& b){ return a.first < b.first; });
-
-        SliceDocInfo di;
-        di.cord_uid = uid;
-        di.title = title;
-        di.json_relpath = rel;
-        di.doc_len = doc_len;
-
-        docs.push_back(std::move(di));
-        forward.push_back(std::move(fwd));
     }
 
-    out_num_docs = (uint32_t)docs.size();
-    if (docs.empty()) { err = "no documents could be parsed from metadata.csv paths"; return false; }
-
-    // docs.bin
-    {
-        std::ofstream out(segdir / "docs.bin", std::ios::binary);
-        if (!out) { err = "failed to write docs.bin"; return false; }
-        write_u32(out, (uint32_t)docs.size());
-        for (auto& d : docs) {
-            write_string(out, d.cord_uid);
-            write_string(out, d.title);
-            write_string(out, d.json_relpath);
-            write_u32(out, d.doc_len);
-        }
-    }
-
-    // stats.bin
-    {
-        std::ofstream out(segdir / "stats.bin", std::ios::binary);
-        if (!out) { err = "failed to write stats.bin"; return false; }
-        write_u32(out, (uint32_t)docs.size());
-        double sumdl = 0.0;
-        for (auto& d : docs) {
-            write_f32(out, (float)d.doc_len);
-            sumdl += (double)d.doc_len;
-        }
-        float avgdl = (docs.empty()) ? 0.0f : (float)(sumdl / (double)docs.size());
-        write_f32(out, avgdl);
-    }
-
-    // forward.bin
-    {
-        std::ofstream out(segdir / "forward.bin", std::ios::binary);
-        if (!out) { err = "failed to write forward.bin"; return false; }
-        write_u32(out, (uint32_t)forward.size());
-        for (auto& vec : forward) {
-            write_u32(out, (uint32_t)vec.size());
-            for (auto& p : vec) {
-                write_u32(out, p.first);
-                write_u32(out, p.second);
-            }
-        }
-    }
-
-    // terms.bin
-    {
-        std::ofstream out(segdir / "terms.bin", std::ios::binary);
-        if (!out) { err = "failed to write terms.bin"; return false; }
-        write_u32(out, (uint32_t)id_to_term.size());
-        for (auto& t : id_to_term) write_string(out, t);
-    }
-
-    return true;
-}
-
-// Posting list element
-struct Posting { uint32_t docId; uint32_t tf; };
-
-static bool build_barrelized_lexicon_from_forward(
-    const fs::path& segdir,
-    std::string& err
-) {
-    fs::path fwd_path  = segdir / "forward.bin";
-    fs::path term_path = segdir / "terms.bin";
-    if (!fs::exists(fwd_path) || !fs::exists(term_path)) {
-        err = "segment missing forward.bin or terms.bin";
-        return false;
-    }
-
-    // Load terms
-    std::vector<std::string> terms;
-    {
-        std::ifstream in(term_path, std::ios::binary);
-        if (!in) { err = "failed to open terms.bin"; return false; }
-        uint32_t n = read_u32(in);
-        terms.resize(n);
-        for (uint32_t i = 0; i < n; i++) terms[i] = read_string(in);
-    }
-
-    // Build inverted postings
-    std::vector<std::vector<Posting>> inverted(terms.size());
-    {
-        std::ifstream in(fwd_path, std::ios::binary);
-        if (!in) { err = "failed to open forward.bin"; return false; }
-
-        uint32_t numDocs = read_u32(in);
-        for (uint32_t docId = 0; docId < numDocs; docId++) {
-            uint32_t cnt = read_u32(in);
-            for (uint32_t i = 0; i < cnt; i++) {
-                uint32_t termId = read_u32(in);
-                uint32_t tf     = read_u32(in);
-                if (termId >= inverted.size()) continue;
-                inverted[termId].push_back({docId, tf});
-            }
-        }
-    }
-
-    // Write barrelized inverted + lexicon
-    {
-        BarrelParams bp;
-        bp.barrel_count = BARREL_COUNT;
-        uint32_t tcount = (uint32_t)terms.size();
-        bp.terms_per_barrel = (tcount + bp.barrel_count - 1) / bp.barrel_count;
-        if (bp.terms_per_barrel == 0) bp.terms_per_barrel = 1;
-
-        write_barrels_manifest(segdir, bp);
-
-        std::vector<std::ofstream> inv(bp.barrel_count);
-        std::vector<std::ofstream> lex(bp.barrel_count);
-        std::vector<uint64_t> offsets(bp.barrel_count, 0);
-        std::vector<uint32_t> barrel_term_counts(bp.barrel_count, 0);
-
-        for (uint32_t b = 0; b < bp.barrel_count; b++) {
-            inv[b].open(inv_barrel_path(segdir, b), std::ios::binary);
-            lex[b].open(lex_barrel_path(segdir, b), std::ios::binary);
-            if (!inv[b] || !lex[b]) { err = "failed to open barrel files for writing"; return false; }
-            write_u32(lex[b], 0); // placeholder
-        }
-
-        for (uint32_t tid = 0; tid < tcount; tid++) {
-            auto& plist = inverted[tid];
-            if (plist.empty()) continue;
-
-            std::sort(plist.begin(), plist.end(),
-                      [](const Posting& a, const Posting& b){ return a.docId < b.docId; });
-
-            uint32_t df = (uint32_t)plist.size();
-            uint32_t b  = barrel_for_term(tid, bp);
-
-            barrel_term_counts[b]++;
-
-            write_string(lex[b], terms[tid]);
-            write_u32(lex[b], tid);
-            write_u32(lex[b], df);
-            write_u64(lex[b], offsets[b]);
-            write_u32(lex[b], df);
-
-            for (auto& p : plist) {
-                write_u32(inv[b], p.docId);
-                write_u32(inv[b], p.tf);
-            }
-            offsets[b] += (uint64_t)df * (sizeof(uint32_t) * 2);
-        }
-
-        for (uint32_t b = 0; b < bp.barrel_count; b++) {
-            lex[b].flush();
-            lex[b].close();
-
-            std::ofstream patch(lex_barrel_path(segdir, b),
-                                std::ios::in | std::ios::out | std::ios::binary);
-            if (!patch) { err = "failed to patch lexicon barrel"; return false; }
-            patch.seekp(0, std::ios::beg);
-            write_u32(patch, barrel_term_counts[b]);
-            patch.flush();
-        }
-    }
+    out_num_docs = writer.doc_count();
+    if (out_num_docs == 0) { err = "no documents could be parsed from metadata.csv paths"; return false; }
 
+    // docs, forward, stats, terms and barrel files (positions and fields included)
+    if (!writer.finish()) { err = "failed to build segment barrels"; return false; }
     return true;
 }
 
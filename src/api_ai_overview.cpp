@@ -1,7 +1,6 @@
 #include "api_ai_overview.hpp"
 #include "api_engine.hpp"
 #include "api_stats.hpp"
-#include "third_party/httplib.h"
 #include <iostream>
 #include <sstream>
 
@@ -76,94 +75,24 @@ static std::string build_user_prompt(const std::string& query, const json& searc
     return oss.str();
 }
 
-// Helper function to make HTTPS POST request using httplib (cross-platform)
-static std::string make_https_post(const std::string& url, const std::string& path, 
-                                   const std::string& api_key, const std::string& body) {
-    try {
-        // Parse URL to extract host
-        std::string host = url;
-        if (host.find("https://") == 0) {
-            host = host.substr(8);
-        }
-        if (host.back() == '/') {
-            host.pop_back();
-        }
-        
-        // Create HTTPS client
-        httplib::SSLClient cli(host);
-        cli.set_connection_timeout(30, 0); // 30 seconds
-        cli.set_read_timeout(60, 0);       // 60 seconds
-        cli.set_write_timeout(60, 0);      // 60 seconds
-        
-        // Set headers
-        httplib::Headers headers = {
-            {"Content-Type", "application/json"},
-            {"api-key", api_key}
-        };
-        
-        // Make POST request
-        auto res = cli.Post(path.c_str(), headers, body, "application/json");
-        
-        if (res && res->status == 200) {
-            return res->body;
-        } else {
-            std::cerr << "[https_post] Request failed";
-            if (res) {
-                std::cerr << " - Status: " << res->status;
-            }
-            std::cerr << "\n";
-            return "";
-        }
-        
-    } catch (const std::exception& e) {
-        std::cerr << "[https_post] Exception: " << e.what() << "\n";
-        return "";
-    }
+// Overviews are built from the search results, which are shared by every spelling
+// of a query, so they are cached and shared under the normalized query as well
+static std::string ai_overview_cache_key(Engine& engine, const std::string& query, int k) {
+    return engine.make_cache_key(Engine::normalize_query(query), k);
 }
 
-json generate_ai_overview(const AzureOpenAIConfig& config,
-                          const std::string& query,
-                          int k,
-                          const json& search_results,
-                          Engine* engine,
-                          StatsTracker* stats,
-                          bool is_authorized) {
+// Call Azure OpenAI for an overview and cache a successful response
+static json request_ai_overview(const AzureOpenAIConfig& config,
+                                const std::string& query,
+                                int k,
+                                const json& search_results,
+                                Engine* engine,
+                                StatsTracker* stats,
+                                bool is_authorized,
+                                const OverviewDeltaFn& on_delta) {
     json response_json;
     
-    // Track AI overview call
-    if (stats) {
-        stats->increment_ai_overview_calls();
-    }
-    
-    // Check cache first if engine is provided
-    if (engine) {
-        std::string cache_key = engine->make_cache_key(query, k);
-        
-        std::lock_guard<std::mutex> lock(engine->mtx);
-        json cached = engine->get_ai_overview_from_cache(cache_key);
-        
-        if (!cached.is_null() && cached.contains("from_cache")) {
-            std::cerr << "[ai_overview] Cache HIT for query: \"" << query << "\" k=" << k << "\n";
-            
-            // Track cache hit
-            if (stats) {
-                stats->increment_ai_overview_cache_hits();
-            }
-            
-            // Remove internal flag and add user-visible flag
-            cached.erase("from_cache");
-            cached["cached"] = true;
-            return cached;
-        }
-        
-        std::cerr << "[ai_overview] Cache MISS for query: \"" << query << "\" k=" << k << "\n";
-    }
-    
     try {
-        // Build the API path
-        std::string path = "/openai/deployments/" + config.model + 
-                          "/chat/completions?api-version=" + config.api_version;
-        
         // Build the request body
         json request_body;
         request_body["messages"] = json::array();
@@ -182,10 +111,13 @@ json generate_ai_overview(const AzureOpenAIConfig& config,
         
         // Set parameters
         request_body["max_completion_tokens"] = 1000;
+        if (on_delta) {
+            request_body["stream"] = true;
+        }
         
         std::string body_str = request_body.dump();
         
-        std::cerr << "[azure_openai] Calling Azure OpenAI at " << config.endpoint << path << "\n";
+        std::cerr << "[azure_openai] Calling Azure OpenAI at " << config.endpoint << "\n";
         
         // Decrement AI API calls remaining only for unauthorized requests
         if (stats && !is_authorized) {
@@ -195,23 +127,40 @@ json generate_ai_overview(const AzureOpenAIConfig& config,
             std::cerr << "[azure_openai] Authorized request - counter not decremented\n";
         }
         
-        // Make the HTTPS POST request using WinHTTP
-        std::string response_body = make_https_post(config.endpoint, path, config.api_key, body_str);
+        // Queued on the shared keep-alive connections, bounded by config.timeout
+        UpstreamResult upstream = on_delta ? azure_chat_completion_stream(config, body_str, on_delta)
+                                           : azure_chat_completion(config, body_str);
         
-        if (response_body.empty()) {
-            response_json["error"] = "Failed to connect to Azure OpenAI";
+        // Failed call, non-200 status or cut-off stream. An error body is only
+        // reported when it is JSON; otherwise status and error say what happened.
+        if (!upstream.ok()) {
+            json error_body = json::parse(upstream.body, nullptr, false);
+            response_json["error"] = upstream.status == 0 ? "Failed to connect to Azure OpenAI"
+                                                          : "Azure OpenAI API error";
+            response_json["details"] = {{"status", upstream.status}, {"error", upstream.error}};
+            if (!error_body.is_discarded() && error_body.is_object() && error_body.contains("error"))
+                response_json["details"]["upstream"] = error_body["error"];
             response_json["success"] = false;
-            std::cerr << "[azure_openai] Connection failed\n";
+            std::cerr << "[azure_openai] Call failed (status " << upstream.status << "): "
+                      << (upstream.error.empty() ? upstream.body : upstream.error) << "\n";
             return response_json;
         }
         
         // Parse the response
-        json api_response = json::parse(response_body);
+        json api_response = json::parse(upstream.body, nullptr, false);
+        if (api_response.is_discarded() || !api_response.is_object()) {
+            response_json["error"] = "Invalid response from Azure OpenAI";
+            response_json["details"] = {{"status", upstream.status}, {"error", "response is not a JSON object"}};
+            response_json["success"] = false;
+            std::cerr << "[azure_openai] Invalid response: " << upstream.body.substr(0, 200) << "\n";
+            return response_json;
+        }
         
-        // Check for API errors
+        // Check for API errors (a streamed error event arrives with status 200)
         if (api_response.contains("error")) {
             response_json["error"] = "Azure OpenAI API error";
-            response_json["details"] = api_response["error"];
+            response_json["details"] = {{"status", upstream.status}, {"error", upstream.error},
+                                        {"upstream", api_response["error"]}};
             response_json["success"] = false;
             std::cerr << "[azure_openai] API error: " << api_response.dump() << "\n";
             return response_json;
@@ -240,8 +189,7 @@ json generate_ai_overview(const AzureOpenAIConfig& config,
                 
                 // Cache the successful response if engine is provided
                 if (engine) {
-                    std::string cache_key = engine->make_cache_key(query, k);
-                    std::lock_guard<std::mutex> lock(engine->mtx);
+                    std::string cache_key = ai_overview_cache_key(*engine, query, k);
                     engine->put_ai_overview_in_cache(cache_key, response_json);
                     std::cerr << "[ai_overview] Cached AI overview for query: \"" << query << "\" k=" << k << "\n";
                 }
@@ -263,4 +211,86 @@ json generate_ai_overview(const AzureOpenAIConfig& config,
     return response_json;
 }
 
+// Cached, shared or new overview; with on_delta, the text is also passed to it
+// as it is generated (a cached or shared overview arrives in one piece)
+static json ai_overview_for(const AzureOpenAIConfig& config,
+                            const std::string& query,
+                            int k,
+                            const json& search_results,
+                            Engine* engine,
+                            StatsTracker* stats,
+                            bool is_authorized,
+                            const OverviewDeltaFn& on_delta) {
+    // Track AI overview call
+    if (stats) {
+        stats->increment_ai_overview_calls();
+    }
+    
+    // Check cache first if engine is provided
+    if (engine) {
+        std::string cache_key = ai_overview_cache_key(*engine, query, k);
+        
+        auto cached = engine->get_ai_overview_from_cache(cache_key);
+        
+        if (cached) {
+            std::cerr << "[ai_overview] Cache HIT for query: \"" << query << "\" k=" << k << "\n";
+            
+            // Track cache hit
+            if (stats) {
+                stats->increment_ai_overview_cache_hits();
+            }
+            
+            // Add user-visible flag to a copy of the shared entry
+            json hit = *cached;
+            hit["cached"] = true;
+            if (on_delta && hit.contains("overview") && hit["overview"].is_string()) {
+                on_delta(hit["overview"].get<std::string>());
+            }
+            return hit;
+        }
+        
+        std::cerr << "[ai_overview] Cache MISS for query: \"" << query << "\" k=" << k << "\n";
+
+        // Concurrent misses on the same query share one upstream call
+        bool shared = false;
+        json result = engine->ai_overview_flights.run(cache_key, [&] {
+            return request_ai_overview(config, query, k, search_results, engine, stats, is_authorized, on_delta);
+        }, &shared);
+        if (shared && result.value("success", false)) {
+            std::cerr << "[ai_overview] Joined in-flight request for query: \"" << query << "\" k=" << k << "\n";
+            if (stats) {
+                stats->increment_ai_overview_cache_hits();
+            }
+            result["cached"] = true;
+            if (on_delta && result["overview"].is_string()) {
+                on_delta(result["overview"].get<std::string>());
+            }
+        }
+        return result;
+    }
+    
+    return request_ai_overview(config, query, k, search_results, engine, stats, is_authorized, on_delta);
+}
+
+json generate_ai_overview(const AzureOpenAIConfig& config,
+                          const std::string& query,
+                          int k,
+                          const json& search_results,
+                          Engine* engine,
+                          StatsTracker* stats,
+                          bool is_authorized) {
+    return ai_overview_for(config, query, k, search_results, engine, stats, is_authorized, nullptr);
+}
+
+json generate_ai_overview_stream(const AzureOpenAIConfig& config,
+                                 const std::string& query,
+                                 int k,
+                                 const json& search_results,
+                                 Engine* engine,
+                                 StatsTracker* stats,
+                                 bool is_authorized,
+                                 const OverviewDeltaFn& on_delta) {
+    return ai_overview_for(config, query, k, search_results, engine, stats, is_authorized, on_delta);
+}
+
 } // namespace cord19
@@ -3,7 +3,6 @@
 #include "api_engine.hpp"
 #include "api_metadata.hpp"
 #include "api_stats.hpp"
-#include "third_party/httplib.h"
 #include <iostream>
 #include <sstream>
 
@@ -39,86 +38,18 @@ static std::string build_summary_user_prompt(const std::string& title, const std
     return oss.str();
 }
 
-// Helper function to make HTTPS POST request using httplib (cross-platform)
-static std::string make_https_post_summary(const std::string& url, const std::string& path, 
-                                           const std::string& api_key, const std::string& body) {
-    try {
-        // Parse URL to extract host
-        std::string host = url;
-        if (host.find("https://") == 0) {
-            host = host.substr(8);
-        }
-        if (host.back() == '/') {
-            host.pop_back();
-        }
-        
-        // Create HTTPS client
-        httplib::SSLClient cli(host);
-        cli.set_connection_timeout(30, 0); // 30 seconds
-        cli.set_read_timeout(60, 0);       // 60 seconds
-        cli.set_write_timeout(60, 0);      // 60 seconds
-        
-        // Set headers
-        httplib::Headers headers = {
-            {"Content-Type", "application/json"},
-            {"api-key", api_key}
-        };
-        
-        // Make POST request
-        auto res = cli.Post(path.c_str(), headers, body, "application/json");
-        
-        if (res && res->status == 200) {
-            return res->body;
-        } else {
-            std::cerr << "[https_post] Request failed";
-            if (res) {
-                std::cerr << " - Status: " << res->status;
-            }
-            std::cerr << "\n";
-            return "";
-        }
-        
-    } catch (const std::exception& e) {
-        std::cerr << "[https_post] Exception: " << e.what() << "\n";
-        return "";
-    }
-}
-
-json generate_ai_summary(const AzureOpenAIConfig& config,
-                         const std::string& cord_uid,
-                         Engine* engine,
-                         StatsTracker* stats,
-                         bool is_authorized) {
+// Call Azure OpenAI for a summary of one document and cache a successful response
+static json request_ai_summary(const AzureOpenAIConfig& config,
+                               const std::string& cord_uid,
+                               Engine* engine,
+                               StatsTracker* stats,
+                               bool is_authorized) {
     json response_json;
     
-    // Check cache first if engine is provided
-    if (engine) {
-        std::string cache_key = "summary|" + cord_uid;
-        
-        std::lock_guard<std::mutex> lock(engine->mtx);
-        json cached = engine->get_ai_summary_from_cache(cache_key);
-        
-        if (!cached.is_null() && cached.contains("from_cache")) {
-            std::cerr << "[ai_summary] Cache HIT for cord_uid: \"" << cord_uid << "\"\n";
-            
-            // Track cache hit and increment calls (cache hit is still a call)
-            if (stats) {
-                stats->increment_ai_summary_calls();
-                stats->increment_ai_summary_cache_hits();
-            }
-            
-            // Remove internal flag and add user-visible flag
-            cached.erase("from_cache");
-            cached["cached"] = true;
-            return cached;
-        }
-        
-        std::cerr << "[ai_summary] Cache MISS for cord_uid: \"" << cord_uid << "\"\n";
-    }
-    
     try {
-        // Look up metadata byte position for the cord_uid
-        if (!engine || engine->uid_to_meta.find(cord_uid) == engine->uid_to_meta.end()) {
+        // Look up metadata for the cord_uid (store or CSV file)
+        MetaData meta;
+        if (!engine || !engine->get_metadata(cord_uid, meta)) {
             response_json["error"] = "cord_uid not found in metadata";
             response_json["success"] = false;
             response_json["cord_uid"] = cord_uid;
@@ -126,10 +57,6 @@ json generate_ai_summary(const AzureOpenAIConfig& config,
             return response_json;
         }
         
-        // Fetch actual metadata on-demand from file
-        const auto& meta_info = engine->uid_to_meta.at(cord_uid);
-        MetaData meta = fetch_metadata(engine->metadata_csv_path, meta_info);
-        
         // Check if abstract exists
         if (meta.abstract.empty()) {
             response_json["error"] = "No abstract available for this document";
@@ -139,10 +66,6 @@ json generate_ai_summary(const AzureOpenAIConfig& config,
             return response_json;
         }
         
-        // Build the API path
-        std::string path = "/openai/deployments/" + config.model + 
-                          "/chat/completions?api-version=" + config.api_version;
-        
         // Build the request body
         json request_body;
         request_body["messages"] = json::array();
@@ -164,7 +87,7 @@ json generate_ai_summary(const AzureOpenAIConfig& config,
         
         std::string body_str = request_body.dump();
         
-        std::cerr << "[azure_openai] Calling Azure OpenAI for summary at " << config.endpoint << path << "\n";
+        std::cerr << "[azure_openai] Calling Azure OpenAI for summary at " << config.endpoint << "\n";
         
         // Decrement AI API calls remaining only for unauthorized requests
         if (stats && !is_authorized) {
@@ -174,24 +97,41 @@ json generate_ai_summary(const AzureOpenAIConfig& config,
             std::cerr << "[azure_openai] Authorized request - counter not decremented\n";
         }
         
-        // Make the HTTPS POST request using WinHTTP
-        std::string response_body = make_https_post_summary(config.endpoint, path, config.api_key, body_str);
-        
-        if (response_body.empty()) {
-            response_json["error"] = "Failed to connect to Azure OpenAI";
+        // Queued on the shared keep-alive connections, bounded by config.timeout
+        UpstreamResult upstream = azure_chat_completion(config, body_str);
+        
+        // Failed call, non-200 status or cut-off stream. An error body is only
+        // reported when it is JSON; otherwise status and error say what happened.
+        if (!upstream.ok()) {
+            json error_body = json::parse(upstream.body, nullptr, false);
+            response_json["error"] = upstream.status == 0 ? "Failed to connect to Azure OpenAI"
+                                                          : "Azure OpenAI API error";
+            response_json["details"] = {{"status", upstream.status}, {"error", upstream.error}};
+            if (!error_body.is_discarded() && error_body.is_object() && error_body.contains("error"))
+                response_json["details"]["upstream"] = error_body["error"];
             response_json["success"] = false;
             response_json["cord_uid"] = cord_uid;
-            std::cerr << "[azure_openai] Connection failed\n";
+            std::cerr << "[azure_openai] Call failed (status " << upstream.status << "): "
+                      << (upstream.error.empty() ? upstream.body : upstream.error) << "\n";
             return response_json;
         }
         
         // Parse the response
-        json api_response = json::parse(response_body);
+        json api_response = json::parse(upstream.body, nullptr, false);
+        if (api_response.is_discarded() || !api_response.is_object()) {
+            response_json["error"] = "Invalid response from Azure OpenAI";
+            response_json["details"] = {{"status", upstream.status}, {"error", "response is not a JSON object"}};
+            response_json["success"] = false;
+            response_json["cord_uid"] = cord_uid;
+            std::cerr << "[azure_openai] Invalid response: " << upstream.body.substr(0, 200) << "\n";
+            return response_json;
+        }
         
-        // Check for API errors
+        // Check for API errors (a streamed error event arrives with status 200)
         if (api_response.contains("error")) {
             response_json["error"] = "Azure OpenAI API error";
-            response_json["details"] = api_response["error"];
+            response_json["details"] = {{"status", upstream.status}, {"error", upstream.error},
+                                        {"upstream", api_response["error"]}};
             response_json["success"] = false;
             response_json["cord_uid"] = cord_uid;
             std::cerr << "[azure_openai] API error: " << api_response.dump() << "\n";
@@ -222,7 +162,6 @@ json generate_ai_summary(const AzureOpenAIConfig& config,
                 // Cache the successful response if engine is provided
                 if (engine) {
                     std::string cache_key = "summary|" + cord_uid;
-                    std::lock_guard<std::mutex> lock(engine->mtx);
                     engine->put_ai_summary_in_cache(cache_key, response_json);
                     std::cerr << "[ai_summary] Cached AI summary for cord_uid: \"" << cord_uid << "\"\n";
                 }
@@ -247,4 +186,51 @@ json generate_ai_summary(const AzureOpenAIConfig& config,
     return response_json;
 }
 
+json generate_ai_summary(const AzureOpenAIConfig& config,
+                         const std::string& cord_uid,
+                         Engine* engine,
+                         StatsTracker* stats,
+                         bool is_authorized) {
+    // Check cache first if engine is provided
+    if (engine) {
+        std::string cache_key = "summary|" + cord_uid;
+        
+        auto cached = engine->get_ai_summary_from_cache(cache_key);
+        
+        if (cached) {
+            std::cerr << "[ai_summary] Cache HIT for cord_uid: \"" << cord_uid << "\"\n";
+            
+            // Track cache hit and increment calls (cache hit is still a call)
+            if (stats) {
+                stats->increment_ai_summary_calls();
+                stats->increment_ai_summary_cache_hits();
+            }
+            
+            // Add user-visible flag to a copy of the shared entry
+            json hit = *cached;
+            hit["cached"] = true;
+            return hit;
+        }
+        
+        std::cerr << "[ai_summary] Cache MISS for cord_uid: \"" << cord_uid << "\"\n";
+
+        // Concurrent misses on the same document share one upstream call
+        bool shared = false;
+        json result = engine->ai_summary_flights.run(cache_key, [&] {
+            return request_ai_summary(config, cord_uid, engine, stats, is_authorized);
+        }, &shared);
+        if (shared && result.value("success", false)) {
+            std::cerr << "[ai_summary] Joined in-flight request for cord_uid: \"" << cord_uid << "\"\n";
+            if (stats) {
+                stats->increment_ai_summary_calls();
+                stats->increment_ai_summary_cache_hits();
+            }
+            result["cached"] = true;
+        }
+        return result;
+    }
+    
+    return request_ai_summary(config, cord_uid, engine, stats, is_authorized);
+}
+
 } // namespace cord19
@@ -1,8 +1,10 @@
 #include "api_engine.hpp"
 
 #include <algorithm>
+#include <cctype>
 #include <cstdlib>
 #include <cmath>
+#include <cstring>
 #include <fstream>
 #include <iostream>
 #include <queue>
@@ -13,30 +15,15 @@
 
 using namespace cord19;
 
-// Destructor: save all caches before engine is destroyed
+// Destructor: stop the flusher and save unsaved cache updates
 Engine::~Engine() {
-    std::lock_guard<std::mutex> lock(mtx);
-    
-    // Save search cache if there are unsaved updates
-    if (cache_updates_since_save > 0 || !cache.empty()) {
-        std::cerr << "[cache] Saving search cache on shutdown...\n";
-        save_cache();
-    }
-    
-    // Save AI overview cache if there are unsaved updates
-    if (ai_overview_cache_updates_since_save > 0 || !ai_overview_cache.empty()) {
-        std::cerr << "[cache] Saving AI overview cache on shutdown...\n";
-        save_ai_overview_cache();
-    }
-    
-    // Save AI summary cache if there are unsaved updates
-    if (ai_summary_cache_updates_since_save > 0 || !ai_summary_cache.empty()) {
-        std::cerr << "[cache] Saving AI summary cache on shutdown...\n";
-        save_ai_summary_cache();
-    }
+    stop_cache_flusher();
+    std::cerr << "[cache] Flushing caches on shutdown...\n";
+    flush_dirty_caches();
 }
 #include "api_segment.hpp"
 #include "indexio.hpp"
+#include "parallel.hpp"
 #include "textutil.hpp"
 
 namespace cord19 {
@@ -53,21 +40,8 @@ bool Engine::reload() {
     // Lock engine during reload to avoid concurrent reads/writes
     std::lock_guard<std::mutex> lock(mtx);
 
-    // Load segment names from manifest file
-    seg_names = load_manifest(index_dir / "manifest.bin");
-    if (seg_names.empty()) {
-        // Fallback: scan segments directory if manifest is missing/empty
-        fs::path segroot = index_dir / "segments";
-        if (fs::exists(segroot) && fs::is_directory(segroot)) {
-            seg_names.clear();
-            for (auto& e : fs::directory_iterator(segroot)) {
-                if (!e.is_directory()) continue;
-                auto name = e.path().filename().string();
-                if (name.rfind("seg_", 0) == 0) seg_names.push_back(name);
-            }
-            std::sort(seg_names.begin(), seg_names.end());
-        }
-    }
+    // Load segment names from manifest file (or scan the segments directory)
+    seg_names = list_segment_names(index_dir);
 
     // Stop if no segments were found
     if (seg_names.empty()) return false;
@@ -89,6 +63,10 @@ bool Engine::reload() {
     // Replace engine segments with newly loaded segments
     segments = std::move(loaded);
 
+    // Ranked hit lists and posting lists refer to the old segment/doc ids
+    ranked_hits_cache.clear();
+    posting_cache.clear();
+
     // Build autocomplete index using df scores from all segment lexicons
     {
         std::unordered_map<std::string, uint32_t> term_to_score;
@@ -107,14 +85,46 @@ bool Engine::reload() {
         ac.build(term_to_score, 10);
     }
 
-    // Reload metadata mapping from CSV
+    // Reload metadata: prefer the columnar store, else map cord_uids to CSV rows
     uid_to_meta.clear();
     metadata_csv_path = index_dir / "metadata.csv";
-    load_metadata_uid_meta(metadata_csv_path, uid_to_meta);
+    if (meta_store.open(index_dir / "metadata.bin")) {
+        std::cerr << "[metadata] mapped store rows=" << meta_store.size() << "\n";
+
+        // Attach store rows to segment docs (from docrows.bin, or by cord_uid lookup)
+        for (uint32_t segId = 0; segId < (uint32_t)segments.size(); segId++) {
+            auto& seg = segments[segId];
+            if (read_doc_rows(seg.dir, meta_store, seg)) continue;
+            size_t missing = resolve_doc_rows(meta_store, seg);
+            std::cerr << "[metadata] resolved rows of " << seg_names[segId]
+                      << " by cord_uid (missing=" << missing << ")\n";
+        }
+    } else {
+        load_metadata_uid_meta(metadata_csv_path, uid_to_meta);
+        read_metadata_columns(metadata_csv_path, metadata_cols);
+    }
+    meta_cache.clear();
+    filter_cache.clear();
+    load_doc_attrs();
 
     // Reset semantic index and load embeddings if available
     sem = SemanticIndex();
     {
+        // Prefer the memory-mapped binary file written by embeddingconvert
+        fs::path bin_path;
+        if (const char* p = std::getenv("EMBEDDINGS_BIN_PATH")) {
+            bin_path = fs::path(p);
+        } else if (fs::exists(index_dir / "embeddings.bin")) {
+            bin_path = index_dir / "embeddings.bin";
+        }
+
+        if (!bin_path.empty() && sem.load_binary(bin_path)) {
+            std::cerr << "[reload] semantic embeddings mapped: "
+                      << sem.size() << " terms, dim=" << sem.dim
+                      << " from " << bin_path.string() << "\n";
+        }
+    }
+    if (!sem.enabled) {
         // Collect only needed terms to reduce embedding memory usage
         std::unordered_set<std::string> needed_terms;
         needed_terms.reserve(250000);
@@ -138,12 +148,12 @@ bool Engine::reload() {
             }
         }
 
-        // Load embeddings from file if it exists
+        // Load embeddings from text file if it exists
         if (!emb_path.empty() && fs::exists(emb_path)) {
             bool ok = sem.load_from_text(emb_path, needed_terms);
             if (ok) {
                 std::cerr << "[reload] semantic embeddings loaded: "
-                          << sem.terms.size() << " terms, dim=" << sem.dim
+                          << sem.size() << " terms, dim=" << sem.dim
                           << " from " << emb_path.string() << "\n";
             } else {
                 std::cerr << "[reload] embeddings file found but no usable vectors loaded: "
@@ -152,10 +162,12 @@ bool Engine::reload() {
         }
     }
 
-    // Load all caches from disk
+    // Persist pending cache updates, then load all caches from disk
+    flush_dirty_caches();
     load_cache();
     load_ai_overview_cache();
     load_ai_summary_cache();
+    start_cache_flusher();
 
     // Reload successful
     return true;
@@ -191,300 +203,859 @@ std::string Engine::make_cache_key(const std::string& query, int k) {
     return query + "|" + std::to_string(k);
 }
 
-// Get result from cache if available, update LRU
-json Engine::get_from_cache(const std::string& cache_key) {
-    auto it = cache.find(cache_key);
-    if (it == cache.end()) {
-        return json(); // empty json means not found
-    }
-    
-    // Move to front of LRU list (most recently used)
-    lru_list.erase(it->second.lru_iter);
-    lru_list.push_front(cache_key);
-    it->second.lru_iter = lru_list.begin();
-    
-    // Return a copy of cached result
-    json result = it->second.result;
-    result["from_cache"] = true;
-    return result;
-}
-
-// Put result in cache with LRU eviction
-void Engine::put_in_cache(const std::string& cache_key, const json& result) {
-    // Check if already in cache (shouldn't happen, but handle it)
-    auto it = cache.find(cache_key);
-    if (it != cache.end()) {
-        // Update existing entry
-        lru_list.erase(it->second.lru_iter);
-        lru_list.push_front(cache_key);
-        it->second.result = result;
-        it->second.lru_iter = lru_list.begin();
-        return;
+// Approximate in-memory size of a JSON value (charged against cache budgets)
+static size_t json_bytes(const json& j) {
+    size_t n = sizeof(json);
+    if (j.is_string()) {
+        n += j.get_ref<const std::string&>().size();
+    } else if (j.is_object()) {
+        for (auto it = j.begin(); it != j.end(); ++it) {
+            n += it.key().size() + 32 + json_bytes(it.value());
+        }
+    } else if (j.is_array()) {
+        for (const auto& v : j) n += json_bytes(v);
     }
-    
-    // Evict if cache is full - evict LRU (least recently used)
-    if (cache.size() >= MAX_CACHE_SIZE) {
-        std::string key_to_evict = lru_list.back();
-        
-        // Remove the LRU entry
-        auto evict_it = cache.find(key_to_evict);
-        if (evict_it != cache.end()) {
-            lru_list.erase(evict_it->second.lru_iter);
-            cache.erase(evict_it);
-        }
-    }
-    
-    // Add new entry
-    lru_list.push_front(cache_key);
-    CacheEntry entry;
-    entry.result = result;
-    entry.lru_iter = lru_list.begin();
-    cache[cache_key] = entry;
-    
-    // Periodically save cache to disk (every N updates)
-    cache_updates_since_save++;
-    if (cache_updates_since_save >= CACHE_SAVE_INTERVAL) {
-        save_cache();
-        cache_updates_since_save = 0;
-    }
-}
-
-// Get AI overview from cache if available, update LRU
-json Engine::get_ai_overview_from_cache(const std::string& cache_key) {
-    auto it = ai_overview_cache.find(cache_key);
-    if (it == ai_overview_cache.end()) {
-        return json(); // empty json means not found
-    }
-    
-    // Move to front of LRU list (most recently used)
-    ai_overview_lru_list.erase(it->second.lru_iter);
-    ai_overview_lru_list.push_front(cache_key);
-    it->second.lru_iter = ai_overview_lru_list.begin();
-    
-    // Return a copy of cached result
-    json result = it->second.result;
-    result["from_cache"] = true;
-    return result;
+    return n;
+}
+
+// Insert the members of `fields` into a serialized JSON object before its closing brace
+std::string splice_json_fields(const std::string& object_json, const json& fields) {
+    std::string extra = fields.dump();
+    if (extra.size() <= 2) return object_json; // "{}"
+
+    size_t close = object_json.rfind('}');
+    if (close == std::string::npos || close == 0) return object_json;
+    size_t prev = object_json.find_last_not_of(" \t\r\n", close - 1);
+
+    std::string out;
+    out.reserve(object_json.size() + extra.size());
+    out.append(object_json, 0, close);
+    if (prev != std::string::npos && object_json[prev] != '{') out.push_back(',');
+    out.append(extra, 1, extra.size() - 1); // members + closing brace
+    return out;
+}
+
+// Get serialized result from cache if available (shared, not copied)
+std::shared_ptr<const std::string> Engine::get_from_cache(const std::string& cache_key) {
+    cache_shadow.get(cache_key);
+    return cache.get(cache_key);
+}
+
+// Put serialized result in cache (admission and eviction per cache policy)
+void Engine::put_in_cache(const std::string& cache_key, std::shared_ptr<const std::string> body) {
+    size_t charge = body->size();
+    cache_shadow.put(cache_key, nullptr, charge);
+    cache.put(cache_key, std::move(body), charge);
+    cache_dirty = true; // persisted by the background flusher
+}
+
+// Search cache policy from the SEARCH_CACHE_POLICY environment variable
+CachePolicy Engine::search_cache_policy() {
+    const char* p = std::getenv("SEARCH_CACHE_POLICY");
+    return parse_cache_policy(p ? p : "", CachePolicy::TinyLfu);
+}
+
+// The shadow cache always simulates the policy that is not serving requests
+CachePolicy Engine::shadow_cache_policy() {
+    return search_cache_policy() == CachePolicy::TinyLfu ? CachePolicy::Lru : CachePolicy::TinyLfu;
+}
+
+static json cache_stats_to_json(const CacheStats& st) {
+    json j;
+    j["hits"] = st.hits;
+    j["misses"] = st.misses;
+    j["hit_ratio"] = st.hit_ratio();
+    j["admitted"] = st.admitted;
+    j["rejected"] = st.rejected;
+    j["evicted"] = st.evicted;
+    return j;
+}
+
+template <class V>
+static json cache_usage_json(const ShardedLruCache<V>& c) {
+    json j = cache_stats_to_json(c.stats());
+    j["policy"] = cache_policy_name(c.policy());
+    j["entries"] = c.size();
+    j["bytes"] = c.bytes();
+    j["capacity_bytes"] = c.capacity();
+    return j;
+}
+
+json Engine::cache_stats_json() const {
+    json j;
+
+    // Search cache: serving policy plus the shadow replay, keyed by policy name
+    json search;
+    search["active_policy"] = cache_policy_name(cache.policy());
+    json serving = cache_usage_json(cache);
+    serving["active"] = true;
+    json shadow = cache_stats_to_json(cache_shadow.stats());
+    shadow["active"] = false;
+    search["policies"][cache_policy_name(cache.policy())] = serving;
+    search["policies"][cache_policy_name(cache_shadow.policy())] = shadow;
+    j["search"] = search;
+
+    j["ranked_hits"] = cache_usage_json(ranked_hits_cache);
+    j["postings"] = cache_usage_json(posting_cache);
+    j["metadata"] = cache_usage_json(meta_cache);
+    j["filters"] = cache_usage_json(filter_cache);
+    j["ai_overview"] = cache_usage_json(ai_overview_cache);
+    j["ai_summary"] = cache_usage_json(ai_summary_cache);
+    return j;
+}
+
+// Get AI overview from cache if available
+std::shared_ptr<const json> Engine::get_ai_overview_from_cache(const std::string& cache_key) {
+    return ai_overview_cache.get(cache_key);
 }
 
 // Put AI overview in cache with LRU eviction
 void Engine::put_ai_overview_in_cache(const std::string& cache_key, const json& result) {
-    // Check if already in cache (shouldn't happen, but handle it)
-    auto it = ai_overview_cache.find(cache_key);
-    if (it != ai_overview_cache.end()) {
-        // Update existing entry
-        ai_overview_lru_list.erase(it->second.lru_iter);
-        ai_overview_lru_list.push_front(cache_key);
-        it->second.result = result;
-        it->second.lru_iter = ai_overview_lru_list.begin();
-        return;
-    }
-    
-    // Evict if cache is full - evict LRU (least recently used)
-    if (ai_overview_cache.size() >= MAX_AI_OVERVIEW_CACHE_SIZE) {
-        std::string key_to_evict = ai_overview_lru_list.back();
-        
-        // Remove the LRU entry
-        auto evict_it = ai_overview_cache.find(key_to_evict);
-        if (evict_it != ai_overview_cache.end()) {
-            ai_overview_lru_list.erase(evict_it->second.lru_iter);
-            ai_overview_cache.erase(evict_it);
-        }
-    }
-    
-    // Add new entry
-    ai_overview_lru_list.push_front(cache_key);
-    CacheEntry entry;
-    entry.result = result;
-    entry.lru_iter = ai_overview_lru_list.begin();
-    ai_overview_cache[cache_key] = entry;
-    
-    // Periodically save AI overview cache to disk (every N updates)
-    ai_overview_cache_updates_since_save++;
-    if (ai_overview_cache_updates_since_save >= CACHE_SAVE_INTERVAL) {
-        save_ai_overview_cache();
-        ai_overview_cache_updates_since_save = 0;
-    }
-}
-
-// Get AI summary from cache if available, update LRU
-json Engine::get_ai_summary_from_cache(const std::string& cache_key) {
-    auto it = ai_summary_cache.find(cache_key);
-    if (it == ai_summary_cache.end()) {
-        return json(); // empty json means not found
-    }
-    
-    // Move to front of LRU list (most recently used)
-    ai_summary_lru_list.erase(it->second.lru_iter);
-    ai_summary_lru_list.push_front(cache_key);
-    it->second.lru_iter = ai_summary_lru_list.begin();
-    
-    // Return a copy of cached result
-    json result = it->second.result;
-    result["from_cache"] = true;
-    return result;
+    ai_overview_cache.put(cache_key, std::make_shared<const json>(result), json_bytes(result));
+    ai_overview_cache_dirty = true; // persisted by the background flusher
+}
+
+// Get AI summary from cache if available
+std::shared_ptr<const json> Engine::get_ai_summary_from_cache(const std::string& cache_key) {
+    return ai_summary_cache.get(cache_key);
 }
 
 // Put AI summary in cache with LRU eviction
 void Engine::put_ai_summary_in_cache(const std::string& cache_key, const json& result) {
-    // Check if already in cache (shouldn't happen, but handle it)
-    auto it = ai_summary_cache.find(cache_key);
-    if (it != ai_summary_cache.end()) {
-        // Update existing entry
-        ai_summary_lru_list.erase(it->second.lru_iter);
-        ai_summary_lru_list.push_front(cache_key);
-        it->second.result = result;
-        it->second.lru_iter = ai_summary_lru_list.begin();
-        return;
+    ai_summary_cache.put(cache_key, std::make_shared<const json>(result), json_bytes(result));
+    ai_summary_cache_dirty = true; // persisted by the background flusher
+}
+
+// Lowercased query terms without stopwords and short tokens, joined by spaces
+std::string Engine::normalize_query(const std::string& query) {
+    return parse_query(query).key;
+}
+
+// One word or quoted run of a query with its +/- operator
+struct QueryGroup {
+    std::vector<std::string> terms;
+    char op = ' '; // '+', '-' or ' '
+    bool quoted = false;
+};
+
+// Parse words, "quoted runs", +/- prefixes and AND into scored, required and excluded terms
+ParsedQuery Engine::parse_query(const std::string& query) {
+    std::vector<QueryGroup> groups;
+    TokenBuffer tokbuf;
+    bool and_next = false;
+    const size_t n = query.size();
+    for (size_t i = 0; i < n;) {
+        if (std::isspace((unsigned char)query[i])) {
+            i++;
+            continue;
+        }
+
+        QueryGroup g;
+        if ((query[i] == '+' || query[i] == '-') && i + 1 < n && !std::isspace((unsigned char)query[i + 1]))
+            g.op = query[i++];
+
+        std::string_view text;
+        if (query[i] == '"') {
+            size_t close = std::min(query.find('"', i + 1), n);
+            text = std::string_view(query).substr(i + 1, close - i - 1);
+            i = std::min(close + 1, n);
+            g.quoted = true;
+        } else {
+            size_t end = i;
+            while (end < n && query[end] != '"' && !std::isspace((unsigned char)query[end])) end++;
+            text = std::string_view(query).substr(i, end - i);
+            i = end;
+        }
+
+        // AND makes both of its operands required
+        if (!g.quoted && g.op == ' ' && text == "AND") {
+            if (!groups.empty() && groups.back().op == ' ') groups.back().op = '+';
+            and_next = true;
+            continue;
+        }
+
+        for (auto t : tokenize(text, tokbuf)) {
+            if (is_index_term(t)) g.terms.emplace_back(t);
+        }
+        if (g.terms.empty()) continue;
+        if (and_next && g.op == ' ') g.op = '+';
+        and_next = false;
+        groups.push_back(std::move(g));
     }
-    
-    // Evict if cache is full - evict LRU (least recently used)
-    if (ai_summary_cache.size() >= MAX_AI_SUMMARY_CACHE_SIZE) {
-        std::string key_to_evict = ai_summary_lru_list.back();
-        
-        // Remove the LRU entry
-        auto evict_it = ai_summary_cache.find(key_to_evict);
-        if (evict_it != ai_summary_cache.end()) {
-            ai_summary_lru_list.erase(evict_it->second.lru_iter);
-            ai_summary_cache.erase(evict_it);
+
+    // Flatten groups; the key spells the query canonically (plain queries: terms joined by spaces)
+    ParsedQuery q;
+    auto add_key = [&q](const std::string& part) {
+        if (!q.key.empty()) q.key.push_back(' ');
+        q.key += part;
+    };
+    for (auto& g : groups) {
+        if (g.quoted && g.terms.size() > 1) {
+            std::string text = g.terms[0];
+            for (size_t i = 1; i < g.terms.size(); i++) text += " " + g.terms[i];
+            if (g.op == '-') {
+                add_key("-\"" + text + "\"");
+                q.excluded_phrases.push_back(std::move(g.terms));
+            } else {
+                add_key("\"" + text + "\"");
+                q.terms.insert(q.terms.end(), g.terms.begin(), g.terms.end());
+                q.phrases.push_back(std::move(g.terms));
+            }
+            continue;
+        }
+
+        for (auto& t : g.terms) {
+            if (g.op == '-') {
+                add_key("-" + t);
+                q.excluded.push_back(t);
+                continue;
+            }
+            if (g.op == '+') {
+                add_key("+" + t);
+                q.required.push_back(t);
+            } else {
+                add_key(t);
+            }
+            q.terms.push_back(t);
         }
     }
-    
-    // Add new entry
-    ai_summary_lru_list.push_front(cache_key);
-    CacheEntry entry;
-    entry.result = result;
-    entry.lru_iter = ai_summary_lru_list.begin();
-    ai_summary_cache[cache_key] = entry;
-    
-    // Periodically save AI summary cache to disk (every N updates)
-    ai_summary_cache_updates_since_save++;
-    if (ai_summary_cache_updates_since_save >= CACHE_SAVE_INTERVAL) {
-        save_ai_summary_cache();
-        ai_summary_cache_updates_since_save = 0;
+    return q;
+}
+
+// Parse ';'-separated date / journal / source clauses into a filter with a canonical key
+bool Engine::parse_filter(const std::string& expr, SearchFilter& out, std::string& error) {
+    out = SearchFilter{};
+    bool seen_journal = false, seen_source = false;
+
+    std::string_view rest(expr);
+    while (!rest.empty()) {
+        size_t semi = rest.find(';');
+        std::string_view clause = AttrValues::trim(rest.substr(0, semi));
+        rest = (semi == std::string_view::npos) ? std::string_view() : rest.substr(semi + 1);
+        if (clause.empty()) continue;
+
+        // Split into field, operator and value
+        size_t op_at = clause.find_first_of("<>=:");
+        if (op_at == std::string_view::npos) {
+            error = "filter clause without operator: " + std::string(clause);
+            return false;
+        }
+        std::string field = AttrValues::fold(clause.substr(0, op_at));
+        size_t op_len = (op_at + 1 < clause.size() && clause[op_at + 1] == '=' && clause[op_at] != '=') ? 2 : 1;
+        std::string op(clause.substr(op_at, op_len));
+        std::string_view value = AttrValues::trim(clause.substr(op_at + op_len));
+
+        if (field == "date") {
+            int32_t first, last;
+            if (!parse_date_period(value, first, last)) {
+                error = "bad date (want YYYY, YYYY-MM or YYYY-MM-DD): " + std::string(value);
+                return false;
+            }
+            int32_t from = INT32_MIN, to = INT32_MAX;
+            if (op == "=" || op == ":") from = first, to = last;
+            else if (op == ">=") from = first;
+            else if (op == ">") from = last + 1;
+            else if (op == "<=") to = last;
+            else if (op == "<") to = first - 1;
+            out.has_date = true;
+            out.day_from = std::max(out.day_from, from);
+            out.day_to = std::min(out.day_to, to);
+            continue;
+        }
+
+        bool journal = field == "journal";
+        if (!journal && field != "source") {
+            error = "unknown filter field: " + field;
+            return false;
+        }
+        if (op != "=" && op != ":") {
+            error = field + " filter takes = with '|'-separated names";
+            return false;
+        }
+        bool& seen = journal ? seen_journal : seen_source;
+        if (seen) {
+            error = "repeated filter field: " + field;
+            return false;
+        }
+        seen = true;
+
+        std::vector<std::string>& names = journal ? out.journals : out.sources;
+        while (!value.empty()) {
+            size_t bar = value.find('|');
+            std::string name = AttrValues::fold(value.substr(0, bar));
+            value = (bar == std::string_view::npos) ? std::string_view() : value.substr(bar + 1);
+            if (!name.empty()) names.push_back(std::move(name));
+        }
+        if (names.empty()) {
+            error = field + " filter without names";
+            return false;
+        }
+        std::sort(names.begin(), names.end());
+        names.erase(std::unique(names.begin(), names.end()), names.end());
+    }
+
+    // Canonical key: inclusive date range, then sorted names
+    if (out.has_date) {
+        out.key = "date:" + (out.day_from == INT32_MIN ? std::string() : format_day(out.day_from)) + ".." +
+                  (out.day_to == INT32_MAX ? std::string() : format_day(out.day_to));
     }
+    auto add_names = [&out](const char* label, const std::vector<std::string>& names) {
+        if (names.empty()) return;
+        if (!out.key.empty()) out.key.push_back(';');
+        out.key += label;
+        for (size_t i = 0; i < names.size(); i++) out.key += (i ? "|" : "") + names[i];
+    };
+    add_names("journal:", out.journals);
+    add_names("source:", out.sources);
+    return true;
 }
 
-// Run BM25 search with optional semantic expansion and return JSON results
-json Engine::search(const std::string& query, int k) {
+// Fill the filter attribute columns of every segment from the metadata store or CSV
+void Engine::load_doc_attrs() {
+    journals.clear();
+    sources.clear();
+    bool sources_full = false;
+    size_t dated = 0, docs = 0;
+
+    for (auto& seg : segments) {
+        DocAttrs& a = seg.attrs;
+        const size_t n = seg.docs.size();
+        a.publish_day.assign(n, DocAttrs::NO_DAY);
+        a.journal.assign(n, DocAttrs::NO_VALUE);
+        a.sources.assign(n, 0);
+        docs += n;
+
+        auto set = [&](uint32_t docId, std::string_view publish_time, std::string_view journal,
+                       std::string_view source) {
+            a.publish_day[docId] = parse_publish_day(publish_time);
+            if (a.publish_day[docId] != DocAttrs::NO_DAY) dated++;
+            if (!AttrValues::trim(journal).empty()) a.journal[docId] = journals.intern(journal);
+
+            // source_x lists several sources ("Elsevier; PMC")
+            while (!source.empty()) {
+                size_t semi = source.find(';');
+                std::string_view name = AttrValues::trim(source.substr(0, semi));
+                source = (semi == std::string_view::npos) ? std::string_view() : source.substr(semi + 1);
+                if (name.empty()) continue;
+                uint32_t id;
+                if (!sources.find(name, id)) {
+                    if (sources.size() >= MAX_SOURCES) {
+                        sources_full = true;
+                        continue;
+                    }
+                    id = sources.intern(name);
+                }
+                a.sources[docId] |= 1u << id;
+            }
+        };
+
+        if (meta_store.valid()) {
+            for (uint32_t i = 0; i < (uint32_t)n; i++) {
+                uint32_t row = seg.docs[i].meta_row;
+                if (row == NO_META_ROW) continue;
+                set(i, meta_store.field(row, MetadataStore::PublishTime),
+                    meta_store.field(row, MetadataStore::Journal), meta_store.field(row, MetadataStore::Source));
+            }
+        } else if (!uid_to_meta.empty()) {
+            // One pass over the CSV rows of this segment's docs, in file order
+            std::vector<uint32_t> ids;
+            std::vector<MetaInfo> rows;
+            for (uint32_t i = 0; i < (uint32_t)n; i++) {
+                auto it = uid_to_meta.find(std::string(seg.cord_uid(i)));
+                if (it == uid_to_meta.end()) continue;
+                ids.push_back(i);
+                rows.push_back(it->second);
+            }
+            auto metas = fetch_metadata_batch(metadata_csv_path, metadata_cols, rows, /*with_abstract*/ false);
+            for (size_t j = 0; j < ids.size(); j++) set(ids[j], metas[j].publish_time, metas[j].journal, metas[j].source);
+        }
+    }
 
-    // Lock engine during search
-    std::lock_guard<std::mutex> lock(mtx);
+    if (sources_full) {
+        std::cerr << "[metadata] More than " << MAX_SOURCES << " sources, the rest are not filterable\n";
+    }
+    std::cerr << "[metadata] filter attributes: docs=" << docs << " dated=" << dated
+              << " journals=" << journals.size() << " sources=" << sources.size() << "\n";
+}
+
+// Evaluate the filter once per doc over the attribute columns
+void Engine::filter_bits(const Segment& seg, const SearchFilter& filter, std::vector<uint64_t>& bits) const {
+    const DocAttrs& a = seg.attrs;
+    const size_t n = a.size();
+    bits.assign((n + 63) / 64, 0);
+
+    // Resolve names to ids; a name not in the index matches no doc
+    std::vector<char> journal_ok;
+    if (!filter.journals.empty()) {
+        journal_ok.assign(journals.size(), 0);
+        for (const auto& name : filter.journals) {
+            uint32_t id;
+            if (journals.find(name, id)) journal_ok[id] = 1;
+        }
+    }
+    uint32_t source_mask = 0;
+    for (const auto& name : filter.sources) {
+        uint32_t id;
+        if (sources.find(name, id)) source_mask |= 1u << id;
+    }
+
+    for (size_t i = 0; i < n; i++) {
+        if (filter.has_date) {
+            int32_t day = a.publish_day[i];
+            if (day == DocAttrs::NO_DAY || day < filter.day_from || day > filter.day_to) continue;
+        }
+        if (!filter.journals.empty()) {
+            uint32_t j = a.journal[i];
+            if (j == DocAttrs::NO_VALUE || !journal_ok[j]) continue;
+        }
+        if (!filter.sources.empty() && !(a.sources[i] & source_mask)) continue;
+        bits[i >> 6] |= 1ull << (i & 63);
+    }
+}
+
+// Filter bitsets are shared by every query with the same filter until the next reload
+std::shared_ptr<const std::vector<uint64_t>> Engine::cached_filter_bits(uint32_t segId, const SearchFilter& filter) {
+    std::string key = std::to_string(segId) + "|" + filter.key;
+    if (auto cached = filter_cache.get(key)) return cached;
+
+    auto bits = std::make_shared<std::vector<uint64_t>>();
+    filter_bits(segments[segId], filter, *bits);
+    std::shared_ptr<const std::vector<uint64_t>> shared = std::move(bits);
+    filter_cache.put(key, shared, shared->size() * sizeof(uint64_t));
+    return shared;
+}
+
+// Posting cache key of a term in a segment
+static std::string posting_key(uint32_t segId, uint32_t termId) {
+    return std::to_string(segId) + ":" + std::to_string(termId);
+}
+
+// Load a term's posting list, consulting the hot-term cache before the inverted file
+std::shared_ptr<const PostingList> Engine::read_postings(uint32_t segId, const LexEntry& e, bool admit) {
+    std::string key = posting_key(segId, e.termId);
+    if (auto cached = posting_cache.get(key)) return cached;
+
+    auto& seg = segments[segId];
+
+    // Pick correct inverted file (barrels or single file)
+    const RandomAccessFile& inv = seg.use_barrels ? seg.inv_barrels[e.barrelId] : seg.inv;
+
+    // Read the whole list at once (a truncated file keeps the postings it has)
+    auto list = std::make_shared<PostingList>();
+    list->postings.resize(e.count);
+    if (!inv.read_at(e.offset, list->postings.data(), (size_t)e.count * sizeof(Posting))) {
+        std::cerr << "[search] Short read of postings for termId " << e.termId
+                  << " in segment " << seg_names[segId] << "\n";
+        uint64_t have = e.offset < inv.size() ? (inv.size() - e.offset) / sizeof(Posting) : 0;
+        list->postings.resize((size_t)std::min<uint64_t>(have, e.count));
+        inv.read_at(e.offset, list->postings.data(), list->postings.size() * sizeof(Posting));
+    }
+
+    // Field tfs sit at the same index in the field tf barrel
+    if (seg.has_fields && e.barrelId < seg.field_barrels.size()) {
+        const RandomAccessFile& ftf = seg.field_barrels[e.barrelId];
+        list->field_tfs.resize(list->postings.size());
+        if (!ftf.read_at(e.offset / sizeof(Posting) * sizeof(uint16_t), list->field_tfs.data(),
+                         list->field_tfs.size() * sizeof(uint16_t))) {
+            std::cerr << "[search] Short read of field tfs for termId " << e.termId
+                      << " in segment " << seg_names[segId] << "\n";
+            list->field_tfs.clear();
+        }
+    }
+
+    // Admit long lists that keep being requested (df * access frequency)
+    uint64_t freq;
+    {
+        std::lock_guard<std::mutex> lock(posting_sketch_mtx);
+        uint64_t h = std::hash<std::string>{}(key);
+        posting_sketch.increment(h);
+        freq = posting_sketch.frequency(h);
+    }
+    if (admit || (uint64_t)e.df * freq >= POSTING_ADMIT_SCORE) {
+        posting_cache.put(key, list, list->bytes());
+    }
+    return list;
+}
+
+// Open a cursor on a term's postings (the cached list if it is hot, else the inverted file)
+bool Engine::open_cursor(uint32_t segId, const std::string& term, PostingCursor& c) {
+    auto& seg = segments[segId];
+    auto it = seg.lex.find(term);
+    if (it == seg.lex.end() || it->second.df == 0) return false;
+
+    const LexEntry& e = it->second;
+    const RandomAccessFile& inv = seg.use_barrels ? seg.inv_barrels[e.barrelId] : seg.inv;
+    PositionsBarrel* pb = (seg.has_positions && e.barrelId < seg.pos_barrels.size())
+                              ? &seg.pos_barrels[e.barrelId] : nullptr;
+    const RandomAccessFile* ftf = (seg.has_fields && e.barrelId < seg.field_barrels.size())
+                                      ? &seg.field_barrels[e.barrelId] : nullptr;
+    c.open(inv, e, posting_cache.get(posting_key(segId, e.termId)), pb, ftf);
+    return true;
+}
 
-    // Set BM25 parameters and clamp result count to 1..100
+// BM25 contribution of one posting
+static float bm25_tf(float idf, uint32_t tf, float dl, float avgdl) {
     const float k1 = 1.2f;
     const float b = 0.75f;
-    const int K = std::max(1, std::min(k, 100));
-    
-    // Check cache first
-    std::string cache_key = make_cache_key(query, K);
-    json cached = get_from_cache(cache_key);
-    if (!cached.is_null()) {
-        // Return cached result with from_cache flag
-        return cached;
+    float denom = (float)tf + k1 * (1.0f - b + b * (dl / avgdl));
+    return idf * ((float)tf * (k1 + 1.0f)) / denom;
+}
+
+// BM25F contribution of one posting: each field's tf is normalized by that
+// field's length and weighted, and the sum is saturated once
+static float bm25f_tf(float idf, uint32_t tf, uint16_t packed, const Segment& seg, uint32_t docId,
+                      const float* weights) {
+    const float k1 = 1.2f;
+    const float b = 0.75f;
+    uint32_t ftf[FIELD_COUNT];
+    unpack_field_tf(packed, tf, ftf);
+
+    const FieldLens& fl = seg.field_lens[docId];
+    uint32_t dl = seg.docs[docId].doc_len;
+    uint32_t head = std::min(dl, fl.title + fl.abstract);
+    const float len[FIELD_COUNT] = {(float)fl.title, (float)fl.abstract, (float)(dl - head)};
+
+    float t = 0.0f;
+    for (uint32_t f = 0; f < FIELD_COUNT; f++) {
+        if (ftf[f] == 0) continue;
+        t += weights[f] * (float)ftf[f] / (1.0f - b + b * (len[f] / seg.avg_field_len[f]));
     }
+    return idf * (t * (k1 + 1.0f)) / (t + k1);
+}
 
-    // Tokenize the query string
-    auto qtoks = tokenize(query);
+// BM25F field weights from BM25F_TITLE_WEIGHT, BM25F_ABSTRACT_WEIGHT and BM25F_BODY_WEIGHT
+std::array<float, FIELD_COUNT> Engine::field_weights_from_env() {
+    std::array<float, FIELD_COUNT> w = {3.0f, 1.5f, 1.0f};
+    const char* names[FIELD_COUNT] = {"BM25F_TITLE_WEIGHT", "BM25F_ABSTRACT_WEIGHT", "BM25F_BODY_WEIGHT"};
+    for (uint32_t f = 0; f < FIELD_COUNT; f++) {
+        const char* p = std::getenv(names[f]);
+        if (!p || !*p) continue;
+        char* end = nullptr;
+        float v = std::strtof(p, &end);
+        if (*end == '\0' && v >= 0.0f) w[f] = v;
+        else std::cerr << "[search] Ignoring invalid " << names[f] << "=" << p << "\n";
+    }
+    return w;
+}
+
+// Zig-zag intersection: the rarest required term proposes a doc, the other
+// required terms advance to it (galloping over blocks), and any overshoot is
+// the next proposal. Excluded and scored terms are advanced the same way, so
+// every list is only read around the docs that survive.
+void Engine::score_conjunctive(uint32_t segId, const std::vector<std::pair<std::string, float>>& qterms_w,
+                               const ParsedQuery& q, const std::vector<uint64_t>* allow,
+                               std::unordered_map<uint32_t, float>& score) {
+    auto& seg = segments[segId];
+
+    // One cursor per distinct term (-1 if the term is not in this segment)
+    std::vector<PostingCursor> cur;
+    std::unordered_map<std::string, ptrdiff_t> slot;
+    auto cursor_of = [&](const std::string& term) {
+        auto it = slot.find(term);
+        if (it != slot.end()) return it->second;
+        PostingCursor c;
+        ptrdiff_t i = -1;
+        if (open_cursor(segId, term, c)) {
+            i = (ptrdiff_t)cur.size();
+            cur.push_back(std::move(c));
+        }
+        slot.emplace(term, i);
+        return i;
+    };
 
-    // Build base query terms by removing stopwords and short tokens
-    std::vector<std::string> base_terms;
-    base_terms.reserve(qtoks.size());
-    for (auto& t : qtoks) {
-        if (t.size() < 2) continue;
-        if (is_stopword(t)) continue;
-        base_terms.push_back(t);
+    // Required terms, rarest first
+    std::vector<size_t> req;
+    auto require = [&](const std::string& term) {
+        ptrdiff_t i = cursor_of(term);
+        if (i >= 0 && std::find(req.begin(), req.end(), (size_t)i) == req.end()) req.push_back((size_t)i);
+        return i >= 0;
+    };
+    for (const auto& t : q.required)
+        if (!require(t)) return;
+    for (const auto& phrase : q.phrases)
+        for (const auto& t : phrase)
+            if (!require(t)) return;
+    std::sort(req.begin(), req.end(), [&](size_t a, size_t b) { return cur[a].df() < cur[b].df(); });
+
+    std::vector<size_t> excl;
+    for (const auto& t : q.excluded) {
+        ptrdiff_t i = cursor_of(t);
+        if (i >= 0) excl.push_back((size_t)i);
     }
 
-    // Prepare output JSON structure
-    json out;
-    out["query"] = query;
-    out["k"] = K;
-    out["segments"] = (int)segments.size();
-    out["results"] = json::array();
+    struct Scorer {
+        size_t cur;
+        float weight;
+        float idf;
+    };
+    std::vector<Scorer> scorers;
+    for (const auto& tw : qterms_w) {
+        ptrdiff_t i = cursor_of(tw.first);
+        if (i < 0) continue;
+        scorers.push_back({(size_t)i, tw.second, bm25_idf(seg.N, seg.lex.find(tw.first)->second.df)});
+    }
 
-    // Return empty if no usable terms or no segments loaded
-    if (base_terms.empty() || segments.empty()) return out;
+    PostingCursor& lead = cur[req[0]];
+    uint32_t d = lead.doc();
+    while (d != PostingCursor::END) {
+        // Filtered-out proposals never touch the other lists
+        if (allow && !((*allow)[d >> 6] >> (d & 63) & 1)) {
+            lead.next();
+            d = lead.doc();
+            continue;
+        }
 
-    // Expand query using embeddings if semantic search is enabled
-    std::vector<std::pair<std::string, float>> qterms_w;
-    if (sem.enabled) {
-        qterms_w = sem.expand(base_terms,
-                              /*per_term*/ 3,
-                              /*global_topk*/ 5,
-                              /*min_sim*/ 0.55f,
-                              /*alpha*/ 0.6f,
-                              /*max_total_terms*/ 40);
-    } else {
-        qterms_w.reserve(base_terms.size());
-        for (const auto& t : base_terms) qterms_w.push_back({t, 1.0f});
+        uint32_t next = d;
+        for (size_t r = 1; r < req.size() && next == d; r++) next = cur[req[r]].advance(d);
+        if (next != d) {
+            d = lead.advance(next);
+            continue;
+        }
+
+        bool excluded = false;
+        for (size_t i = 0; i < excl.size() && !excluded; i++) excluded = cur[excl[i]].advance(d) == d;
+        if (!excluded) {
+            float dl = (float)seg.docs[d].doc_len;
+            float s = 0.0f;
+            for (const auto& sc : scorers) {
+                PostingCursor& c = cur[sc.cur];
+                if (c.advance(d) != d) continue;
+                s += sc.weight * (c.has_fields() ? bm25f_tf(sc.idf, c.tf(), c.field_tf(), seg, d, field_weights.data())
+                                                 : bm25_tf(sc.idf, c.tf(), dl, seg.avgdl));
+            }
+            score[d] = s;
+        }
+
+        lead.next();
+        d = lead.doc();
     }
+}
+
+// True if some occurrence of term 0 is followed by terms 1..n-1 at the next positions
+static bool positions_adjacent(const std::vector<std::vector<uint32_t>>& pos) {
+    for (uint32_t p0 : pos[0]) {
+        bool all = true;
+        for (size_t i = 1; i < pos.size() && all; i++)
+            all = std::binary_search(pos[i].begin(), pos[i].end(), p0 + (uint32_t)i);
+        if (all) return true;
+    }
+    return false;
+}
 
-    // Return empty if expansion produced no terms
-    if (qterms_w.empty()) return out;
+// Smallest gap between an occurrence of a and one of b (both ascending)
+static uint32_t min_distance(const std::vector<uint32_t>& a, const std::vector<uint32_t>& b) {
+    uint32_t best = UINT32_MAX;
+    size_t i = 0, j = 0;
+    while (i < a.size() && j < b.size()) {
+        uint32_t d = a[i] < b[j] ? b[j] - a[i] : a[i] - b[j];
+        best = std::min(best, d);
+        if (a[i] < b[j]) i++;
+        else j++;
+    }
+    return best;
+}
 
-    // Define a hit record to keep (score, segment, doc)
-    struct Hit {
-        float s;
-        uint32_t segId;
-        uint32_t docId;
+// Phrase matches among the scored docs: docs holding every phrase term whose
+// positions (for the best PHRASE_VERIFY_LIMIT of them) show the terms adjacent.
+// Without positions a phrase matches as AND, and an excluded phrase removes nothing.
+void Engine::filter_phrase(uint32_t segId, const std::vector<std::string>& phrase, bool exclude,
+                           std::unordered_map<uint32_t, float>& score) {
+    if (score.empty()) return;
+
+    auto open_all = [&](std::vector<PostingCursor>& cur) {
+        cur.clear();
+        cur.resize(phrase.size());
+        bool verify = true;
+        for (size_t i = 0; i < phrase.size(); i++) {
+            if (!open_cursor(segId, phrase[i], cur[i])) return -1;
+            verify = verify && cur[i].has_positions();
+        }
+        return verify ? 1 : 0;
     };
 
-    // Use a min-heap to keep only top K hits
+    std::vector<PostingCursor> cur;
+    int verify = open_all(cur);
+    if (verify < 0 || (exclude && verify == 0)) {
+        if (!exclude) score.clear();
+        return;
+    }
+
+    // Scored docs that contain every phrase term, in docId order
+    std::vector<std::pair<uint32_t, float>> cands(score.begin(), score.end());
+    std::sort(cands.begin(), cands.end());
+    size_t n = 0;
+    for (const auto& c : cands) {
+        bool all = true;
+        for (size_t i = 0; i < cur.size() && all; i++) all = cur[i].advance(c.first) == c.first;
+        if (all) cands[n++] = c;
+    }
+    cands.resize(n);
+
+    if (verify) {
+        // Check the best candidates against positions (fresh cursors, docId order)
+        if (cands.size() > PHRASE_VERIFY_LIMIT) {
+            std::nth_element(cands.begin(), cands.begin() + PHRASE_VERIFY_LIMIT, cands.end(),
+                             [](const auto& a, const auto& b) { return a.second > b.second; });
+            cands.resize(PHRASE_VERIFY_LIMIT);
+            std::sort(cands.begin(), cands.end());
+        }
+        open_all(cur);
+
+        std::vector<std::vector<uint32_t>> pos(cur.size());
+        n = 0;
+        for (const auto& c : cands) {
+            bool ok = true;
+            for (size_t i = 0; i < cur.size() && ok; i++)
+                ok = cur[i].advance(c.first) == c.first && cur[i].positions(pos[i]);
+            if (ok && positions_adjacent(pos)) cands[n++] = c;
+        }
+        cands.resize(n);
+    }
+
+    if (exclude) {
+        for (const auto& c : cands) score.erase(c.first);
+    } else {
+        std::unordered_map<uint32_t, float> kept(cands.begin(), cands.end());
+        score.swap(kept);
+    }
+}
+
+// Multiply each score by 1 + PROXIMITY_WEIGHT * (mean of 1 / gap over adjacent
+// distinct query terms). Hits in segments without positions keep their score.
+void Engine::proximity_rerank(const std::vector<std::string>& terms, std::vector<RankedHits::Hit>& hits) {
+    std::vector<std::string> distinct;
+    for (const auto& t : terms)
+        if (std::find(distinct.begin(), distinct.end(), t) == distinct.end()) distinct.push_back(t);
+    if (distinct.size() < 2) return;
+
+    // Visit hits by (segment, docId) so each segment's cursors only move forward
+    std::vector<size_t> order(hits.size());
+    for (size_t i = 0; i < order.size(); i++) order[i] = i;
+    std::sort(order.begin(), order.end(), [&](size_t a, size_t b) {
+        return hits[a].segId != hits[b].segId ? hits[a].segId < hits[b].segId : hits[a].docId < hits[b].docId;
+    });
+
+    std::vector<PostingCursor> cur;
+    std::vector<char> present(distinct.size());
+    uint32_t cur_seg = UINT32_MAX;
+    std::vector<std::vector<uint32_t>> pos(distinct.size());
+    std::vector<char> found(distinct.size());
+    for (size_t k : order) {
+        auto& h = hits[k];
+        if (!segments[h.segId].has_positions) continue;
+        if (h.segId != cur_seg) {
+            cur.clear();
+            cur.resize(distinct.size());
+            for (size_t i = 0; i < distinct.size(); i++) present[i] = open_cursor(h.segId, distinct[i], cur[i]);
+            cur_seg = h.segId;
+        }
+
+        for (size_t i = 0; i < distinct.size(); i++)
+            found[i] = present[i] && cur[i].advance(h.docId) == h.docId && cur[i].positions(pos[i]);
+
+        float closeness = 0.0f;
+        for (size_t i = 0; i + 1 < distinct.size(); i++) {
+            if (!found[i] || !found[i + 1]) continue;
+            closeness += 1.0f / (float)std::max<uint32_t>(1, min_distance(pos[i], pos[i + 1]));
+        }
+        h.s *= 1.0f + PROXIMITY_WEIGHT * closeness / (float)(distinct.size() - 1);
+    }
+
+    std::stable_sort(hits.begin(), hits.end(),
+                     [](const RankedHits::Hit& a, const RankedHits::Hit& b) { return a.s > b.s; });
+}
+
+// Score every segment with BM25 and keep the SEARCH_DEPTH best hits
+std::shared_ptr<const RankedHits> Engine::rank(const std::vector<std::pair<std::string, float>>& qterms_w,
+                                               const ParsedQuery& q, const SearchFilter& filter, bool facets) {
+    using Hit = RankedHits::Hit;
+
+    // Multi-term queries collect extra hits for the proximity re-rank
+    bool proximity = false;
+    if (q.terms.size() > 1)
+        for (const auto& seg : segments) proximity = proximity || seg.has_positions;
+    const int depth = proximity ? PROXIMITY_DEPTH : SEARCH_DEPTH;
+
+    // Use a min-heap to keep only the top `depth` hits
     auto cmp = [](const Hit& a, const Hit& b) { return a.s > b.s; };
     std::priority_queue<Hit, std::vector<Hit>, decltype(cmp)> pq(cmp);
 
     // Count how many docs matched across all segments
     uint64_t total_found = 0;
 
+    // Facet counts over all matches
+    std::unordered_map<int32_t, uint64_t> year_counts;
+    std::unordered_map<uint32_t, uint64_t> journal_counts;
+    uint64_t source_counts[MAX_SOURCES] = {};
+
     // Score documents segment by segment
     for (uint32_t segId = 0; segId < (uint32_t)segments.size(); segId++) {
         auto& seg = segments[segId];
 
         // Store BM25 scores per docId inside this segment
         std::unordered_map<uint32_t, float> score;
-        score.reserve(20000);
 
-        // Process each weighted query term
-        for (const auto& tw : qterms_w) {
-            const std::string& term = tw.first;
-            const float qweight = tw.second;
+        // Docs passing the filter, checked before a posting is scored
+        std::shared_ptr<const std::vector<uint64_t>> bits;
+        if (!filter.empty()) bits = cached_filter_bits(segId, filter);
+        const std::vector<uint64_t>* allow = bits.get();
+        auto allowed = [&](uint32_t d) { return !allow || ((*allow)[d >> 6] >> (d & 63) & 1); };
 
-            // Skip term if not found in this segment lexicon
-            auto it = seg.lex.find(term);
-            if (it == seg.lex.end()) continue;
-
-            const LexEntry& e = it->second;
-            if (e.df == 0) continue;
-
-            // Compute IDF using segment document count and df
-            float idf = bm25_idf(seg.N, e.df);
-
-            // Pick correct inverted file stream (barrels or single file)
-            std::ifstream* invp = nullptr;
-            if (seg.use_barrels) invp = &seg.inv_barrels[e.barrelId];
-            else invp = &seg.inv;
-
-            // Seek to posting list position for this term
-            invp->clear();
-            invp->seekg((std::streamoff)e.offset, std::ios::beg);
-
-            // Read postings and accumulate BM25 score per doc
-            for (uint32_t i = 0; i < e.count; i++) {
-                uint32_t docId = read_u32(*invp);
-                uint32_t tf = read_u32(*invp);
+        if (q.conjunctive()) {
+            // Required terms: intersect instead of scoring every posting
+            score_conjunctive(segId, qterms_w, q, allow, score);
+        } else {
+            score.reserve(20000);
+
+            // Process each weighted query term
+            for (const auto& tw : qterms_w) {
+                const std::string& term = tw.first;
+                const float qweight = tw.second;
+
+                // Skip term if not found in this segment lexicon
+                auto it = seg.lex.find(term);
+                if (it == seg.lex.end()) continue;
+
+                const LexEntry& e = it->second;
+                if (e.df == 0) continue;
+
+                // Compute IDF using segment document count and df
+                float idf = bm25_idf(seg.N, e.df);
+
+                // Read postings and accumulate BM25 (BM25F with field data) score per doc
+                auto list = read_postings(segId, e);
+                if (list->field_tfs.empty()) {
+                    for (const Posting& p : list->postings) {
+                        if (!allowed(p.docId)) continue;
+                        score[p.docId] += qweight * bm25_tf(idf, p.tf, (float)seg.docs[p.docId].doc_len, seg.avgdl);
+                    }
+                } else {
+                    for (size_t i = 0; i < list->postings.size(); i++) {
+                        const Posting& p = list->postings[i];
+                        if (!allowed(p.docId)) continue;
+                        score[p.docId] += qweight * bm25f_tf(idf, p.tf, list->field_tfs[i], seg, p.docId,
+                                                             field_weights.data());
+                    }
+                }
+            }
 
-                float dl = (float)seg.docs[docId].doc_len;
-                float denom = (float)tf + k1 * (1.0f - b + b * (dl / seg.avgdl));
-                float s = idf * ((float)tf * (k1 + 1.0f)) / denom;
-                score[docId] += qweight * s;
+            // Drop docs with excluded terms
+            for (const auto& t : q.excluded) {
+                auto it = seg.lex.find(t);
+                if (it == seg.lex.end() || it->second.df == 0) continue;
+                auto list = read_postings(segId, it->second);
+                for (const Posting& p : list->postings) score.erase(p.docId);
             }
         }
 
+        // Quoted phrases restrict the matches
+        for (const auto& phrase : q.phrases) filter_phrase(segId, phrase, false, score);
+        for (const auto& phrase : q.excluded_phrases) filter_phrase(segId, phrase, true, score);
+
         // Push top scoring docs from this segment into global heap
         for (auto& kv : score) {
             Hit h{kv.second, segId, kv.first};
-            if ((int)pq.size() < K) pq.push(h);
+            if ((int)pq.size() < depth) pq.push(h);
             else if (h.s > pq.top().s) {
                 pq.pop();
                 pq.push(h);
@@ -493,181 +1064,458 @@ json Engine::search(const std::string& query, int k) {
 
         // Add count of matched docs from this segment
         total_found += (uint64_t)score.size();
+
+        if (facets) {
+            const DocAttrs& a = seg.attrs;
+            for (const auto& kv : score) {
+                uint32_t d = kv.first;
+                if (d >= a.size()) continue;
+                if (a.publish_day[d] != DocAttrs::NO_DAY) year_counts[year_of_day(a.publish_day[d])]++;
+                if (a.journal[d] != DocAttrs::NO_VALUE) journal_counts[a.journal[d]]++;
+                for (uint32_t s = 0; s < sources.size(); s++) source_counts[s] += (a.sources[d] >> s) & 1;
+            }
+        }
     }
 
     // Extract hits from heap into sorted list (highest score first)
-    std::vector<Hit> hits;
+    auto ranked = std::make_shared<RankedHits>();
+    ranked->hits.reserve(pq.size());
     while (!pq.empty()) {
-        hits.push_back(pq.top());
+        ranked->hits.push_back(pq.top());
         pq.pop();
     }
-    std::reverse(hits.begin(), hits.end());
-    out["found"] = total_found;
+    std::reverse(ranked->hits.begin(), ranked->hits.end());
+    if (proximity) {
+        proximity_rerank(q.terms, ranked->hits);
+        if (ranked->hits.size() > (size_t)SEARCH_DEPTH) ranked->hits.resize(SEARCH_DEPTH);
+    }
+    ranked->found = total_found;
+
+    // Facets: years newest first, journals and sources most frequent first
+    if (facets) {
+        auto entries = [](std::vector<std::pair<std::string, uint64_t>>& v, size_t limit) {
+            std::sort(v.begin(), v.end(), [](const auto& a, const auto& b) {
+                return a.second != b.second ? a.second > b.second : a.first < b.first;
+            });
+            if (v.size() > limit) v.resize(limit);
+            json arr = json::array();
+            for (const auto& e : v) arr.push_back({{"value", e.first}, {"count", e.second}});
+            return arr;
+        };
+
+        std::vector<std::pair<int32_t, uint64_t>> years(year_counts.begin(), year_counts.end());
+        std::sort(years.begin(), years.end(), [](const auto& a, const auto& b) { return a.first > b.first; });
+        json year_arr = json::array();
+        for (const auto& y : years) year_arr.push_back({{"value", std::to_string(y.first)}, {"count", y.second}});
+
+        std::vector<std::pair<std::string, uint64_t>> js, ss;
+        for (const auto& kv : journal_counts) js.emplace_back(journals.name(kv.first), kv.second);
+        for (uint32_t s = 0; s < sources.size(); s++)
+            if (source_counts[s]) ss.emplace_back(sources.name(s), source_counts[s]);
+
+        ranked->facets["year"] = std::move(year_arr);
+        ranked->facets["journal"] = entries(js, FACET_JOURNALS);
+        ranked->facets["source"] = entries(ss, MAX_SOURCES);
+    }
+    return ranked;
+}
+
+// Metadata of one document from the store or the CSV file
+bool Engine::get_metadata(const std::string& cord_uid, MetaData& out) {
+    std::lock_guard<std::mutex> lock(mtx);
+
+    if (meta_store.valid()) {
+        uint32_t row;
+        if (!meta_store.find(cord_uid, row)) return false;
+        out = meta_store.get(row);
+        return true;
+    }
+
+    auto it = uid_to_meta.find(cord_uid);
+    if (it == uid_to_meta.end()) return false;
+    out = fetch_metadata_batch(metadata_csv_path, metadata_cols, {it->second}, /*with_abstract*/ true)[0];
+    return true;
+}
+
+// Add display metadata to a search result entry (empty fields are omitted)
+static void put_meta_fields(json& r, std::string_view title, std::string_view url,
+                            std::string_view publish_time, std::string_view author) {
+    if (!title.empty()) r["title"] = std::string(title);
+
+    // Keep only the first of several ';'-separated URLs
+    url = url.substr(0, url.find(';'));
+    if (!url.empty()) r["url"] = std::string(url);
+
+    if (!publish_time.empty()) r["publish_time"] = std::string(publish_time);
+    if (!author.empty()) r["author"] = std::string(author);
+}
 
-    // Convert hits into JSON output entries
-    for (auto& h : hits) {
-        auto& d = segments[h.segId].docs[h.docId];
+// Approximate in-memory size of parsed metadata (charged against meta_cache)
+static size_t meta_bytes(const MetaData& m) {
+    return sizeof(MetaData) + m.url.size() + m.publish_time.size() + m.author.size() +
+           m.title.size() + m.abstract.size() + m.journal.size() + m.source.size();
+}
+
+// Convert the first k hits into JSON result entries with their metadata
+json Engine::hydrate(const RankedHits& ranked, int k) {
+    json results = json::array();
+    size_t n = std::min(ranked.hits.size(), (size_t)std::max(k, 0));
+
+    // Without a store: take hot docs from meta_cache and read the rest in one batch
+    std::vector<std::shared_ptr<const MetaData>> metas(n);
+    if (!meta_store.valid()) {
+        std::vector<size_t> missing;
+        std::vector<MetaInfo> to_read;
+        for (size_t i = 0; i < n; i++) {
+            const auto& h = ranked.hits[i];
+            std::string cord_uid(segments[h.segId].cord_uid(h.docId));
+            if ((metas[i] = meta_cache.get(cord_uid))) continue;
+
+            auto it = uid_to_meta.find(cord_uid);
+            if (it == uid_to_meta.end()) continue;
+            missing.push_back(i);
+            to_read.push_back(it->second);
+        }
+
+        auto fetched = fetch_metadata_batch(metadata_csv_path, metadata_cols, to_read,
+                                            /*with_abstract*/ false);
+        for (size_t j = 0; j < missing.size(); j++) {
+            const auto& h = ranked.hits[missing[j]];
+            auto m = std::make_shared<const MetaData>(std::move(fetched[j]));
+            meta_cache.put(std::string(segments[h.segId].cord_uid(h.docId)), m, meta_bytes(*m));
+            metas[missing[j]] = std::move(m);
+        }
+    }
+
+    for (size_t i = 0; i < n; i++) {
+        const auto& h = ranked.hits[i];
+        const auto& seg = segments[h.segId];
+        const DocInfo& d = seg.docs[h.docId];
         json r;
         r["score"] = h.s;
         r["segment"] = seg_names[h.segId];
         r["docId"] = h.docId;
-        r["cord_uid"] = d.cord_uid;
-
-        // Fetch ALL metadata fields on-demand from file (title, url, author, etc.)
-        auto it = uid_to_meta.find(d.cord_uid);
-        if (it != uid_to_meta.end()) {
-            // Fetch metadata on-demand from file
-            MetaData meta = fetch_metadata(metadata_csv_path, it->second);
-            
-            // Add title from metadata (not from docs structure)
-            if (!meta.title.empty()) r["title"] = meta.title;
-            
-            std::string url = meta.url;
-            auto semi = url.find(';');
-            if (semi != std::string::npos) url = url.substr(0, semi);
-            if (!url.empty()) r["url"] = url;
-
-            if (!meta.publish_time.empty()) r["publish_time"] = meta.publish_time;
-            if (!meta.author.empty()) r["author"] = meta.author;
+        r["cord_uid"] = std::string(seg.cord_uid(h.docId));
+
+        if (meta_store.valid()) {
+            // Zero-copy field lookups in the mapped store, by row resolved at load time
+            if (d.meta_row != NO_META_ROW) {
+                put_meta_fields(r, meta_store.field(d.meta_row, MetadataStore::Title),
+                                meta_store.field(d.meta_row, MetadataStore::Url),
+                                meta_store.field(d.meta_row, MetadataStore::PublishTime),
+                                meta_store.field(d.meta_row, MetadataStore::Author));
+            }
+        } else if (const auto& m = metas[i]) {
+            put_meta_fields(r, m->title, m->url, m->publish_time, m->author);
         }
-        // Note: json_relpath removed - not needed in API response
 
-        out["results"].push_back(r);
+        results.push_back(std::move(r));
     }
-    
-    // Store result in cache before returning
-    put_in_cache(cache_key, out);
+    return results;
+}
 
-    return out;
+// Run BM25 search with optional semantic expansion and return JSON results
+SearchResult Engine::search(const std::string& query, int k, const SearchFilter& filter, bool facets) {
+    // Concurrent identical searches wait for the first one instead of ranking again
+    bool shared = false;
+    SearchResult r = search_flights.run(
+        search_cache_key(query, k, filter, facets),
+        [&] { return search_batch({SearchRequest{query, k, filter, facets}})[0]; }, &shared);
+    if (shared) r.from_cache = true;
+    r.query = query; // a shared flight may have been started by another spelling
+    return r;
 }
 
-// Save search cache to JSON file
-void Engine::save_cache() {
-    try {
-        json cache_json = json::array();
-        
-        // Serialize cache entries
-        for (const auto& kv : cache) {
-            const std::string& key = kv.first;
-            const CacheEntry& entry = kv.second;
-            
-            json item;
-            item["key"] = key;
-            item["result"] = entry.result;
-            
-            cache_json.push_back(item);
-        }
-        
-        // Write to file
-        fs::path cache_file = "search_cache.json";
-        std::ofstream ofs(cache_file);
-        if (ofs.is_open()) {
-            ofs << cache_json.dump(2);
-            ofs.close();
-            std::cerr << "[cache] Saved " << cache_json.size() << " search cache entries to " << cache_file << "\n";
-        } else {
-            std::cerr << "[cache] Failed to open " << cache_file << " for writing\n";
-        }
-    } catch (const std::exception& e) {
-        std::cerr << "[cache] Error saving search cache: " << e.what() << "\n";
+// Response cache key of a search (normalized and clamped as in search_batch)
+std::string Engine::search_cache_key(const std::string& query, int k, const SearchFilter& filter, bool facets) {
+    std::string key = make_cache_key(normalize_query(query), std::max(1, std::min(k, SEARCH_DEPTH)));
+    if (!filter.empty()) key += "|filter:" + filter.key;
+    if (facets) key += "|facets";
+    return key;
+}
+
+// Weighted query terms: expanded with embeddings if semantic search is enabled
+std::vector<std::pair<std::string, float>> Engine::weighted_terms(const std::vector<std::string>& base_terms) {
+    std::vector<std::pair<std::string, float>> qterms_w;
+    if (sem.enabled) {
+        qterms_w = sem.expand(base_terms,
+                              /*per_term*/ 3,
+                              /*global_topk*/ 5,
+                              /*min_sim*/ 0.55f,
+                              /*alpha*/ 0.6f,
+                              /*max_total_terms*/ 40);
+    } else {
+        qterms_w.reserve(base_terms.size());
+        for (const auto& t : base_terms) qterms_w.push_back({t, 1.0f});
     }
+    return qterms_w;
 }
 
-// Load search cache from JSON file
-void Engine::load_cache() {
-    try {
-        fs::path cache_file = "search_cache.json";
-        
-        if (!fs::exists(cache_file)) {
-            std::cerr << "[cache] No search cache file found at " << cache_file << "\n";
-            return;
+// Serve cached responses, then rank the rest under one lock: posting lists of
+// terms shared by several queries are read once, and distinct ranked lists
+// are computed in parallel before all responses are hydrated in parallel.
+std::vector<SearchResult> Engine::search_batch(const std::vector<SearchRequest>& requests) {
+    std::vector<SearchResult> results(requests.size());
+
+    // A query that missed the response cache
+    struct Pending {
+        size_t index = 0;
+        int K = 0;
+        std::string cache_key;
+        std::string ranked_key;
+        ParsedQuery parsed;
+        json out;
+        std::shared_ptr<const RankedHits> ranked;
+        ptrdiff_t task = -1; // entry of `tasks` that ranks this query
+    };
+    std::vector<Pending> pending;
+
+    for (size_t i = 0; i < requests.size(); i++) {
+        const SearchRequest& r = requests[i];
+
+        // Clamp result count to 1..SEARCH_DEPTH
+        const int K = std::max(1, std::min(r.k, SEARCH_DEPTH));
+
+        // Filter and facets extend the keys of both caches (plain searches keep theirs)
+        std::string key_suffix;
+        if (!r.filter.empty()) key_suffix += "|filter:" + r.filter.key;
+        if (r.facets) key_suffix += "|facets";
+
+        // Normalized terms key both caches, so every spelling of a query shares its entries
+        ParsedQuery parsed = parse_query(r.query);
+
+        // Check response cache first (the cache has its own locks)
+        std::string cache_key = make_cache_key(parsed.key, K) + key_suffix;
+        if (auto cached = get_from_cache(cache_key)) {
+            results[i] = SearchResult{std::move(cached), r.query, true};
+            continue;
         }
-        
-        std::ifstream ifs(cache_file);
-        if (!ifs.is_open()) {
-            std::cerr << "[cache] Failed to open " << cache_file << " for reading\n";
-            return;
+
+        // Prepare output JSON structure (the query echo is spliced in when served)
+        Pending p;
+        p.index = i;
+        p.K = K;
+        p.cache_key = std::move(cache_key);
+        p.out["k"] = K;
+        if (!r.filter.empty()) p.out["filter"] = r.filter.key;
+        p.out["results"] = json::array();
+
+        // The ranked hit list is shared by all k as well
+        p.parsed = std::move(parsed);
+        p.ranked_key = p.parsed.key + key_suffix;
+        pending.push_back(std::move(p));
+    }
+    if (pending.empty()) return results;
+
+    // Lock engine during ranking and hydration
+    std::lock_guard<std::mutex> lock(mtx);
+
+    // Rank each distinct ranked key once
+    struct RankTask {
+        size_t query;   // pending entry that defines the query
+        std::vector<std::pair<std::string, float>> qterms_w;
+        std::shared_ptr<const RankedHits> ranked;
+    };
+    std::vector<RankTask> tasks;
+    std::unordered_map<std::string, size_t> task_of;
+    std::unordered_map<std::string, uint32_t> term_queries;
+
+    for (size_t j = 0; j < pending.size(); j++) {
+        Pending& p = pending[j];
+        p.out["segments"] = (int)segments.size();
+
+        // No usable terms or no segments loaded: empty response
+        if (p.parsed.key.empty() || segments.empty()) continue;
+
+        // Reuse a ranked list computed for another k or spelling of the same query
+        // (the response is still built here, so it is not reported as cached)
+        if ((p.ranked = ranked_hits_cache.get(p.ranked_key))) continue;
+        auto it = task_of.find(p.ranked_key);
+        if (it != task_of.end()) {
+            p.task = (ptrdiff_t)it->second;
+            continue;
         }
-        
-        json cache_json;
-        ifs >> cache_json;
-        ifs.close();
-        
-        if (!cache_json.is_array()) {
-            std::cerr << "[cache] Invalid cache file format (not an array)\n";
+
+        RankTask t{j, weighted_terms(p.parsed.terms), nullptr};
+        if (t.qterms_w.empty()) continue; // expansion produced no terms
+
+        // Count the queries that read each term
+        std::unordered_set<std::string> used;
+        for (const auto& tw : t.qterms_w) used.insert(tw.first);
+        used.insert(p.parsed.excluded.begin(), p.parsed.excluded.end());
+        for (const auto& t2 : used) term_queries[t2]++;
+
+        p.task = (ptrdiff_t)tasks.size();
+        task_of.emplace(p.ranked_key, tasks.size());
+        tasks.push_back(std::move(t));
+    }
+
+    // Lists read by several queries are read once up front and kept in posting_cache
+    for (const auto& kv : term_queries) {
+        if (kv.second < 2) continue;
+        for (uint32_t segId = 0; segId < (uint32_t)segments.size(); segId++) {
+            auto it = segments[segId].lex.find(kv.first);
+            if (it != segments[segId].lex.end() && it->second.df > 0) read_postings(segId, it->second, /*admit*/ true);
+        }
+    }
+
+    // Index files are read positionally, so ranks and hydrations run in parallel
+    auto for_each_parallel = [](size_t n, const auto& fn) {
+        std::atomic<size_t> next{0};
+        size_t threads = std::min<size_t>(n, std::max(1u, std::thread::hardware_concurrency()));
+        run_parallel(threads, [&](size_t) {
+            for (size_t i; (i = next.fetch_add(1)) < n;) fn(i);
+        });
+    };
+
+    for_each_parallel(tasks.size(), [&](size_t i) {
+        RankTask& t = tasks[i];
+        const Pending& p = pending[t.query];
+        const SearchRequest& r = requests[p.index];
+        t.ranked = rank(t.qterms_w, p.parsed, r.filter, r.facets);
+        ranked_hits_cache.put(p.ranked_key, t.ranked,
+                              t.ranked->hits.size() * sizeof(RankedHits::Hit) + json_bytes(t.ranked->facets));
+    });
+
+    for_each_parallel(pending.size(), [&](size_t j) {
+        Pending& p = pending[j];
+        if (p.task >= 0) p.ranked = tasks[(size_t)p.task].ranked;
+        if (!p.ranked) {
+            results[p.index] = SearchResult{std::make_shared<const std::string>(p.out.dump()),
+                                            requests[p.index].query, false};
             return;
         }
-        
-        // Clear existing cache
-        cache.clear();
-        lru_list.clear();
-        
-        // Load entries
-        size_t loaded = 0;
-        
-        for (const auto& item : cache_json) {
-            if (!item.contains("key") || !item.contains("result")) {
-                continue;
+
+        // Hydrate metadata only for the requested slice
+        p.out["found"] = p.ranked->found;
+        if (requests[p.index].facets) p.out["facets"] = p.ranked->facets;
+        p.out["results"] = hydrate(*p.ranked, p.K);
+
+        // Serialize once and store in cache before returning
+        auto body = std::make_shared<const std::string>(p.out.dump());
+        put_in_cache(p.cache_key, body);
+        results[p.index] = SearchResult{std::move(body), requests[p.index].query, false};
+    });
+    return results;
+}
+
+// Binary cache file layout (all integers little-endian, strings u32 length-prefixed):
+//   magic "NSCACHE1", u64 count, then count * (key string, value string)
+// Entries are stored least recently used first so loading restores recency.
+static constexpr char CACHE_FILE_MAGIC[8] = {'N', 'S', 'C', 'A', 'C', 'H', 'E', '1'};
+
+// Search cache files since the response cache moved to normalized keys (bodies hold no query
+// echo), so files of older versions, whose bodies do, are not loaded
+static constexpr char SEARCH_CACHE_FILE_MAGIC[8] = {'N', 'S', 'C', 'A', 'C', 'H', 'E', '2'};
+
+// Cache value encoding: search bodies are stored as-is, JSON values compactly serialized
+static void write_cache_value(std::ofstream& out, const std::string& v) { write_string(out, v); }
+static void write_cache_value(std::ofstream& out, const json& v) { write_string(out, v.dump()); }
+
+static void read_cache_value(std::string&& bytes, std::shared_ptr<const std::string>& v, size_t& charge) {
+    charge = bytes.size();
+    v = std::make_shared<const std::string>(std::move(bytes));
+}
+static void read_cache_value(std::string&& bytes, std::shared_ptr<const json>& v, size_t& charge) {
+    auto j = std::make_shared<const json>(json::parse(bytes));
+    charge = json_bytes(*j);
+    v = std::move(j);
+}
+
+// Legacy JSON cache files store the value tree under "result" (AI caches only)
+static void legacy_cache_value(json&& result, std::shared_ptr<const json>& v, size_t& charge) {
+    auto j = std::make_shared<const json>(std::move(result));
+    charge = json_bytes(*j);
+    v = std::move(j);
+}
+
+// Snapshot a cache and write it to a binary file (temp file + rename)
+template <class V>
+static void save_cache_file(const ShardedLruCache<V>& c, const fs::path& cache_file,
+                            const char* label, const char (&file_magic)[8] = CACHE_FILE_MAGIC) {
+    try {
+        // Take references to the entries first so shards are not locked during I/O
+        std::vector<std::pair<std::string, std::shared_ptr<const V>>> entries;
+        entries.reserve(c.size());
+        c.for_each([&](const std::string& key, const std::shared_ptr<const V>& value) {
+            entries.emplace_back(key, value);
+        });
+
+        fs::path tmp_file = cache_file;
+        tmp_file += ".tmp";
+        {
+            std::ofstream out(tmp_file, std::ios::binary);
+            if (!out) {
+                std::cerr << "[cache] Failed to open " << tmp_file << " for writing\n";
+                return;
+            }
+            out.write(file_magic, sizeof(file_magic));
+            write_u64(out, (uint64_t)entries.size());
+            for (const auto& [key, value] : entries) {
+                write_string(out, key);
+                write_cache_value(out, *value);
+            }
+            if (!out) {
+                std::cerr << "[cache] Failed while writing " << tmp_file << "\n";
+                return;
             }
-            
-            std::string key = item["key"];
-            json result = item["result"];
-            
-            // Add to LRU list and cache
-            lru_list.push_back(key);  // Add at back (older entries)
-            CacheEntry entry;
-            entry.result = result;
-            entry.lru_iter = --lru_list.end();
-            cache[key] = entry;
-            loaded++;
         }
-        
-        std::cerr << "[cache] Loaded " << loaded << " search cache entries\n";
-        
+        fs::rename(tmp_file, cache_file);
+        std::cerr << "[cache] Saved " << entries.size() << " " << label
+                  << " cache entries to " << cache_file << "\n";
     } catch (const std::exception& e) {
-        std::cerr << "[cache] Error loading search cache: " << e.what() << "\n";
+        std::cerr << "[cache] Error saving " << label << " cache: " << e.what() << "\n";
     }
 }
 
-// Save AI overview cache to JSON file
-void Engine::save_ai_overview_cache() {
+// Load a binary cache file (returns false if the file does not exist or is unreadable)
+template <class V>
+static bool load_cache_file(ShardedLruCache<V>& c, const fs::path& cache_file,
+                            const char* label, const char (&file_magic)[8] = CACHE_FILE_MAGIC) {
+    if (!fs::exists(cache_file)) return false;
+
     try {
-        json cache_json = json::array();
-        
-        // Serialize AI overview cache entries
-        for (const auto& kv : ai_overview_cache) {
-            const std::string& key = kv.first;
-            const CacheEntry& entry = kv.second;
-            
-            json item;
-            item["key"] = key;
-            item["result"] = entry.result;
-            
-            cache_json.push_back(item);
+        std::ifstream in(cache_file, std::ios::binary);
+        char magic[sizeof(file_magic)] = {};
+        in.read(magic, sizeof(magic));
+        if (!in || std::memcmp(magic, file_magic, sizeof(magic)) != 0) {
+            std::cerr << "[cache] Invalid " << label << " cache file: " << cache_file << "\n";
+            return false;
         }
-        
-        // Write to file
-        fs::path cache_file = "ai_overview_cache.json";
-        std::ofstream ofs(cache_file);
-        if (ofs.is_open()) {
-            ofs << cache_json.dump(2);
-            ofs.close();
-            std::cerr << "[cache] Saved " << cache_json.size() << " AI overview cache entries to " << cache_file << "\n";
-        } else {
-            std::cerr << "[cache] Failed to open " << cache_file << " for writing\n";
+
+        // Clear existing cache
+        c.clear();
+
+        uint64_t count = read_u64(in);
+        size_t loaded = 0;
+        for (uint64_t i = 0; i < count && in; i++) {
+            std::string key = read_string(in);
+            std::string bytes = read_string(in);
+            if (!in) break;
+
+            std::shared_ptr<const V> value;
+            size_t charge = 0;
+            read_cache_value(std::move(bytes), value, charge);
+            c.put(key, std::move(value), charge);
+            loaded++;
         }
+
+        std::cerr << "[cache] Loaded " << loaded << " " << label << " cache entries from "
+                  << cache_file << "\n";
+        return true;
     } catch (const std::exception& e) {
-        std::cerr << "[cache] Error saving AI overview cache: " << e.what() << "\n";
+        std::cerr << "[cache] Error loading " << label << " cache: " << e.what() << "\n";
+        return false;
     }
 }
 
-// Load AI overview cache from JSON file
-void Engine::load_ai_overview_cache() {
+// Load a legacy JSON cache file ([{"key": ..., "result": ...}]) for migration
+template <class V>
+static void load_legacy_cache_file(ShardedLruCache<V>& c, const fs::path& cache_file,
+                                   const char* label) {
     try {
-        fs::path cache_file = "ai_overview_cache.json";
-        
         if (!fs::exists(cache_file)) {
-            std::cerr << "[cache] No AI overview cache file found at " << cache_file << "\n";
+            std::cerr << "[cache] No " << label << " cache file found\n";
             return;
         }
         
@@ -682,127 +1530,108 @@ void Engine::load_ai_overview_cache() {
         ifs.close();
         
         if (!cache_json.is_array()) {
-            std::cerr << "[cache] Invalid AI overview cache file format (not an array)\n";
+            std::cerr << "[cache] Invalid " << label << " cache file format (not an array)\n";
             return;
         }
         
-        // Clear existing AI overview cache
-        ai_overview_cache.clear();
-        ai_overview_lru_list.clear();
+        // Clear existing cache
+        c.clear();
         
-        // Load entries
+        // Load entries (file order is oldest first, so recency is restored)
         size_t loaded = 0;
-        
-        for (const auto& item : cache_json) {
+        for (auto& item : cache_json) {
             if (!item.contains("key") || !item.contains("result")) {
                 continue;
             }
             
             std::string key = item["key"];
-            json result = item["result"];
-            
-            // Add to LRU list and cache
-            ai_overview_lru_list.push_back(key);  // Add at back (older entries)
-            CacheEntry entry;
-            entry.result = result;
-            entry.lru_iter = --ai_overview_lru_list.end();
-            ai_overview_cache[key] = entry;
+            std::shared_ptr<const V> value;
+            size_t charge = 0;
+            legacy_cache_value(std::move(item["result"]), value, charge);
+            c.put(key, std::move(value), charge);
             loaded++;
         }
         
-        std::cerr << "[cache] Loaded " << loaded << " AI overview cache entries\n";
+        std::cerr << "[cache] Loaded " << loaded << " " << label << " cache entries from "
+                  << cache_file << " (legacy JSON)\n";
         
     } catch (const std::exception& e) {
-        std::cerr << "[cache] Error loading AI overview cache: " << e.what() << "\n";
+        std::cerr << "[cache] Error loading " << label << " cache: " << e.what() << "\n";
     }
 }
 
-// Save AI summary cache to JSON file
+// Save search cache to binary file
+void Engine::save_cache() {
+    std::lock_guard<std::mutex> lock(cache_file_mtx);
+    save_cache_file(cache, "search_cache.bin", "search", SEARCH_CACHE_FILE_MAGIC);
+}
+
+// Load search cache from binary file (older files and legacy JSON are keyed by raw query, so skipped)
+void Engine::load_cache() {
+    load_cache_file(cache, "search_cache.bin", "search", SEARCH_CACHE_FILE_MAGIC);
+
+    // Start the shadow policy from the same contents
+    cache_shadow.clear();
+    cache.for_each([&](const std::string& key, const std::shared_ptr<const std::string>& body) {
+        cache_shadow.put(key, nullptr, body->size());
+    });
+}
+
+// Save AI overview cache to binary file
+void Engine::save_ai_overview_cache() {
+    std::lock_guard<std::mutex> lock(cache_file_mtx);
+    save_cache_file(ai_overview_cache, "ai_overview_cache.bin", "AI overview");
+}
+
+// Load AI overview cache from binary file (or legacy JSON file)
+void Engine::load_ai_overview_cache() {
+    if (!load_cache_file(ai_overview_cache, "ai_overview_cache.bin", "AI overview"))
+        load_legacy_cache_file(ai_overview_cache, "ai_overview_cache.json", "AI overview");
+}
+
+// Save AI summary cache to binary file
 void Engine::save_ai_summary_cache() {
-    try {
-        json cache_json = json::array();
-        
-        // Serialize AI summary cache entries
-        for (const auto& kv : ai_summary_cache) {
-            const std::string& key = kv.first;
-            const CacheEntry& entry = kv.second;
-            
-            json item;
-            item["key"] = key;
-            item["result"] = entry.result;
-            
-            cache_json.push_back(item);
-        }
-        
-        // Write to file
-        fs::path cache_file = "ai_summary_cache.json";
-        std::ofstream ofs(cache_file);
-        if (ofs.is_open()) {
-            ofs << cache_json.dump(2);
-            ofs.close();
-            std::cerr << "[cache] Saved " << cache_json.size() << " AI summary cache entries to " << cache_file << "\n";
-        } else {
-            std::cerr << "[cache] Failed to open " << cache_file << " for writing\n";
-        }
-    } catch (const std::exception& e) {
-        std::cerr << "[cache] Error saving AI summary cache: " << e.what() << "\n";
-    }
+    std::lock_guard<std::mutex> lock(cache_file_mtx);
+    save_cache_file(ai_summary_cache, "ai_summary_cache.bin", "AI summary");
 }
 
-// Load AI summary cache from JSON file
+// Load AI summary cache from binary file (or legacy JSON file)
 void Engine::load_ai_summary_cache() {
-    try {
-        fs::path cache_file = "ai_summary_cache.json";
-        
-        if (!fs::exists(cache_file)) {
-            std::cerr << "[cache] No AI summary cache file found at " << cache_file << "\n";
-            return;
-        }
-        
-        std::ifstream ifs(cache_file);
-        if (!ifs.is_open()) {
-            std::cerr << "[cache] Failed to open " << cache_file << " for reading\n";
-            return;
-        }
-        
-        json cache_json;
-        ifs >> cache_json;
-        ifs.close();
-        
-        if (!cache_json.is_array()) {
-            std::cerr << "[cache] Invalid AI summary cache file format (not an array)\n";
-            return;
-        }
-        
-        // Clear existing AI summary cache
-        ai_summary_cache.clear();
-        ai_summary_lru_list.clear();
-        
-        // Load entries
-        size_t loaded = 0;
-        
-        for (const auto& item : cache_json) {
-            if (!item.contains("key") || !item.contains("result")) {
-                continue;
-            }
-            
-            std::string key = item["key"];
-            json result = item["result"];
-            
-            // Add to LRU list and cache
-            ai_summary_lru_list.push_back(key);  // Add at back (older entries)
-            CacheEntry entry;
-            entry.result = result;
-            entry.lru_iter = --ai_summary_lru_list.end();
-            ai_summary_cache[key] = entry;
-            loaded++;
+    if (!load_cache_file(ai_summary_cache, "ai_summary_cache.bin", "AI summary"))
+        load_legacy_cache_file(ai_summary_cache, "ai_summary_cache.json", "AI summary");
+}
+
+// Save every cache that changed since its last save
+void Engine::flush_dirty_caches() {
+    if (cache_dirty.exchange(false)) save_cache();
+    if (ai_overview_cache_dirty.exchange(false)) save_ai_overview_cache();
+    if (ai_summary_cache_dirty.exchange(false)) save_ai_summary_cache();
+}
+
+// Start the background thread that persists dirty caches (no-op if running)
+void Engine::start_cache_flusher() {
+    if (cache_flusher.joinable()) return;
+    cache_flusher_stop = false;
+    cache_flusher = std::thread([this] {
+        std::unique_lock<std::mutex> lock(cache_flusher_mtx);
+        while (!cache_flusher_stop) {
+            cache_flusher_cv.wait_for(lock, CACHE_FLUSH_INTERVAL, [this] { return cache_flusher_stop; });
+            lock.unlock();
+            flush_dirty_caches();
+            lock.lock();
         }
-        
-        std::cerr << "[cache] Loaded " << loaded << " AI summary cache entries\n";
-        
-    } catch (const std::exception& e) {
-        std::cerr << "[cache] Error loading AI summary cache: " << e.what() << "\n";
+    });
+}
+
+// Stop the background flusher thread
+void Engine::stop_cache_flusher() {
+    if (!cache_flusher.joinable()) return;
+    {
+        std::lock_guard<std::mutex> lock(cache_flusher_mtx);
+        cache_flusher_stop = true;
     }
+    cache_flusher_cv.notify_all();
+    cache_flusher.join();
 }
 
 } // namespace cord19
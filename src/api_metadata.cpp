@@ -7,6 +7,16 @@
 #include <string>
 #include <vector>
 
+#if defined(__SSE2__) || defined(_M_X64)
+#include <emmintrin.h>
+#endif
+#ifdef _MSC_VER
+#include <intrin.h>
+#endif
+
+#include "mmap_file.hpp"
+#include "parallel.hpp"
+
 namespace cord19 {
 
 // Parse a CSV line into individual columns
@@ -57,7 +67,7 @@ static inline std::string trim_copy(std::string s) {
 }
 
 // Extract first author surname and append "et al."
-static std::string first_author_et_al(const std::string& authors_raw) {
+std::string first_author_et_al(const std::string& authors_raw) {
     std::string s = trim_copy(authors_raw);
     if (s.empty()) return "";
 
@@ -105,31 +115,101 @@ static std::string first_author_et_al(const std::string& authors_raw) {
     return surname + " et al.";
 }
 
+// Find the first of up to three delimiter bytes in [p, end) (end if none).
+// Compares 16 bytes at a time where SSE2 is available.
+static const char* find_any_of(const char* p, const char* end, char a, char b, char c) {
+#if defined(__SSE2__) || defined(_M_X64)
+    const __m128i va = _mm_set1_epi8(a);
+    const __m128i vb = _mm_set1_epi8(b);
+    const __m128i vc = _mm_set1_epi8(c);
+    while (end - p >= 16) {
+        __m128i x = _mm_loadu_si128(reinterpret_cast<const __m128i*>(p));
+        __m128i m = _mm_or_si128(_mm_or_si128(_mm_cmpeq_epi8(x, va), _mm_cmpeq_epi8(x, vb)),
+                                 _mm_cmpeq_epi8(x, vc));
+        unsigned mask = (unsigned)_mm_movemask_epi8(m);
+        if (mask) {
+#ifdef _MSC_VER
+            unsigned long i;
+            _BitScanForward(&i, mask);
+            return p + i;
+#else
+            return p + __builtin_ctz(mask);
+#endif
+        }
+        p += 16;
+    }
+#endif
+    for (; p < end; ++p) {
+        if (*p == a || *p == b || *p == c) return p;
+    }
+    return end;
+}
+
+// End of the CSV record starting at p (one past its '\n', or end).
+// `inq` is the quote state at p; newlines inside quotes do not end the record.
+static const char* record_end(const char* p, const char* end, bool inq = false) {
+    while (p < end) {
+        p = inq ? find_any_of(p, end, '"', '"', '"') : find_any_of(p, end, '"', '\n', '\n');
+        if (p == end) break;
+        if (*p == '\n') return p + 1;
+        inq = !inq; // a "" escape toggles twice, so the state stays correct
+        ++p;
+    }
+    return end;
+}
+
+// Read field `col` of the record starting at p, stopping there (returns false if the record is shorter)
+static bool record_field(const char* p, const char* end, int col, std::string& out) {
+    out.clear();
+
+    // Skip earlier fields
+    for (int f = 0; f < col; f++) {
+        bool inq = false;
+        for (;;) {
+            p = inq ? find_any_of(p, end, '"', '"', '"') : find_any_of(p, end, ',', '"', '\n');
+            if (p == end || (!inq && *p == '\n')) return false;
+            if (*p == '"') { inq = !inq; ++p; continue; }
+            ++p; // comma ends the field
+            break;
+        }
+    }
+
+    // Copy the wanted field without quotes ("" becomes ")
+    bool inq = false;
+    while (p < end) {
+        const char* q = inq ? find_any_of(p, end, '"', '"', '"') : find_any_of(p, end, ',', '"', '\n');
+        out.append(p, q);
+        if (q == end) break;
+        if (*q == '"') {
+            if (inq && q + 1 < end && q[1] == '"') { out.push_back('"'); p = q + 2; continue; }
+            inq = !inq;
+            p = q + 1;
+            continue;
+        }
+        break; // comma or newline outside quotes
+    }
+    if (!out.empty() && out.back() == '\r') out.pop_back();
+    return true;
+}
+
 // Load metadata CSV byte positions and map cord_uid to file positions
 void load_metadata_uid_meta(const fs::path& metadata_csv,
                             std::unordered_map<std::string, MetaInfo>& uid_to_meta) {
 
-    // Open metadata CSV file
-    std::ifstream in(metadata_csv, std::ios::binary);
-    if (!in) {
+    // Map metadata CSV file
+    MappedFile mf;
+    if (!mf.open(metadata_csv)) {
         std::cerr << "[metadata] FAILED open: "
                   << metadata_csv.string() << "\n";
         return;
     }
+    const char* base = mf.data();
+    const char* end = base + mf.size();
 
-    // Read header line and track its position
-    std::string header;
-    uint64_t current_pos = 0;
-    
-    if (!std::getline(in, header)) {
-        std::cerr << "[metadata] FAILED read header\n";
-        return;
-    }
-    
-    // Move past header (including newline)
-    current_pos = in.tellg();
-
-    // Parse column names
+    // Parse column names from the header record
+    const char* body = record_end(base, end);
+    std::string header(base, body);
+    while (!header.empty() && (header.back() == '\n' || header.back() == '\r')) header.pop_back();
     auto cols = csv_row(header);
     int uid_i = -1;
 
@@ -144,107 +224,210 @@ void load_metadata_uid_meta(const fs::path& metadata_csv,
         return;
     }
 
-    std::string line;
-    size_t loaded = 0, bad = 0;
-
-    // Read metadata rows and store byte positions
-    while (std::getline(in, line)) {
-        uint64_t line_start = current_pos;
-        uint32_t line_length = static_cast<uint32_t>(line.length() + 1); // +1 for newline
-        
-        auto r = csv_row(line);
+    // Split the body into chunks. Quote parity of everything before a cut point
+    // tells whether the cut is inside a quoted field, so each chunk can find its
+    // first real record boundary without scanning from the start of the file.
+    size_t nthreads = worker_count((size_t)(end - body), 4u << 20);
+    std::vector<const char*> cuts(nthreads + 1);
+    for (size_t i = 0; i <= nthreads; i++) cuts[i] = body + (size_t)(end - body) * i / nthreads;
+
+    std::vector<size_t> quotes(nthreads, 0);
+    run_parallel(nthreads, [&](size_t c) {
+        for (const char* p = cuts[c]; (p = find_any_of(p, cuts[c + 1], '"', '"', '"')) < cuts[c + 1]; ++p)
+            quotes[c]++;
+    });
+
+    std::vector<const char*> starts(nthreads + 1, end);
+    starts[0] = body;
+    size_t parity = 0;
+    for (size_t c = 1; c < nthreads; c++) {
+        parity += quotes[c - 1];
+        starts[c] = record_end(cuts[c], end, parity % 2 == 1);
+    }
+    for (size_t c = nthreads - 1; c >= 1; c--) {
+        starts[c] = std::min(starts[c], starts[c + 1]);
+    }
 
-        // Skip malformed rows
-        if ((int)r.size() <= uid_i) {
-            bad++;
-            current_pos += line_length;
-            continue;
+    // Collect (cord_uid, offset, length) of each record in parallel
+    struct Row {
+        std::string uid;
+        MetaInfo info;
+    };
+    std::vector<std::vector<Row>> rows(nthreads);
+    std::vector<size_t> bad(nthreads, 0);
+
+    run_parallel(nthreads, [&](size_t c) {
+        std::string uid;
+        for (const char* p = starts[c]; p < starts[c + 1];) {
+            const char* next = record_end(p, end);
+            if (!record_field(p, next, uid_i, uid)) {
+                if (next - p > 2) bad[c]++; // blank lines are not bad rows
+            } else if (!uid.empty()) {
+                MetaInfo info;
+                info.file_offset = (uint64_t)(p - base);
+                info.row_length = (uint32_t)(next - p);
+                rows[c].push_back(Row{uid, info});
+            }
+            p = next;
         }
+    });
 
-        auto uid = r[uid_i];
-        if (uid.empty()) {
-            current_pos += line_length;
-            continue;
-        }
+    // Insert in file order so the first occurrence of a cord_uid wins
+    size_t total = 0, bad_rows = 0;
+    for (size_t c = 0; c < nthreads; c++) {
+        total += rows[c].size();
+        bad_rows += bad[c];
+    }
+    uid_to_meta.reserve(uid_to_meta.size() + total);
 
-        // Store byte position for this cord_uid (only first occurrence)
-        if (uid_to_meta.find(uid) == uid_to_meta.end()) {
-            MetaInfo& entry = uid_to_meta[uid];
-            entry.file_offset = line_start;
-            entry.row_length = line_length;
-            loaded++;
+    size_t loaded = 0;
+    for (auto& chunk : rows) {
+        for (auto& r : chunk) {
+            if (uid_to_meta.emplace(std::move(r.uid), r.info).second) loaded++;
         }
-        
-        current_pos += line_length;
+        std::vector<Row>().swap(chunk);
     }
 
     // Print loading summary
     std::cerr << "[metadata] loaded=" << loaded
-              << " bad_rows=" << bad
-              << " map_size=" << uid_to_meta.size() << "\n";
+              << " bad_rows=" << bad_rows
+              << " map_size=" << uid_to_meta.size()
+              << " threads=" << nthreads << "\n";
 }
 
-// Fetch full metadata from file on-demand using stored byte position
-MetaData fetch_metadata(const fs::path& metadata_csv, const MetaInfo& meta_info) {
-    MetaData result;
-    
-    // Open file and seek to the stored position
+// Resolve metadata column positions from the CSV header
+bool read_metadata_columns(const fs::path& metadata_csv, MetadataColumns& cols) {
+    cols = MetadataColumns{};
+
+    std::ifstream in(metadata_csv, std::ios::binary);
+    std::string header;
+    if (!in || !std::getline(in, header)) {
+        std::cerr << "[metadata] FAILED to read header: " << metadata_csv.string() << "\n";
+        return false;
+    }
+    if (!header.empty() && header.back() == '\r') header.pop_back();
+
+    auto names = csv_row(header);
+    for (int i = 0; i < (int)names.size(); i++) {
+        if (names[i] == "url") cols.url = i;
+        if (names[i] == "publish_time") cols.publish_time = i;
+        if (names[i] == "authors") cols.authors = i;
+        if (names[i] == "title") cols.title = i;
+        if (names[i] == "abstract") cols.abstract = i;
+        if (names[i] == "journal") cols.journal = i;
+        if (names[i] == "source_x" || names[i] == "source") cols.source = i;
+    }
+    return true;
+}
+
+// Split a CSV record into raw field slices (quotes included), stopping after column max_col
+static void csv_field_slices(const char* p, const char* end, int max_col,
+                             std::vector<std::string_view>& out) {
+    out.clear();
+    while ((int)out.size() <= max_col) {
+        const char* b = p;
+        bool inq = false;
+        for (;;) {
+            p = inq ? find_any_of(p, end, '"', '"', '"') : find_any_of(p, end, ',', '"', '\n');
+            if (p == end || (!inq && *p != '"')) break;
+            inq = !inq;
+            ++p;
+        }
+        const char* e = p;
+        if (e > b && e[-1] == '\r' && (p == end || *p == '\n')) --e;
+        out.emplace_back(b, (size_t)(e - b));
+        if (p == end || *p == '\n') break;
+        ++p; // skip comma
+    }
+}
+
+// Copy a raw CSV field without its quotes ("" becomes ")
+static std::string unquote(std::string_view raw) {
+    std::string out;
+    out.reserve(raw.size());
+    bool inq = false;
+    for (size_t i = 0; i < raw.size(); i++) {
+        char c = raw[i];
+        if (c != '"') {
+            out.push_back(c);
+        } else if (inq && i + 1 < raw.size() && raw[i + 1] == '"') {
+            out.push_back('"');
+            i++;
+        } else {
+            inq = !inq;
+        }
+    }
+    return out;
+}
+
+// Fetch several rows with one open; rows are read in file order and nearby rows in one read
+std::vector<MetaData> fetch_metadata_batch(const fs::path& metadata_csv, const MetadataColumns& cols,
+                                           const std::vector<MetaInfo>& rows, bool with_abstract) {
+    std::vector<MetaData> result(rows.size());
+    if (rows.empty()) return result;
+
     std::ifstream in(metadata_csv, std::ios::binary);
     if (!in) {
         std::cerr << "[metadata] FAILED to open file for fetch: "
                   << metadata_csv.string() << "\n";
         return result;
     }
-    
-    // Seek to the row position
-    in.seekg(meta_info.file_offset);
-    
-    // Read the row
-    std::string line;
-    if (!std::getline(in, line)) {
-        std::cerr << "[metadata] FAILED to read row at offset: "
-                  << meta_info.file_offset << "\n";
-        return result;
-    }
-    
-    // Parse the CSV row
-    auto r = csv_row(line);
-    
-    // Read header to get column indices (cache this in production for better performance)
-    in.seekg(0);
-    std::string header;
-    if (!std::getline(in, header)) {
-        std::cerr << "[metadata] FAILED to read header\n";
-        return result;
+
+    // Visit rows in offset order
+    std::vector<size_t> order(rows.size());
+    for (size_t i = 0; i < order.size(); i++) order[i] = i;
+    std::sort(order.begin(), order.end(),
+              [&](size_t a, size_t b) { return rows[a].file_offset < rows[b].file_offset; });
+
+    // Only scan as far as the last wanted column
+    int max_col = std::max({cols.url, cols.publish_time, cols.authors, cols.title, cols.journal,
+                            cols.source, with_abstract ? cols.abstract : -1});
+    if (max_col < 0) return result;
+
+    // Rows closer than this are fetched with a single read
+    constexpr uint64_t MAX_GAP = 64 * 1024;
+
+    std::string buf;
+    std::vector<std::string_view> fields;
+    auto field = [&](int col) -> std::string {
+        return (col >= 0 && col < (int)fields.size()) ? unquote(fields[col]) : std::string();
+    };
+
+    for (size_t i = 0; i < order.size();) {
+        // Extend the read range over following rows while the gaps are small
+        uint64_t begin = rows[order[i]].file_offset;
+        uint64_t end = begin + rows[order[i]].row_length;
+        size_t j = i + 1;
+        while (j < order.size() && rows[order[j]].file_offset <= end + MAX_GAP) {
+            end = std::max(end, rows[order[j]].file_offset + rows[order[j]].row_length);
+            j++;
+        }
+
+        buf.resize((size_t)(end - begin));
+        in.clear();
+        in.seekg((std::streamoff)begin);
+        if (!in.read(&buf[0], (std::streamsize)buf.size())) {
+            std::cerr << "[metadata] FAILED to read rows at offset: " << begin << "\n";
+            i = j;
+            continue;
+        }
+
+        // Parse the wanted columns of each row in the range
+        for (; i < j; i++) {
+            const MetaInfo& mi = rows[order[i]];
+            const char* rp = buf.data() + (mi.file_offset - begin);
+            csv_field_slices(rp, rp + mi.row_length, max_col, fields);
+
+            MetaData& m = result[order[i]];
+            m.url = field(cols.url);
+            m.publish_time = field(cols.publish_time);
+            m.author = first_author_et_al(field(cols.authors));
+            m.title = field(cols.title);
+            m.journal = field(cols.journal);
+            m.source = field(cols.source);
+            if (with_abstract) m.abstract = field(cols.abstract);
+        }
     }
-    
-    auto cols = csv_row(header);
-    int url_i = -1, pub_i = -1, auth_i = -1, title_i = -1, abstract_i = -1;
-    
-    for (int i = 0; i < (int)cols.size(); i++) {
-        if (cols[i] == "url") url_i = i;
-        if (cols[i] == "publish_time") pub_i = i;
-        if (cols[i] == "authors") auth_i = i;
-        if (cols[i] == "title") title_i = i;
-        if (cols[i] == "abstract") abstract_i = i;
-    }
-    
-    // Extract fields
-    if (url_i >= 0 && (int)r.size() > url_i)
-        result.url = r[url_i];
-    
-    if (pub_i >= 0 && (int)r.size() > pub_i)
-        result.publish_time = r[pub_i];
-    
-    if (auth_i >= 0 && (int)r.size() > auth_i)
-        result.author = first_author_et_al(r[auth_i]);
-    
-    if (title_i >= 0 && (int)r.size() > title_i)
-        result.title = r[title_i];
-    
-    if (abstract_i >= 0 && (int)r.size() > abstract_i)
-        result.abstract = r[abstract_i];
-    
     return result;
 }
 
@@ -1,6 +1,7 @@
 #include "api_segment.hpp"
 
 #include <algorithm>
+#include <cstring>
 #include <fstream>
 #include <iomanip>
 #include <iostream>
@@ -60,10 +61,39 @@ static bool load_segment_legacy(const fs::path& segdir, Segment& s) {
         s.lex.emplace(std::move(term), e);
     }
 
-    // Open legacy inverted file stream
-    s.inv.open(segdir / "inverted.bin", std::ios::binary);
+    // Open legacy inverted file
     s.use_barrels = false;
-    return (bool)s.inv;
+    return s.inv.open(segdir / "inverted.bin");
+}
+
+// Load fields.bin (per-doc field lengths) and open the field tf barrels
+static bool load_segment_fields(const fs::path& segdir, Segment& s) {
+    std::ifstream in(field_lens_path(segdir), std::ios::binary);
+    char magic[sizeof(FIELDS_MAGIC)] = {};
+    in.read(magic, sizeof(magic));
+    if (!in || std::memcmp(magic, FIELDS_MAGIC, sizeof(magic)) != 0) return false;
+    if (read_u32(in) != (uint32_t)s.docs.size()) return false;
+
+    s.field_lens.resize(s.docs.size());
+    in.read((char*)s.field_lens.data(), (std::streamsize)(s.field_lens.size() * sizeof(FieldLens)));
+    if (!in) return false;
+
+    // Average length per field (body = doc_len minus title and abstract)
+    double sum[FIELD_COUNT] = {};
+    for (size_t i = 0; i < s.docs.size(); i++) {
+        const FieldLens& f = s.field_lens[i];
+        sum[FIELD_TITLE] += f.title;
+        sum[FIELD_ABSTRACT] += f.abstract;
+        sum[FIELD_BODY] += (double)s.docs[i].doc_len - f.title - f.abstract;
+    }
+    for (uint32_t f = 0; f < FIELD_COUNT; f++)
+        s.avg_field_len[f] = s.docs.empty() ? 0.0f : (float)(sum[f] / (double)s.docs.size());
+
+    s.field_barrels.resize(s.barrel_params.barrel_count);
+    for (uint32_t b = 0; b < s.barrel_params.barrel_count; b++) {
+        if (!s.field_barrels[b].open(field_tf_barrel_path(segdir, b))) return false;
+    }
+    return true;
 }
 
 // Load segment using barrelized inverted index format
@@ -74,8 +104,7 @@ static bool load_segment_barrels(const fs::path& segdir, Segment& s) {
     // Open all inverted barrel files
     s.inv_barrels.resize(s.barrel_params.barrel_count);
     for (uint32_t b = 0; b < s.barrel_params.barrel_count; b++) {
-        s.inv_barrels[b].open(inv_barrel_path(segdir, b), std::ios::binary);
-        if (!s.inv_barrels[b]) return false;
+        if (!s.inv_barrels[b].open(inv_barrel_path(segdir, b))) return false;
     }
 
     // Load lexicon from all lex barrels
@@ -98,9 +127,73 @@ static bool load_segment_barrels(const fs::path& segdir, Segment& s) {
             s.lex.emplace(std::move(term), e);
         }
     }
+
+    // Open positions barrels if the segment was built with them
+    s.has_positions = false;
+    s.pos_barrels.clear();
+    if (has_positions(segdir)) {
+        s.pos_barrels.resize(s.barrel_params.barrel_count);
+        bool ok = true;
+        for (uint32_t b = 0; b < s.barrel_params.barrel_count && ok; b++)
+            ok = s.pos_barrels[b].open(pos_barrel_path(segdir, b));
+        if (ok) s.has_positions = true;
+        else {
+            std::cerr << "[segment] Unreadable positions barrels, phrases match as AND: " << segdir << "\n";
+            s.pos_barrels.clear();
+        }
+    }
+
+    // Field data switches the segment to BM25F scoring
+    s.has_fields = false;
+    if (has_fields(segdir)) {
+        if (load_segment_fields(segdir, s)) s.has_fields = true;
+        else {
+            std::cerr << "[segment] Unreadable field data, scoring with BM25: " << segdir << "\n";
+            s.field_lens.clear();
+            s.field_barrels.clear();
+        }
+    }
     return true;
 }
 
+// Load docs.bin: doc lengths and the cord_uid heap (metadata rows are resolved later)
+bool load_segment_docs(const fs::path& segdir, Segment& s) {
+    std::ifstream in(segdir / "docs.bin", std::ios::binary);
+    if (!in) return false;
+    uint32_t n = read_u32(in);
+    s.docs.assign(n, DocInfo{});
+    s.uid_heap.clear();
+    s.uid_offsets.assign(1, 0);
+    s.uid_offsets.reserve((size_t)n + 1);
+
+    // Read per-doc fields (only cord_uid and doc_len are used)
+    for (uint32_t i = 0; i < n; i++) {
+        s.uid_heap += read_string(in);
+        s.uid_offsets.push_back((uint32_t)s.uid_heap.size());
+        read_string(in);  // Skip title (available in metadata.csv)
+        read_string(in);  // Skip json_relpath (available in metadata.csv)
+        s.docs[i].doc_len = read_u32(in);
+    }
+    return (bool)in;
+}
+
+// List segment names from manifest.bin, or scan the segments folder if it is missing/empty
+std::vector<std::string> list_segment_names(const fs::path& index_dir) {
+    auto names = load_manifest(index_dir / "manifest.bin");
+    if (!names.empty()) return names;
+
+    fs::path segroot = index_dir / "segments";
+    if (fs::exists(segroot) && fs::is_directory(segroot)) {
+        for (auto& e : fs::directory_iterator(segroot)) {
+            if (!e.is_directory()) continue;
+            auto name = e.path().filename().string();
+            if (name.rfind("seg_", 0) == 0) names.push_back(name);
+        }
+        std::sort(names.begin(), names.end());
+    }
+    return names;
+}
+
 // Load segment stats, docs, and lexicon/index files
 bool load_segment(const fs::path& segdir, Segment& s) {
     s = Segment{};
@@ -115,20 +208,7 @@ bool load_segment(const fs::path& segdir, Segment& s) {
     }
 
     // Load docs.bin document metadata
-    {
-        std::ifstream in(segdir / "docs.bin", std::ios::binary);
-        if (!in) return false;
-        uint32_t n = read_u32(in);
-        s.docs.resize(n);
-
-        // Read per-doc fields (only cord_uid and doc_len are used)
-        for (uint32_t i = 0; i < n; i++) {
-            s.docs[i].cord_uid = read_string(in);
-            read_string(in);  // Skip title (available in metadata.csv)
-            read_string(in);  // Skip json_relpath (available in metadata.csv)
-            s.docs[i].doc_len = read_u32(in);
-        }
-    }
+    if (!load_segment_docs(segdir, s)) return false;
 
     // Pick barrel or legacy loader based on segment files
     if (has_barrels(segdir)) return load_segment_barrels(segdir, s);
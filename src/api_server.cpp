@@ -2,7 +2,6 @@
 #include <filesystem>
 #include <iostream>
 #include <string>
-#include <thread>
 
 #include "api_add_document.hpp"
 #include "api_ai_overview.hpp"
@@ -12,6 +11,7 @@
 #include "api_http.hpp"
 #include "api_stats.hpp"
 #include "env_loader.hpp"
+#include "sse.hpp"
 #include "third_party/httplib.h"
 
 using cord19::Engine;
@@ -60,6 +60,29 @@ int main(int argc, char** argv) {
     
     if (azure_enabled) {
         std::cout << "[azure] Azure OpenAI enabled with model: " << azure_config.model << "\n";
+
+        // Upstream calls share a few keep-alive connections and wait in a bounded queue
+        // A missing, malformed or non-positive value keeps the default
+        auto env_positive = [&env_vars](const char* name, long long fallback) {
+            const std::string& v = env_vars[name];
+            if (v.empty()) return fallback;
+            try {
+                size_t used = 0;
+                long long n = std::stoll(v, &used);
+                if (used == v.size() && n > 0) return n;
+            } catch (const std::exception&) {
+            }
+            std::cerr << "[azure] Ignoring invalid " << name << "=" << v << " (using " << fallback << ")\n";
+            return fallback;
+        };
+        cord19::UpstreamClient::Options upstream_opt;
+        upstream_opt.connections =
+            (size_t)env_positive("AZURE_OPENAI_CONNECTIONS", (long long)upstream_opt.connections);
+        upstream_opt.queue_capacity =
+            (size_t)env_positive("AZURE_OPENAI_QUEUE", (long long)upstream_opt.queue_capacity);
+        azure_config.timeout = std::chrono::milliseconds(
+            env_positive("AZURE_OPENAI_TIMEOUT_MS", (long long)azure_config.timeout.count()));
+        azure_config.client = std::make_shared<cord19::UpstreamClient>(azure_config.endpoint, upstream_opt);
     } else {
         std::cout << "[azure] Azure OpenAI not configured (AI overview endpoint will return error)\n";
     }
@@ -130,15 +153,28 @@ int main(int argc, char** argv) {
         int k = 10;
         if (req.has_param("k")) k = std::stoi(req.get_param_value("k"));
 
+        // Optional attribute filter and facet counts
+        cord19::SearchFilter filter;
+        std::string filter_error;
+        if (req.has_param("filter") &&
+            !cord19::Engine::parse_filter(req.get_param_value("filter"), filter, filter_error)) {
+            res.status = 400;
+            json err;
+            err["error"] = filter_error;
+            res.set_content(err.dump(), "application/json");
+            return;
+        }
+        std::string facets_param = req.has_param("facets") ? req.get_param_value("facets") : "";
+        bool facets = facets_param == "1" || facets_param == "true";
+
         auto search_t0 = clock::now();
-        auto j = engine.search(q, k);
+        auto sr = engine.search(q, k, filter, facets);
         auto search_t1 = clock::now();
 
         double search_ms =
             std::chrono::duration<double, std::milli>(search_t1 - search_t0).count();
         
-        // Check if result was from cache
-        bool from_cache = j.contains("from_cache") && j["from_cache"] == true;
+        bool from_cache = sr.from_cache;
         
         // Track search stats
         stats_tracker.increment_searches();
@@ -146,35 +182,134 @@ int main(int argc, char** argv) {
             stats_tracker.increment_search_cache_hits();
         }
         
+        // Per-request fields spliced into the shared serialized body
+        json timing;
+        timing["query"] = sr.query;
         if (from_cache) {
             // For cached results: search_time_ms = 0, cache lookup time added to total
-            j["search_time_ms"] = 0.0;
-            j["cache_lookup_ms"] = search_ms;
+            timing["search_time_ms"] = 0.0;
+            timing["cache_lookup_ms"] = search_ms;
             
             auto total_t1 = clock::now();
             double total_ms =
                 std::chrono::duration<double, std::milli>(total_t1 - total_t0).count();
-            j["total_time_ms"] = total_ms;
-            j["cached"] = true;
-            j.erase("from_cache"); // Remove internal flag
+            timing["total_time_ms"] = total_ms;
+            timing["cached"] = true;
             
             std::cerr << "[search] q=\"" << q << "\" k=" << k
                       << " CACHED cache_lookup=" << search_ms << "ms total=" << total_ms << "ms\n";
         } else {
             // For new searches: set search time and total time
-            j["search_time_ms"] = search_ms;
+            timing["search_time_ms"] = search_ms;
             
             auto total_t1 = clock::now();
             double total_ms =
                 std::chrono::duration<double, std::milli>(total_t1 - total_t0).count();
-            j["total_time_ms"] = total_ms;
-            j["cached"] = false;
+            timing["total_time_ms"] = total_ms;
+            timing["cached"] = false;
             
             std::cerr << "[search] q=\"" << q << "\" k=" << k
                       << " search=" << search_ms << "ms total=" << total_ms << "ms\n";
         }
 
-        res.set_content(j.dump(2), "application/json");
+        res.set_content(cord19::splice_json_fields(*sr.body, timing), "application/json");
+    });
+
+    // Several searches in one request: {"queries": [{"q", "k", "filter", "facets"} or "q", ...]}
+    svr.Post("/api/search/batch", [&](const httplib::Request& req, httplib::Response& res) {
+        cord19::enable_cors(res);
+
+        using clock = std::chrono::steady_clock;
+        auto total_t0 = clock::now();
+
+        auto bad_request = [&](const std::string& msg) {
+            res.status = 400;
+            json err;
+            err["error"] = msg;
+            res.set_content(err.dump(), "application/json");
+        };
+
+        json body = json::parse(req.body, nullptr, /*allow_exceptions*/ false);
+        if (body.is_discarded() || !body.is_object() || !body.contains("queries") || !body["queries"].is_array()) {
+            bad_request("body must be a JSON object with a 'queries' array");
+            return;
+        }
+        const json& queries = body["queries"];
+        if (queries.empty() || queries.size() > cord19::Engine::MAX_BATCH_QUERIES) {
+            bad_request("'queries' must hold 1 to " + std::to_string(cord19::Engine::MAX_BATCH_QUERIES) + " queries");
+            return;
+        }
+
+        // Validate every query before running any
+        std::vector<cord19::SearchRequest> requests(queries.size());
+        for (size_t i = 0; i < queries.size(); i++) {
+            const json& qj = queries[i];
+            cord19::SearchRequest& r = requests[i];
+            std::string where = "queries[" + std::to_string(i) + "]: ";
+
+            if (qj.is_string()) {
+                r.query = qj.get<std::string>();
+                continue;
+            }
+            if (!qj.is_object() || !qj.contains("q") || !qj["q"].is_string()) {
+                bad_request(where + "missing q");
+                return;
+            }
+            r.query = qj["q"].get<std::string>();
+            if (qj.contains("k")) {
+                if (!qj["k"].is_number_integer()) {
+                    bad_request(where + "k must be an integer");
+                    return;
+                }
+                r.k = qj["k"].get<int>();
+            }
+
+            std::string filter_error;
+            if (qj.contains("filter") &&
+                (!qj["filter"].is_string() ||
+                 !cord19::Engine::parse_filter(qj["filter"].get<std::string>(), r.filter, filter_error))) {
+                bad_request(where + (filter_error.empty() ? "filter must be a string" : filter_error));
+                return;
+            }
+            if (qj.contains("facets")) {
+                const json& f = qj["facets"];
+                r.facets = f.is_boolean() ? f.get<bool>() : (f.is_string() && (f == "1" || f == "true"));
+            }
+        }
+
+        auto search_t0 = clock::now();
+        auto results = engine.search_batch(requests);
+        auto search_t1 = clock::now();
+        double search_ms = std::chrono::duration<double, std::milli>(search_t1 - search_t0).count();
+
+        // Splice the cached bodies as they are instead of re-parsing them
+        size_t hits = 0;
+        std::string out = "{\"count\":" + std::to_string(results.size()) + ",\"results\":[";
+        for (size_t i = 0; i < results.size(); i++) {
+            const auto& sr = results[i];
+            json fields;
+            fields["query"] = sr.query;
+            fields["cached"] = sr.from_cache;
+            if (i > 0) out += ',';
+            out += cord19::splice_json_fields(*sr.body, fields);
+
+            stats_tracker.increment_searches();
+            if (sr.from_cache) {
+                stats_tracker.increment_search_cache_hits();
+                hits++;
+            }
+        }
+
+        double total_ms = std::chrono::duration<double, std::milli>(clock::now() - total_t0).count();
+        json timing;
+        timing["search_time_ms"] = search_ms;
+        timing["total_time_ms"] = total_ms;
+        out += "]}";
+
+        std::cerr << "[search] batch n=" << results.size() << " cached=" << hits
+                  << " search=" << search_ms << "ms total=" << total_ms << "ms\n";
+
+        res.set_content(cord19::splice_json_fields(out, timing), "application/json");
     });
 
     svr.Get("/api/suggest", [&](const httplib::Request& req, httplib::Response& res) {
@@ -240,33 +375,9 @@ int main(int argc, char** argv) {
         
         std::cerr << "[ai_overview] Processing query: \"" << query << "\" k=" << k << "\n";
         
-        // Wait for cached results (retry with backoff for race condition with parallel /api/search call)
-        json search_results;
-        bool found_cache = false;
-        const int max_retries = 10;  // Max ~500ms wait (10 * 50ms)
-        
-        for (int retry = 0; retry < max_retries; retry++) {
-            search_results = engine.search(query, k);
-            
-            // Check if results came from cache (meaning /api/search already populated it)
-            if (search_results.contains("from_cache") && search_results["from_cache"] == true) {
-                found_cache = true;
-                std::cerr << "[ai_overview] Found cached results after " << retry << " retries\n";
-                break;
-            }
-            
-            // If we have results (even if not cached yet), we can use them
-            if (search_results.contains("results") && !search_results["results"].empty()) {
-                std::cerr << "[ai_overview] Using fresh search results (cache being populated)\n";
-                found_cache = true;
-                break;
-            }
-            
-            // Wait 50ms before retry (allow time for parallel /api/search to populate cache)
-            if (retry < max_retries - 1) {
-                std::this_thread::sleep_for(std::chrono::milliseconds(50));
-            }
-        }
+        // Same key as /api/search: a cached response is reused, and a parallel
+        // /api/search for this query is joined instead of ranked again
+        json search_results = engine.search(query, k).parsed();
         
         // Check if we got valid results
         if (!search_results.contains("results") || search_results["results"].empty()) {
@@ -278,6 +389,49 @@ int main(int argc, char** argv) {
             return;
         }
         
+        // Streaming mode: server-sent events, "delta" events with pieces of the overview as
+        // they are generated, then one "done" (or "error") event
+        std::string stream_param = req.has_param("stream") ? req.get_param_value("stream") : "";
+        if (stream_param == "1" || stream_param == "true") {
+            res.set_header("Cache-Control", "no-cache");
+            res.set_chunked_content_provider(
+                "text/event-stream",
+                [&engine, &stats_tracker, &azure_config, query, k, search_results](size_t, httplib::DataSink& sink) {
+                    auto send = [&](const char* event, const json& data) {
+                        std::string ev = cord19::format_sse_event(event, data.dump());
+                        return sink.write(ev.data(), ev.size());
+                    };
+
+                    auto ai_response = cord19::generate_ai_overview_stream(
+                        azure_config, query, k, search_results, &engine, &stats_tracker, false,
+                        [&](const std::string& piece) {
+                            json delta;
+                            delta["delta"] = piece;
+                            return send("delta", delta);
+                        });
+
+                    json end;
+                    end["query"] = query;
+                    if (ai_response.contains("success") && ai_response["success"] == true) {
+                        end["model"] = ai_response["model"];
+                        end["cached"] = ai_response.value("cached", false);
+                        if (ai_response.contains("usage")) {
+                            end["usage"] = ai_response["usage"];
+                        }
+                        send("done", end);
+                    } else {
+                        end["error"] = ai_response.contains("error") ? ai_response["error"] : "Unknown error";
+                        if (ai_response.contains("details")) {
+                            end["details"] = ai_response["details"];
+                        }
+                        send("error", end);
+                    }
+                    sink.done();
+                    return true;
+                });
+            return;
+        }
+        
         // Generate AI overview using Azure OpenAI with caching
         auto ai_response = cord19::generate_ai_overview(azure_config, query, k, search_results, &engine, &stats_tracker, false);
         
@@ -360,6 +514,9 @@ int main(int argc, char** argv) {
         
         // Get comprehensive stats from tracker
         json stats = stats_tracker.get_stats_json(feedback_manager);
+
+        // Live cache counters since startup (per-policy hit ratios for the search cache)
+        stats["caches"] = engine.cache_stats_json();
         
         res.set_content(stats.dump(2), "application/json");
     });
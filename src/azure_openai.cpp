@@ -0,0 +1,72 @@
+#include "azure_openai.hpp"
+#include "sse.hpp"
+#include "third_party/nlohmann/json.hpp"
+
+namespace cord19 {
+
+using json = nlohmann::json;
+
+static std::string chat_completions_path(const AzureOpenAIConfig& config) {
+    return "/openai/deployments/" + config.model + "/chat/completions?api-version=" + config.api_version;
+}
+
+UpstreamResult azure_chat_completion(const AzureOpenAIConfig& config, const std::string& body) {
+    if (!config.client) {
+        UpstreamResult r;
+        r.error = "upstream client not initialized";
+        return r;
+    }
+    return config.client->post(chat_completions_path(config), {{"api-key", config.api_key}}, body, config.timeout);
+}
+
+UpstreamResult azure_chat_completion_stream(const AzureOpenAIConfig& config, const std::string& body,
+                                            const std::function<bool(const std::string&)>& on_delta) {
+    if (!config.client) {
+        UpstreamResult r;
+        r.error = "upstream client not initialized";
+        return r;
+    }
+
+    SseParser parser;
+    std::string text;
+    json error;
+    bool forwarding = true;
+    UpstreamResult r = config.client->post_stream(
+        chat_completions_path(config), {{"api-key", config.api_key}}, body, config.timeout,
+        [&](const std::string& chunk) {
+            parser.feed(chunk, [&](const std::string&, const std::string& data) {
+                if (data == "[DONE]") return;
+                json ev = json::parse(data, nullptr, /*allow_exceptions*/ false);
+                if (ev.is_discarded()) return;
+                if (ev.contains("error")) {
+                    error = ev["error"];
+                    return;
+                }
+
+                // The first chunks may hold only content filter results
+                if (!ev.contains("choices") || !ev["choices"].is_array() || ev["choices"].empty()) return;
+                const json& choice = ev["choices"][0];
+                if (!choice.contains("delta") || !choice["delta"].contains("content") ||
+                    !choice["delta"]["content"].is_string()) return;
+
+                std::string piece = choice["delta"]["content"].get<std::string>();
+                text += piece;
+                if (forwarding && !piece.empty()) forwarding = on_delta(piece);
+            });
+            return true;
+        });
+    if (!r.ok()) return r;
+
+    json assembled;
+    if (!error.is_null()) {
+        assembled["error"] = error;
+    } else {
+        json choice;
+        choice["message"]["content"] = text;
+        assembled["choices"] = json::array({choice});
+    }
+    r.body = assembled.dump();
+    return r;
+}
+
+} // namespace cord19
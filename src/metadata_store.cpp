@@ -0,0 +1,367 @@
+#include "metadata_store.hpp"
+
+#include <algorithm>
+#include <cstring>
+#include <fstream>
+#include <iostream>
+#include <unordered_set>
+#include <vector>
+
+#include "api_metadata.hpp"
+#include "indexio.hpp"
+
+namespace cord19 {
+
+// Store file layout (native-endian, tables 8-byte aligned):
+//   magic "NSMETA01", u32 version, u32 column count, u64 rows, u64 uid_order offset,
+//   per column: u64 offsets offset, u64 heap offset, u64 heap size
+//   per column: (rows + 1) u64 offsets into its heap, then the heap bytes
+//   rows u32 row ids sorted by cord_uid
+static constexpr char STORE_MAGIC[8] = {'N', 'S', 'M', 'E', 'T', 'A', '0', '1'};
+static constexpr uint32_t STORE_VERSION = 2;
+static constexpr size_t STORE_HEADER_SIZE =
+    8 + 4 + 4 + 8 + 8 + MetadataStore::COLUMN_COUNT * 3 * 8;
+
+// Read a native-endian integer at a byte offset of the mapping
+template <class T>
+static T load_at(const char* base, uint64_t off) {
+    T v;
+    std::memcpy(&v, base + off, sizeof(v));
+    return v;
+}
+
+bool MetadataStore::open(const fs::path& path) {
+    close();
+
+    auto mf = std::make_shared<MappedFile>();
+    if (!mf->open(path)) return false;
+
+    const char* base = mf->data();
+    const uint64_t size = mf->size();
+    if (size < STORE_HEADER_SIZE || std::memcmp(base, STORE_MAGIC, sizeof(STORE_MAGIC)) != 0) {
+        std::cerr << "[metadata] Not a metadata store: " << path.string() << "\n";
+        return false;
+    }
+    if (load_at<uint32_t>(base, 8) != STORE_VERSION || load_at<uint32_t>(base, 12) != COLUMN_COUNT) {
+        std::cerr << "[metadata] Unsupported metadata store version: " << path.string() << "\n";
+        return false;
+    }
+
+    // `count` items of `item` bytes at `off` lie inside the file (no overflow on huge values)
+    auto fits = [size](uint64_t off, uint64_t count, uint64_t item) {
+        return off <= size && count <= (size - off) / item;
+    };
+
+    uint64_t rows = load_at<uint64_t>(base, 16);
+    uint64_t uid_off = load_at<uint64_t>(base, 24);
+    if (rows > UINT32_MAX || uid_off % 4 != 0 || !fits(uid_off, rows, 4)) {
+        std::cerr << "[metadata] Corrupt metadata store header: " << path.string() << "\n";
+        return false;
+    }
+
+    // Validate and bind every column table
+    for (uint32_t c = 0; c < COLUMN_COUNT; c++) {
+        uint64_t offs_off = load_at<uint64_t>(base, 32 + c * 24);
+        uint64_t heap_off = load_at<uint64_t>(base, 32 + c * 24 + 8);
+        uint64_t heap_size = load_at<uint64_t>(base, 32 + c * 24 + 16);
+        if (offs_off % 8 != 0 || !fits(offs_off, rows + 1, 8) || !fits(heap_off, heap_size, 1)) {
+            std::cerr << "[metadata] Corrupt metadata store column table: " << path.string() << "\n";
+            return false;
+        }
+        // Offsets must be non-decreasing and end at the heap size so field() never slices outside it
+        const uint64_t* offs = reinterpret_cast<const uint64_t*>(base + offs_off);
+        bool heap_ok = offs[rows] == heap_size;
+        for (uint64_t r = 0; heap_ok && r < rows; r++) heap_ok = offs[r] <= offs[r + 1];
+        if (!heap_ok) {
+            std::cerr << "[metadata] Corrupt metadata store column heap: " << path.string() << "\n";
+            return false;
+        }
+        offsets_[c] = offs;
+        heaps_[c] = base + heap_off;
+    }
+
+    // Every uid_order entry must name a real row (find() indexes columns with it)
+    const uint32_t* uid_order = reinterpret_cast<const uint32_t*>(base + uid_off);
+    for (uint64_t i = 0; i < rows; i++) {
+        if (uid_order[i] >= rows) {
+            std::cerr << "[metadata] Corrupt metadata store uid order: " << path.string() << "\n";
+            return false;
+        }
+    }
+
+    // FNV-1a over the header and the cord_uid column (which fixes the row of every uid)
+    uint64_t fp = 1469598103934665603ull;
+    auto mix = [&fp](const char* p, size_t n) {
+        for (size_t i = 0; i < n; i++) {
+            fp ^= (unsigned char)p[i];
+            fp *= 1099511628211ull;
+        }
+    };
+    mix(base, STORE_HEADER_SIZE);
+    mix((const char*)offsets_[CordUid], (size_t)(rows + 1) * sizeof(uint64_t));
+    mix(heaps_[CordUid], (size_t)offsets_[CordUid][rows]);
+
+    rows_ = (uint32_t)rows;
+    fingerprint_ = fp;
+    uid_order_ = uid_order;
+    file_ = std::move(mf);
+    return true;
+}
+
+void MetadataStore::close() {
+    file_.reset();
+    rows_ = 0;
+    fingerprint_ = 0;
+    for (uint32_t c = 0; c < COLUMN_COUNT; c++) {
+        offsets_[c] = nullptr;
+        heaps_[c] = nullptr;
+    }
+    uid_order_ = nullptr;
+}
+
+bool MetadataStore::find(std::string_view cord_uid, uint32_t& row) const {
+    if (!valid()) return false;
+    const uint32_t* end = uid_order_ + rows_;
+    const uint32_t* it = std::lower_bound(uid_order_, end, cord_uid,
+        [this](uint32_t r, std::string_view key) { return field(r, CordUid) < key; });
+    if (it == end || field(*it, CordUid) != cord_uid) return false;
+    row = *it;
+    return true;
+}
+
+MetaData MetadataStore::get(uint32_t row) const {
+    MetaData m;
+    m.title = std::string(field(row, Title));
+    m.url = std::string(field(row, Url));
+    m.publish_time = std::string(field(row, PublishTime));
+    m.author = std::string(field(row, Author));
+    m.abstract = std::string(field(row, Abstract));
+    m.journal = std::string(field(row, Journal));
+    m.source = std::string(field(row, Source));
+    return m;
+}
+
+// Doc rows file layout: magic "NSROWS01", u64 store fingerprint, u32 count, count * u32 row
+static constexpr char DOC_ROWS_MAGIC[8] = {'N', 'S', 'R', 'O', 'W', 'S', '0', '1'};
+
+size_t resolve_doc_rows(const MetadataStore& store, Segment& seg) {
+    size_t missing = 0;
+    for (uint32_t i = 0; i < (uint32_t)seg.docs.size(); i++) {
+        uint32_t row;
+        if (store.find(seg.cord_uid(i), row)) {
+            seg.docs[i].meta_row = row;
+        } else {
+            seg.docs[i].meta_row = NO_META_ROW;
+            missing++;
+        }
+    }
+    return missing;
+}
+
+bool write_doc_rows(const fs::path& segdir, const MetadataStore& store, const Segment& seg) {
+    std::ofstream out(doc_rows_path(segdir), std::ios::binary);
+    if (!out) return false;
+    out.write(DOC_ROWS_MAGIC, sizeof(DOC_ROWS_MAGIC));
+    write_u64(out, store.fingerprint());
+    write_u32(out, (uint32_t)seg.docs.size());
+    for (const auto& d : seg.docs) write_u32(out, d.meta_row);
+    return (bool)out;
+}
+
+bool read_doc_rows(const fs::path& segdir, const MetadataStore& store, Segment& seg) {
+    std::ifstream in(doc_rows_path(segdir), std::ios::binary);
+    if (!in) return false;
+
+    char magic[sizeof(DOC_ROWS_MAGIC)] = {};
+    in.read(magic, sizeof(magic));
+    if (!in || std::memcmp(magic, DOC_ROWS_MAGIC, sizeof(magic)) != 0) return false;
+    if (read_u64(in) != store.fingerprint()) return false;
+    if (read_u32(in) != (uint32_t)seg.docs.size() || !in) return false;
+
+    std::vector<uint32_t> rows(seg.docs.size());
+    in.read((char*)rows.data(), (std::streamsize)(rows.size() * sizeof(uint32_t)));
+    if (!in) return false;
+
+    for (size_t i = 0; i < rows.size(); i++) {
+        if (rows[i] != NO_META_ROW && rows[i] >= store.size()) return false;
+    }
+    for (size_t i = 0; i < rows.size(); i++) seg.docs[i].meta_row = rows[i];
+    return true;
+}
+
+// Parse one CSV record starting at p into fields.
+// Handles quoted fields, "" escapes and line breaks inside quotes; returns the start of the next record.
+static const char* parse_csv_record(const char* p, const char* end, std::vector<std::string>& fields) {
+    fields.clear();
+    fields.emplace_back();
+    bool inq = false;
+
+    while (p < end) {
+        char c = *p++;
+        if (inq) {
+            if (c == '"') {
+                if (p < end && *p == '"') {
+                    fields.back().push_back('"');
+                    p++;
+                } else {
+                    inq = false;
+                }
+            } else {
+                fields.back().push_back(c);
+            }
+            continue;
+        }
+
+        if (c == '"') inq = true;
+        else if (c == ',') fields.emplace_back();
+        else if (c == '\n') break;
+        else if (c != '\r') fields.back().push_back(c);
+    }
+    return p;
+}
+
+// Pad the stream with zeros up to a multiple of `align`
+static void pad_to(std::ofstream& out, uint64_t align) {
+    static const char zeros[8] = {};
+    uint64_t pos = (uint64_t)out.tellp();
+    if (pos % align) out.write(zeros, (std::streamsize)(align - pos % align));
+}
+
+bool write_metadata_store(const fs::path& metadata_csv, const fs::path& out_path) {
+    using C = MetadataStore::Column;
+
+    MappedFile in;
+    if (!in.open(metadata_csv)) {
+        std::cerr << "[metadata] FAILED open: " << metadata_csv.string() << "\n";
+        return false;
+    }
+    in.advise_sequential();
+    const char* p = in.data();
+    const char* end = p + in.size();
+
+    // Map store columns to CSV header columns
+    std::vector<std::string> fields;
+    p = parse_csv_record(p, end, fields);
+
+    int src[MetadataStore::COLUMN_COUNT];
+    int authors_i = -1;
+    std::fill(src, src + MetadataStore::COLUMN_COUNT, -1);
+    for (int i = 0; i < (int)fields.size(); i++) {
+        const std::string& name = fields[i];
+        if (name == "cord_uid") src[C::CordUid] = i;
+        else if (name == "title") src[C::Title] = i;
+        else if (name == "url") src[C::Url] = i;
+        else if (name == "publish_time") src[C::PublishTime] = i;
+        else if (name == "authors") authors_i = i;
+        else if (name == "abstract") src[C::Abstract] = i;
+        else if (name == "journal") src[C::Journal] = i;
+        else if (name == "source_x" || name == "source") src[C::Source] = i;
+    }
+    if (src[C::CordUid] < 0) {
+        std::cerr << "[metadata] missing cord_uid column in header\n";
+        return false;
+    }
+
+    // Append each unique row to the column heaps
+    std::string heaps[MetadataStore::COLUMN_COUNT];
+    std::vector<uint64_t> offsets[MetadataStore::COLUMN_COUNT];
+    for (auto& o : offsets) o.push_back(0);
+
+    std::unordered_set<std::string> seen;
+    size_t bad = 0;
+
+    while (p < end) {
+        p = parse_csv_record(p, end, fields);
+        if ((int)fields.size() <= src[C::CordUid]) {
+            if (fields.size() > 1 || !fields[0].empty()) bad++;
+            continue;
+        }
+
+        const std::string& uid = fields[src[C::CordUid]];
+        if (uid.empty() || !seen.insert(uid).second) continue;
+
+        for (uint32_t c = 0; c < MetadataStore::COLUMN_COUNT; c++) {
+            if (c == C::Author) {
+                if (authors_i >= 0 && authors_i < (int)fields.size())
+                    heaps[c] += first_author_et_al(fields[authors_i]);
+            } else if (src[c] >= 0 && src[c] < (int)fields.size()) {
+                heaps[c] += fields[src[c]];
+            }
+            offsets[c].push_back(heaps[c].size());
+        }
+    }
+
+    const uint64_t rows = offsets[0].size() - 1;
+    if (rows > UINT32_MAX) {
+        std::cerr << "[metadata] too many rows for a metadata store\n";
+        return false;
+    }
+
+    // Rows sorted by cord_uid for lookups
+    std::vector<uint32_t> uid_order(rows);
+    for (uint32_t r = 0; r < (uint32_t)rows; r++) uid_order[r] = r;
+    auto uid_of = [&](uint32_t r) {
+        return std::string_view(heaps[C::CordUid]).substr(
+            offsets[C::CordUid][r], offsets[C::CordUid][r + 1] - offsets[C::CordUid][r]);
+    };
+    std::sort(uid_order.begin(), uid_order.end(),
+              [&](uint32_t a, uint32_t b) { return uid_of(a) < uid_of(b); });
+
+    // Write to a temp file and rename, so a running server never maps a partial file
+    fs::path tmp_path = out_path;
+    tmp_path += ".tmp";
+    {
+        std::ofstream out(tmp_path, std::ios::binary);
+        if (!out) {
+            std::cerr << "[metadata] FAILED open for writing: " << tmp_path.string() << "\n";
+            return false;
+        }
+
+        // Header is written twice: once as a placeholder, then with final offsets
+        std::vector<char> placeholder(STORE_HEADER_SIZE, 0);
+        out.write(placeholder.data(), (std::streamsize)placeholder.size());
+
+        uint64_t offs_off[MetadataStore::COLUMN_COUNT], heap_off[MetadataStore::COLUMN_COUNT];
+        for (uint32_t c = 0; c < MetadataStore::COLUMN_COUNT; c++) {
+            pad_to(out, 8);
+            offs_off[c] = (uint64_t)out.tellp();
+            out.write((const char*)offsets[c].data(), (std::streamsize)(offsets[c].size() * sizeof(uint64_t)));
+            heap_off[c] = (uint64_t)out.tellp();
+            out.write(heaps[c].data(), (std::streamsize)heaps[c].size());
+        }
+
+        pad_to(out, 8);
+        uint64_t uid_off = (uint64_t)out.tellp();
+        out.write((const char*)uid_order.data(), (std::streamsize)(uid_order.size() * sizeof(uint32_t)));
+
+        out.seekp(0);
+        out.write(STORE_MAGIC, sizeof(STORE_MAGIC));
+        write_u32(out, STORE_VERSION);
+        write_u32(out, MetadataStore::COLUMN_COUNT);
+        write_u64(out, rows);
+        write_u64(out, uid_off);
+        for (uint32_t c = 0; c < MetadataStore::COLUMN_COUNT; c++) {
+            write_u64(out, offs_off[c]);
+            write_u64(out, heap_off[c]);
+            write_u64(out, (uint64_t)heaps[c].size());
+        }
+
+        if (!out) {
+            std::cerr << "[metadata] FAILED write: " << tmp_path.string() << "\n";
+            return false;
+        }
+    }
+
+    std::error_code ec;
+    fs::rename(tmp_path, out_path, ec);
+    if (ec) {
+        std::cerr << "[metadata] FAILED rename to " << out_path.string() << ": " << ec.message() << "\n";
+        return false;
+    }
+
+    std::cerr << "[metadata] store rows=" << rows << " bad_rows=" << bad
+              << " -> " << out_path.string() << "\n";
+    return true;
+}
+
+} // namespace cord19
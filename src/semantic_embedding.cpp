@@ -1,12 +1,26 @@
 #include "semantic_embedding.hpp"
 
 #include <algorithm>
+#include <atomic>
+#include <charconv>
 #include <cmath>
+#include <cstring>
 #include <fstream>
-#include <sstream>
+#include <iostream>
+
+#include "indexio.hpp"
+#include "mmap_file.hpp"
+#include "parallel.hpp"
 
 namespace cord19 {
 
+// Binary embedding file identification
+static constexpr char SEM_BIN_MAGIC[8] = {'N', 'S', 'E', 'M', 'B', '0', '0', '1'};
+static constexpr uint32_t SEM_BIN_VERSION = 1;
+static constexpr size_t SEM_BIN_HEADER_SIZE = 8 + 4 + 4 + 8 * 5;
+static constexpr size_t SEM_BIN_ALIGN = 64;
+static constexpr uint32_t SEM_BIN_MAX_DIM = 1u << 16;
+
 // Dot product for two vectors
 static inline float dot(const float* a, const float* b, int d) {
     float s = 0.0f;
@@ -23,81 +37,428 @@ void SemanticIndex::l2_normalize(std::vector<float>& v) {
     for (float& x : v) x = (float)(x / n);
 }
 
+// Clear both text-loaded and mapped storage
+void SemanticIndex::reset() {
+    enabled = false;
+    dim = 0;
+    terms.clear();
+    vecs.clear();
+    term_to_row.clear();
+    mapped.reset();
+    mapped_terms = nullptr;
+    mapped_strings = nullptr;
+    mapped_vecs = nullptr;
+    mapped_rows = 0;
+}
+
+// Number of stored vectors
+size_t SemanticIndex::size() const {
+    return mapped ? mapped_rows : terms.size();
+}
+
+// Term stored at a row
+std::string_view SemanticIndex::term_at(uint32_t row) const {
+    if (mapped) {
+        const BinTerm& t = mapped_terms[row];
+        return std::string_view(mapped_strings + t.off, t.len);
+    }
+    return terms[row];
+}
+
+// Pointer to the normalized vector stored at a row
+const float* SemanticIndex::row_vec(uint32_t row) const {
+    const float* base = mapped ? mapped_vecs : vecs.data();
+    return base + (size_t)row * (size_t)dim;
+}
+
+// Find the row of a term (binary search on mapped storage, hash lookup otherwise)
+bool SemanticIndex::find_row(std::string_view term, uint32_t& row) const {
+    if (mapped) {
+        const BinTerm* first = mapped_terms;
+        const BinTerm* last = mapped_terms + mapped_rows;
+        const BinTerm* it = std::lower_bound(first, last, term,
+            [&](const BinTerm& t, std::string_view v) {
+                return std::string_view(mapped_strings + t.off, t.len) < v;
+            });
+        if (it == last || std::string_view(mapped_strings + it->off, it->len) != term) return false;
+        row = (uint32_t)(it - first);
+        return true;
+    }
+
+    auto it = term_to_row.find(std::string(term));
+    if (it == term_to_row.end()) return false;
+    row = it->second;
+    return true;
+}
+
 // Get pointer to stored embedding vector for a term
 const float* SemanticIndex::get_vec_ptr(const std::string& term) const {
-    auto it = term_to_row.find(term);
-    if (it == term_to_row.end()) return nullptr;
-    uint32_t row = it->second;
-    return &vecs[(size_t)row * (size_t)dim];
+    uint32_t row;
+    if (!find_row(term, row)) return nullptr;
+    return row_vec(row);
+}
+
+// Normalize a raw row to unit length
+static void l2_normalize_row(float* v, int d) {
+    double ss = 0.0;
+    for (int i = 0; i < d; ++i) ss += (double)v[i] * (double)v[i];
+    double n = std::sqrt(ss);
+    if (n <= 0.0) return;
+    for (int i = 0; i < d; ++i) v[i] = (float)(v[i] / n);
+}
+
+// Whitespace inside an embedding line
+static inline bool is_blank(char c) {
+    return c == ' ' || c == '\t' || c == '\r';
+}
+
+// Return the next whitespace-delimited token and advance p past it
+static inline std::string_view next_token(const char*& p, const char* e) {
+    while (p < e && is_blank(*p)) ++p;
+    const char* s = p;
+    while (p < e && !is_blank(*p)) ++p;
+    return std::string_view(s, (size_t)(p - s));
+}
+
+// Count whitespace-delimited tokens in [p, e)
+static size_t count_tokens(const char* p, const char* e) {
+    size_t n = 0;
+    while (!next_token(p, e).empty()) n++;
+    return n;
+}
+
+// Parse exactly d floats from [p, e) into out
+static bool parse_floats(const char* p, const char* e, float* out, int d) {
+    for (int i = 0; i < d; ++i) {
+        while (p < e && is_blank(*p)) ++p;
+        auto r = std::from_chars(p, e, out[i]);
+        if (r.ec != std::errc()) return false;
+        p = r.ptr;
+    }
+    while (p < e && is_blank(*p)) ++p;
+    return p == e;
+}
+
+// End of the line starting at p (position of '\n' or e)
+static inline const char* line_end(const char* p, const char* e) {
+    const char* nl = (const char*)std::memchr(p, '\n', (size_t)(e - p));
+    return nl ? nl : e;
+}
+
+// Call fn(line_begin, line_end) for every line in [b, e)
+template <class Fn>
+static void for_each_line(const char* b, const char* e, Fn&& fn) {
+    while (b < e) {
+        const char* le = line_end(b, e);
+        fn(b, le);
+        b = le + 1;
+    }
+}
+
+// Split [b, e) into at most n byte ranges that start at line boundaries
+static std::vector<std::pair<const char*, const char*>> split_at_lines(
+    const char* b, const char* e, size_t n) {
+    std::vector<std::pair<const char*, const char*>> out;
+    const size_t total = (size_t)(e - b);
+    const char* cur = b;
+    for (size_t i = 1; i <= n && cur < e; ++i) {
+        const char* cut = (i == n) ? e : b + total * i / n;
+        if (cut < cur) cut = cur;
+        if (cut < e) cut = std::min(e, line_end(cut, e) + 1);
+        out.push_back({cur, cut});
+        cur = cut;
+    }
+    return out;
+}
+
+// Detect optional header line like "400000 300"
+static bool looks_like_header(const char* b, const char* e) {
+    long long a = 0, d = 0;
+    auto r1 = std::from_chars(b, e, a);
+    if (r1.ec != std::errc() || r1.ptr == e || !is_blank(*r1.ptr)) return false;
+    const char* p = r1.ptr;
+    while (p < e && is_blank(*p)) ++p;
+    auto r2 = std::from_chars(p, e, d);
+    if (r2.ec != std::errc()) return false;
+    p = r2.ptr;
+    while (p < e && is_blank(*p)) ++p;
+    return p == e && a > 0 && d > 0 && d < 5000;
 }
 
-// Load embeddings from text file for selected terms
+// Load embeddings from text file for selected terms.
+//
+// The file is memory-mapped and split into newline-aligned chunks parsed in
+// parallel. The vector size is that of the first wanted line with at least 10
+// values. Pass 1 finds, for each wanted term, the first line holding a valid
+// vector of that size; found terms then get dense row ids (prefix sum), and
+// pass 2 parses those lines with from_chars straight into a matrix of only the
+// found rows. Rows end up sorted by term.
 bool SemanticIndex::load_from_text(const fs::path& path,
                                   const std::unordered_set<std::string>& needed_terms) {
-    enabled = false;
-    dim = 0;
-    terms.clear();
-    vecs.clear();
-    term_to_row.clear();
+    reset();
 
-    // Open embedding file
-    std::ifstream in(path);
-    if (!in.is_open()) return false;
-
-    std::string line;
-    bool first_line = true;
-    size_t loaded = 0;
-
-    // Detect optional header line like "400000 300"
-    auto looks_like_header = [](const std::string& s) -> bool {
-        std::istringstream iss(s);
-        long long a, b;
-        if (!(iss >> a >> b)) return false;
-        std::string extra;
-        if (iss >> extra) return false;
-        return a > 0 && b > 0 && b < 5000;
-    };
+    // Map embedding file
+    MappedFile mf;
+    if (!mf.open(path)) return false;
+    mf.advise_sequential();
 
-    // Parse embedding lines
-    while (std::getline(in, line)) {
-        if (line.empty()) continue;
+    const char* const base = mf.data();
+    const char* const end = base + mf.size();
 
-        // Skip header line if present
-        if (first_line) {
-            first_line = false;
-            if (looks_like_header(line)) continue;
+    // Skip header line if present
+    const char* body = base;
+    {
+        const char* le = line_end(base, end);
+        if (looks_like_header(base, le)) body = std::min(end, le + 1);
+    }
+
+    size_t nthreads = worker_count(mf.size(), 1u << 20);
+    auto chunks = split_at_lines(body, end, nthreads);
+
+    // Sorted list of wanted terms (all words in the file when unfiltered)
+    std::vector<std::string_view> wanted;
+    if (!needed_terms.empty()) {
+        wanted.reserve(needed_terms.size());
+        for (const auto& t : needed_terms) wanted.emplace_back(t);
+    } else {
+        std::vector<std::vector<std::string_view>> words(chunks.size());
+        run_parallel(chunks.size(), [&](size_t c) {
+            for_each_line(chunks[c].first, chunks[c].second, [&](const char* b, const char* e) {
+                std::string_view w = next_token(b, e);
+                if (!w.empty()) words[c].push_back(w);
+            });
+        });
+        for (auto& v : words) wanted.insert(wanted.end(), v.begin(), v.end());
+    }
+    std::sort(wanted.begin(), wanted.end());
+    wanted.erase(std::unique(wanted.begin(), wanted.end()), wanted.end());
+    if (wanted.empty()) return false;
+
+    // Vector size comes from the first wanted line with at least 10 values, so a long
+    // line of an unwanted word cannot fix it (each chunk stops at its first such line)
+    std::vector<int> chunk_dim(chunks.size(), 0);
+    run_parallel(chunks.size(), [&](size_t c) {
+        const char* ce = chunks[c].second;
+        for (const char* b = chunks[c].first; b < ce && chunk_dim[c] == 0;) {
+            const char* le = line_end(b, ce);
+            const char* p = b;
+            std::string_view w = next_token(p, le);
+            if (!w.empty() && std::binary_search(wanted.begin(), wanted.end(), w)) {
+                size_t nvals = count_tokens(p, le);
+                if (nvals >= 10) chunk_dim[c] = (int)nvals;
+            }
+            b = le + 1;
         }
+    });
+    for (int cd : chunk_dim) {
+        if (cd > 0) {
+            dim = cd;
+            break;
+        }
+    }
+    if (dim == 0) return false;
+
+    // Pass 1: each wanted term keeps the earliest line offset with `dim` parseable values
+    // (a malformed line is skipped, so a later line for the same term can still win)
+    constexpr uint64_t NO_LINE = UINT64_MAX;
+    const size_t d = (size_t)dim;
+    std::unique_ptr<std::atomic<uint64_t>[]> first_line(new std::atomic<uint64_t>[wanted.size()]);
+    for (size_t r = 0; r < wanted.size(); ++r) first_line[r].store(NO_LINE, std::memory_order_relaxed);
+
+    run_parallel(chunks.size(), [&](size_t c) {
+        std::vector<float> scratch(d);
+        for_each_line(chunks[c].first, chunks[c].second, [&](const char* b, const char* e) {
+            const char* p = b;
+            std::string_view w = next_token(p, e);
+            if (w.empty()) return;
+
+            auto it = std::lower_bound(wanted.begin(), wanted.end(), w);
+            if (it == wanted.end() || *it != w) return;
+
+            auto& slot = first_line[(size_t)(it - wanted.begin())];
+            uint64_t off = (uint64_t)(b - base);
+            uint64_t cur = slot.load(std::memory_order_relaxed);
+            if (off >= cur || !parse_floats(p, e, scratch.data(), dim)) return;
+            while (off < cur && !slot.compare_exchange_weak(cur, off, std::memory_order_relaxed)) {}
+        });
+    });
+
+    // Dense row ids of the found terms
+    std::vector<uint32_t> row_of(wanted.size());
+    size_t found = 0;
+    for (size_t r = 0; r < wanted.size(); ++r) {
+        row_of[r] = (uint32_t)found;
+        if (first_line[r].load(std::memory_order_relaxed) != NO_LINE) found++;
+    }
+    if (found == 0) return false;
+
+    terms.reserve(found);
+    term_to_row.reserve(found);
+    for (size_t r = 0; r < wanted.size(); ++r) {
+        if (first_line[r].load(std::memory_order_relaxed) == NO_LINE) continue;
+        terms.emplace_back(wanted[r]);
+        term_to_row.emplace(terms.back(), row_of[r]);
+    }
 
-        std::istringstream iss(line);
-        std::string word;
-        if (!(iss >> word)) continue;
+    // Pass 2: parse claimed lines into their rows, split by term range
+    vecs.assign(found * d, 0.0f);
+    run_parallel(nthreads, [&](size_t t) {
+        size_t r0 = wanted.size() * t / nthreads;
+        size_t r1 = wanted.size() * (t + 1) / nthreads;
+        for (size_t r = r0; r < r1; ++r) {
+            uint64_t off = first_line[r].load(std::memory_order_relaxed);
+            if (off == NO_LINE) continue;
+
+            const char* p = base + off;
+            const char* e = line_end(p, end);
+            next_token(p, e); // skip word
+
+            // Validated in pass 1, so this parse succeeds
+            float* row = &vecs[(size_t)row_of[r] * d];
+            parse_floats(p, e, row, dim);
+            l2_normalize_row(row, dim);
+        }
+    });
 
-        // Filter to needed terms only
-        if (!needed_terms.empty() && needed_terms.find(word) == needed_terms.end()) {
-            continue;
+    enabled = true;
+    return enabled;
+}
+
+// Memory-map a binary embedding file produced by save_binary
+bool SemanticIndex::load_binary(const fs::path& path) {
+    reset();
+
+    auto mf = std::make_shared<MappedFile>();
+    if (!mf->open(path)) return false;
+
+    const char* base = mf->data();
+    const size_t size = mf->size();
+    if (size < SEM_BIN_HEADER_SIZE || std::memcmp(base, SEM_BIN_MAGIC, sizeof(SEM_BIN_MAGIC)) != 0) {
+        std::cerr << "[semantic] not a binary embedding file: " << path.string() << "\n";
+        return false;
+    }
+
+    // Read header fields (copied out to avoid unaligned access)
+    auto rd32 = [&](size_t off) { uint32_t v; std::memcpy(&v, base + off, sizeof(v)); return v; };
+    auto rd64 = [&](size_t off) { uint64_t v; std::memcpy(&v, base + off, sizeof(v)); return v; };
+
+    uint32_t version      = rd32(8);
+    uint32_t d            = rd32(12);
+    uint64_t rows         = rd64(16);
+    uint64_t terms_off    = rd64(24);
+    uint64_t strings_off  = rd64(32);
+    uint64_t strings_size = rd64(40);
+    uint64_t vecs_off     = rd64(48);
+
+    // `count` items of `item` bytes at `off` lie inside the file (no overflow on huge values)
+    auto fits = [&](uint64_t off, uint64_t count, uint64_t item) {
+        return off <= size && count <= (size - off) / item;
+    };
+
+    // Validate layout against the file size
+    bool ok = version == SEM_BIN_VERSION && d > 0 && d <= SEM_BIN_MAX_DIM && rows > 0 && rows <= UINT32_MAX &&
+              terms_off % alignof(BinTerm) == 0 && vecs_off % SEM_BIN_ALIGN == 0 &&
+              fits(terms_off, rows, sizeof(BinTerm)) &&
+              fits(strings_off, strings_size, 1) &&
+              fits(vecs_off, rows, (uint64_t)d * sizeof(float));
+    if (!ok) {
+        std::cerr << "[semantic] corrupt binary embedding file: " << path.string() << "\n";
+        return false;
+    }
+
+    // Every term must lie in the string heap, in strictly ascending order (find_row binary searches)
+    const BinTerm* bin_terms = (const BinTerm*)(base + terms_off);
+    const char* strings = base + strings_off;
+    std::string_view prev;
+    for (uint64_t r = 0; r < rows; r++) {
+        const BinTerm& t = bin_terms[r];
+        if (t.off > strings_size || t.len > strings_size - t.off) {
+            std::cerr << "[semantic] corrupt term table in binary embedding file: " << path.string() << "\n";
+            return false;
+        }
+        std::string_view term(strings + t.off, t.len);
+        if (r > 0 && !(prev < term)) {
+            std::cerr << "[semantic] unsorted term table in binary embedding file: " << path.string() << "\n";
+            return false;
         }
+        prev = term;
+    }
 
-        // Read vector values
-        std::vector<float> v;
-        float x;
-        while (iss >> x) v.push_back(x);
+    dim = (int)d;
+    mapped_rows = (size_t)rows;
+    mapped_terms = bin_terms;
+    mapped_strings = strings;
+    mapped_vecs = (const float*)(base + vecs_off);
+    mapped = std::move(mf);
 
-        if (v.size() < 10) continue;
-        if (dim == 0) dim = (int)v.size();
-        if ((int)v.size() != dim) continue;
+    enabled = true;
+    return true;
+}
 
-        // Store normalized vector
-        l2_normalize(v);
+// Write loaded vectors to a binary embedding file (rows sorted by term)
+bool SemanticIndex::save_binary(const fs::path& path) const {
+    if (!enabled || dim <= 0) return false;
 
-        uint32_t row = (uint32_t)terms.size();
-        terms.push_back(word);
-        term_to_row.emplace(word, row);
-        vecs.insert(vecs.end(), v.begin(), v.end());
-        loaded++;
+    // Order unique rows by term so the loader can binary search
+    std::vector<uint32_t> order;
+    order.reserve(size());
+    for (uint32_t r = 0; r < (uint32_t)size(); r++) {
+        uint32_t first;
+        if (find_row(term_at(r), first) && first == r) order.push_back(r);
     }
+    std::sort(order.begin(), order.end(),
+              [&](uint32_t a, uint32_t b) { return term_at(a) < term_at(b); });
+
+    const uint64_t rows = order.size();
+    uint64_t strings_size = 0;
+    for (uint32_t r : order) strings_size += term_at(r).size();
+
+    auto align_up = [](uint64_t v, uint64_t a) { return (v + a - 1) / a * a; };
+    const uint64_t terms_off = align_up(SEM_BIN_HEADER_SIZE, alignof(BinTerm));
+    const uint64_t strings_off = terms_off + rows * sizeof(BinTerm);
+    const uint64_t vecs_off = align_up(strings_off + strings_size, SEM_BIN_ALIGN);
+
+    std::ofstream out(path, std::ios::binary);
+    if (!out) return false;
+
+    // Header
+    out.write(SEM_BIN_MAGIC, sizeof(SEM_BIN_MAGIC));
+    write_u32(out, SEM_BIN_VERSION);
+    write_u32(out, (uint32_t)dim);
+    write_u64(out, rows);
+    write_u64(out, terms_off);
+    write_u64(out, strings_off);
+    write_u64(out, strings_size);
+    write_u64(out, vecs_off);
+
+    auto pad_to = [&](uint64_t off) {
+        uint64_t pos = (uint64_t)out.tellp();
+        if (pos < off) out.write(std::string((size_t)(off - pos), '\0').data(), (std::streamsize)(off - pos));
+    };
 
-    enabled = (loaded > 0 && dim > 0);
-    return enabled;
+    // Term table
+    pad_to(terms_off);
+    uint32_t soff = 0;
+    for (uint32_t r : order) {
+        uint32_t len = (uint32_t)term_at(r).size();
+        write_u32(out, soff);
+        write_u32(out, len);
+        soff += len;
+    }
+
+    // String heap
+    for (uint32_t r : order) {
+        std::string_view t = term_at(r);
+        out.write(t.data(), (std::streamsize)t.size());
+    }
+
+    // Vector matrix
+    pad_to(vecs_off);
+    for (uint32_t r : order) {
+        out.write((const char*)row_vec(r), (std::streamsize)((size_t)dim * sizeof(float)));
+    }
+
+    return (bool)out;
 }
 
 // Find most similar stored vectors to a query vector
@@ -116,12 +477,12 @@ std::vector<std::pair<uint32_t, float>> SemanticIndex::most_similar_to_vec(
     heap.reserve((size_t)topk);
 
     // Scan all rows and keep best matches
-    const size_t nrows = terms.size();
+    const size_t nrows = size();
     for (size_t r = 0; r < nrows; ++r) {
         uint32_t row = (uint32_t)r;
         if (banned_rows && banned_rows->find(row) != banned_rows->end()) continue;
 
-        const float* v = &vecs[r * (size_t)dim];
+        const float* v = row_vec(row);
         float sim = dot(qvec, v, dim);
         if (sim < min_sim) continue;
 
@@ -172,8 +533,8 @@ std::vector<std::pair<std::string, float>> SemanticIndex::expand(
     std::unordered_set<uint32_t> banned;
     banned.reserve(query_terms.size() * 2);
     for (const auto& t : query_terms) {
-        auto it = term_to_row.find(t);
-        if (it != term_to_row.end()) banned.insert(it->second);
+        uint32_t row;
+        if (find_row(t, row)) banned.insert(row);
     }
 
     // Per-term neighbor expansion
@@ -183,7 +544,7 @@ std::vector<std::pair<std::string, float>> SemanticIndex::expand(
 
         auto nn = most_similar_to_vec(v, per_term, min_sim, &banned);
         for (auto& [row, sim] : nn) {
-            const std::string& cand = terms[row];
+            std::string cand(term_at(row));
             float weight = std::max(0.0f, std::min(alpha, alpha * sim));
             auto it = w.find(cand);
             if (it == w.end() || weight > it->second) w[cand] = weight;
@@ -208,7 +569,7 @@ std::vector<std::pair<std::string, float>> SemanticIndex::expand(
 
             auto nn = most_similar_to_vec(q.data(), global_topk, min_sim, &banned);
             for (auto& [row, sim] : nn) {
-                const std::string& cand = terms[row];
+                std::string cand(term_at(row));
                 float weight = std::max(0.0f, std::min(alpha * 0.8f, alpha * 0.8f * sim));
                 auto it = w.find(cand);
                 if (it == w.end() || weight > it->second) w[cand] = weight;
@@ -0,0 +1,184 @@
+#include "upstream_client.hpp"
+
+#include <algorithm>
+#include <iostream>
+
+#include "third_party/httplib.h"
+
+namespace cord19 {
+
+// Split a duration into the (seconds, microseconds) pair httplib timeouts take
+template <class Fn>
+static void set_timeout(Fn&& set, std::chrono::microseconds d) {
+    auto us = std::max<int64_t>(1, (int64_t)d.count());
+    set((time_t)(us / 1000000), (time_t)(us % 1000000));
+}
+
+std::string UpstreamClient::normalize_base_url(std::string url) {
+    while (!url.empty() && (url.back() == '/' || url.back() == ' ')) url.pop_back();
+    if (url.find("://") == std::string::npos) url = "https://" + url;
+    return url;
+}
+
+UpstreamClient::UpstreamClient(const std::string& base_url, const Options& opt)
+    : base_url_(normalize_base_url(base_url)), opt_(opt), queue_(opt.queue_capacity) {
+    size_t n = std::max<size_t>(1, opt_.connections);
+    workers_.reserve(n);
+    for (size_t i = 0; i < n; i++) workers_.emplace_back([this] { worker_loop(); });
+    std::cerr << "[upstream] " << base_url_ << ": " << n << " connections, queue " << opt_.queue_capacity << "\n";
+}
+
+UpstreamClient::~UpstreamClient() {
+    stopping_ = true;
+    queue_.close();
+    for (auto& t : workers_) t.join();
+}
+
+std::future<UpstreamResult> UpstreamClient::post_async(const std::string& path, Headers headers, std::string body,
+                                                       Clock::time_point deadline) {
+    auto call = std::make_shared<Call>();
+    call->path = path;
+    call->headers = std::move(headers);
+    call->body = std::move(body);
+    call->deadline = deadline;
+    return enqueue(std::move(call));
+}
+
+UpstreamResult UpstreamClient::post(const std::string& path, Headers headers, std::string body,
+                                    std::chrono::milliseconds timeout) {
+    Clock::time_point deadline = Clock::now() + timeout;
+    auto f = post_async(path, std::move(headers), std::move(body), deadline);
+    if (f.wait_until(deadline) != std::future_status::ready) {
+        UpstreamResult r;
+        r.error = "deadline exceeded";
+        return r;
+    }
+    return f.get();
+}
+
+UpstreamResult UpstreamClient::post_stream(const std::string& path, Headers headers, std::string body,
+                                           std::chrono::milliseconds timeout,
+                                           const std::function<bool(const std::string&)>& on_data) {
+    auto call = std::make_shared<Call>();
+    call->path = path;
+    call->headers = std::move(headers);
+    call->body = std::move(body);
+    Clock::time_point deadline = Clock::now() + timeout;
+    call->deadline = deadline;
+    call->chunks = std::make_shared<BoundedQueue<std::string>>(STREAM_QUEUE_CHUNKS);
+    auto chunks = call->chunks;
+    auto f = enqueue(std::move(call));
+
+    // The worker closes the queue when the call ends; closing it here cancels the call
+    using Chunks = BoundedQueue<std::string>;
+    std::string chunk;
+    Chunks::PopResult got;
+    while ((got = chunks->pop_until(chunk, deadline)) == Chunks::PopResult::Item) {
+        if (!on_data(chunk)) {
+            chunks->close();
+            break;
+        }
+    }
+
+    // Stop waiting at the deadline even if the call is still queued or its worker is stuck reading
+    if (got == Chunks::PopResult::Timeout || f.wait_until(deadline) != std::future_status::ready) {
+        chunks->close();
+        UpstreamResult r;
+        r.error = "deadline exceeded";
+        return r;
+    }
+    return f.get();
+}
+
+std::future<UpstreamResult> UpstreamClient::enqueue(std::shared_ptr<Call> call) {
+    std::future<UpstreamResult> f = call->done.get_future();
+
+    // Fail at once rather than block the caller behind a backlog
+    if (!queue_.try_push(call)) {
+        UpstreamResult r;
+        r.error = stopping_ ? "upstream client stopped" : "upstream queue full";
+        std::cerr << "[upstream] " << r.error << ", rejected POST " << call->path << "\n";
+        finish(*call, std::move(r));
+    }
+    return f;
+}
+
+// Hand the result to the caller (a streamed call's chunk queue is closed first)
+void UpstreamClient::finish(Call& call, UpstreamResult r) {
+    if (call.chunks) call.chunks->close();
+    call.done.set_value(std::move(r));
+}
+
+// One worker: runs queued calls in order on its own keep-alive connection
+void UpstreamClient::worker_loop() {
+    httplib::Client cli(base_url_);
+    cli.set_keep_alive(true);
+    set_timeout([&](time_t s, time_t us) { cli.set_connection_timeout(s, us); },
+                std::chrono::duration_cast<std::chrono::microseconds>(opt_.connect_timeout));
+
+    std::shared_ptr<Call> call;
+    while (queue_.pop(call)) {
+        UpstreamResult r;
+        auto left = std::chrono::duration_cast<std::chrono::microseconds>(call->deadline - Clock::now());
+
+        if (stopping_) {
+            r.error = "upstream client stopped";
+        } else if (!cli.is_valid()) {
+            r.error = "invalid upstream url: " + base_url_;
+        } else if (left.count() <= 0) {
+            r.error = "deadline exceeded while queued";
+        } else {
+            // The call may not outlive its deadline
+            set_timeout([&](time_t s, time_t us) { cli.set_read_timeout(s, us); }, left);
+            set_timeout([&](time_t s, time_t us) { cli.set_write_timeout(s, us); }, left);
+
+            httplib::Headers headers;
+            for (const auto& h : call->headers) headers.emplace(h.first, h.second);
+
+            httplib::Result res;
+            if (call->chunks) {
+                // Stream a 200 body to the caller; keep any other body for the error
+                httplib::Request req;
+                req.method = "POST";
+                req.path = call->path;
+                req.headers = headers;
+                req.body = call->body;
+                req.set_header("Content-Type", "application/json");
+                req.response_handler = [&](const httplib::Response& head) {
+                    r.status = head.status;
+                    return true;
+                };
+                req.content_receiver = [&](const char* data, size_t n, uint64_t, uint64_t) {
+                    if (Clock::now() > call->deadline) {
+                        r.error = "deadline exceeded while streaming";
+                        return false;
+                    }
+                    if (!r.ok()) {
+                        r.body.append(data, n);
+                        return true;
+                    }
+                    if (call->chunks->push(std::string(data, n))) return true;
+                    r.error = "canceled by caller";
+                    return false;
+                };
+                res = cli.send(req);
+            } else {
+                res = cli.Post(call->path, headers, call->body, "application/json");
+                if (res) r.body = res->body;
+            }
+
+            if (res) {
+                r.status = res->status;
+                if (!r.ok()) r.error = "HTTP " + std::to_string(r.status);
+            } else if (r.error.empty()) {
+                r.error = httplib::to_string(res.error());
+            }
+        }
+
+        if (!r.error.empty()) std::cerr << "[upstream] POST " << call->path << " failed: " << r.error << "\n";
+        finish(*call, std::move(r));
+        call.reset();
+    }
+}
+
+} // namespace cord19
@@ -0,0 +1,55 @@
+#include <filesystem>
+#include <iostream>
+#include <string>
+
+#include "cordjson.hpp"
+
+// Scanner output on CORD-19 shaped JSON (title under metadata.title)
+
+static int failures = 0;
+
+static void check(bool ok, const char* what) {
+    if (ok) return;
+    std::cerr << "[cordjson_test] FAILED: " << what << "\n";
+    failures++;
+}
+
+int main(int argc, char** argv) {
+    fs::path data_dir = argc > 1 ? fs::path(argv[1]) : fs::path("tests/data");
+    std::string raw = read_file_all(data_dir / "cord19_pdf_json.json");
+    if (raw.empty()) {
+        std::cerr << "[cordjson_test] missing fixture in " << data_dir.string() << "\n";
+        return 1;
+    }
+
+    // Title comes from metadata.title, not from bib_entries or ref_entries
+    CordFields f;
+    check(extract_fields_from_cord_raw(raw, f), "fixture parses");
+    check(f.title == "The RNA pseudoknots in foot-and-mouth disease virus are dispensable for genome replication\n",
+          "title from metadata.title");
+    check(f.abstract == "Pseudoknots are conserved structures in the 5′ untranslated region.\n", "abstract text");
+    check(f.body == "Foot-and-mouth disease virus replicates in the cytoplasm [1].\n"
+                    "Replicons lacking all pseudoknots still replicated.\n",
+          "body text");
+
+    // Same text as the DOM extractor
+    std::string text;
+    check(extract_text_from_cord_raw(raw, text), "raw extract");
+    check(text == extract_text_from_cord_json(json::parse(raw)), "raw text matches DOM text");
+
+    // A top-level title wins over metadata.title
+    std::string both = R"({"metadata": {"title": "inner"}, "title": "outer", "body_text": []})";
+    check(extract_fields_from_cord_raw(both, f) && f.title == "outer\n", "top-level title wins");
+    check(extract_text_from_cord_json(json::parse(both)) == "outer\n", "DOM top-level title wins");
+
+    // Non-string metadata.title is no title; a later metadata object replaces an earlier one
+    std::string odd = R"({"metadata": {"title": "first"}, "metadata": {"title": null}})";
+    check(extract_fields_from_cord_raw(odd, f) && f.title.empty(), "null metadata.title");
+    check(extract_text_from_cord_json(json::parse(odd)).empty(), "DOM null metadata.title");
+
+    // Malformed metadata is rejected like json::parse
+    check(!extract_fields_from_cord_raw(R"({"metadata": {"title": "x",}})", f), "trailing comma rejected");
+
+    if (failures == 0) std::cout << "[cordjson_test] ok\n";
+    return failures == 0 ? 0 : 1;
+}
@@ -0,0 +1,98 @@
+#include <chrono>
+#include <future>
+#include <iostream>
+#include <string>
+#include <thread>
+
+#include "upstream_client.hpp"
+#include "third_party/httplib.h"
+
+// UpstreamClient against a local stub server: POST /slow sleeps for the
+// number of milliseconds in the request body, then echoes the body.
+
+using namespace cord19;
+using Clock = std::chrono::steady_clock;
+
+static int failures = 0;
+
+static void check(bool ok, const char* what) {
+    if (ok) return;
+    std::cerr << "[upstream_client_test] FAILED: " << what << "\n";
+    failures++;
+}
+
+static long long ms_since(Clock::time_point t0) {
+    return (long long)std::chrono::duration_cast<std::chrono::milliseconds>(Clock::now() - t0).count();
+}
+
+// Wait until the client's workers have taken every queued call
+static void wait_dequeued(const UpstreamClient& client) {
+    auto until = Clock::now() + std::chrono::seconds(2);
+    while (client.queued() > 0 && Clock::now() < until) std::this_thread::sleep_for(std::chrono::milliseconds(1));
+}
+
+int main() {
+    httplib::Server svr;
+    svr.Post("/slow", [](const httplib::Request& req, httplib::Response& res) {
+        std::this_thread::sleep_for(std::chrono::milliseconds(std::stoi(req.body)));
+        res.set_content(req.body, "text/plain");
+    });
+    int port = svr.bind_to_any_port("127.0.0.1");
+    if (port <= 0) {
+        std::cerr << "[upstream_client_test] failed to bind a local port\n";
+        return 1;
+    }
+    std::thread server([&] { svr.listen_after_bind(); });
+    while (!svr.is_running()) std::this_thread::sleep_for(std::chrono::milliseconds(1));
+    const std::string url = "http://127.0.0.1:" + std::to_string(port);
+
+    {
+        UpstreamClient::Options opt;
+        opt.connections = 1;
+        opt.queue_capacity = 1;
+        UpstreamClient client(url, opt);
+
+        // A fast call succeeds
+        UpstreamResult r = client.post("/slow", {}, "0", std::chrono::milliseconds(2000));
+        check(r.ok() && r.body == "0", "fast call returns the stub's response");
+
+        // A call slower than its deadline fails close to the deadline
+        auto t0 = Clock::now();
+        r = client.post("/slow", {}, "1500", std::chrono::milliseconds(200));
+        long long took = ms_since(t0);
+        check(!r.ok() && !r.error.empty(), "slow call fails at its deadline");
+        check(took < 1000, "caller stops waiting once the deadline passes");
+
+        // The worker is free again once the timed-out call has been cut off
+        r = client.post("/slow", {}, "0", std::chrono::milliseconds(2000));
+        check(r.ok(), "connection is usable after a timeout");
+
+        // One call in progress and one queued: the next call is rejected at once
+        auto deadline = Clock::now() + std::chrono::seconds(5);
+        auto busy = client.post_async("/slow", {}, "300", deadline);
+        wait_dequeued(client);
+        auto queued = client.post_async("/slow", {}, "0", deadline);
+        t0 = Clock::now();
+        auto rejected = client.post_async("/slow", {}, "0", deadline);
+        check(rejected.wait_for(std::chrono::seconds(0)) == std::future_status::ready, "full queue fails at once");
+        r = rejected.get();
+        check(!r.ok() && r.error == "upstream queue full", "full queue reports queue full");
+        check(ms_since(t0) < 100, "rejected call does not block");
+        check(busy.get().ok(), "call in progress completes");
+        check(queued.get().ok(), "queued call completes");
+
+        // A queued call whose deadline passes before a connection frees up is not sent
+        busy = client.post_async("/slow", {}, "300", Clock::now() + std::chrono::seconds(5));
+        wait_dequeued(client);
+        auto expired = client.post_async("/slow", {}, "0", Clock::now() + std::chrono::milliseconds(50));
+        r = expired.get();
+        check(!r.ok() && r.error == "deadline exceeded while queued", "expired queued call fails");
+        check(busy.get().ok(), "call ahead of the expired one completes");
+    }
+
+    svr.stop();
+    server.join();
+
+    if (failures == 0) std::cout << "[upstream_client_test] ok\n";
+    return failures == 0 ? 0 : 1;
+}
@@ -0,0 +1,206 @@
+#include <chrono>
+#include <future>
+#include <iostream>
+#include <string>
+#include <thread>
+#include <vector>
+
+#include "azure_openai.hpp"
+#include "sse.hpp"
+#include "upstream_client.hpp"
+#include "third_party/httplib.h"
+#include "third_party/nlohmann/json.hpp"
+
+// Streamed upstream calls against a local stub server that answers chat
+// completions with a chunked text/event-stream body picked by deployment name:
+//   deltas  chat completion deltas, with events split mid-line across chunks
+//   error   one delta, then an error event
+//   stall   one event, then nothing for STALL_MS before the stream ends
+//   many    EVENT_COUNT events spaced a few milliseconds apart
+
+using namespace cord19;
+using json = nlohmann::json;
+using Clock = std::chrono::steady_clock;
+
+static constexpr int STALL_MS = 1500;
+static constexpr int EVENT_COUNT = 50;
+
+static int failures = 0;
+
+static void check(bool ok, const char* what) {
+    if (ok) return;
+    std::cerr << "[upstream_stream_test] FAILED: " << what << "\n";
+    failures++;
+}
+
+static long long ms_since(Clock::time_point t0) {
+    return (long long)std::chrono::duration_cast<std::chrono::milliseconds>(Clock::now() - t0).count();
+}
+
+static std::string delta_event(const std::string& content) {
+    json ev;
+    ev["choices"] = json::array({{{"delta", {{"content", content}}}}});
+    return "data: " + ev.dump() + "\n\n";
+}
+
+// Serve `pieces` as the chunks of a text/event-stream body, sleeping `gap` between them
+static void serve_chunks(httplib::Response& res, std::vector<std::string> pieces, std::chrono::milliseconds gap) {
+    res.set_chunked_content_provider("text/event-stream", [pieces, gap](size_t, httplib::DataSink& sink) {
+        for (const auto& p : pieces) {
+            if (!sink.write(p.data(), p.size())) return false;
+            std::this_thread::sleep_for(gap);
+        }
+        sink.done();
+        return true;
+    });
+}
+
+static void test_sse_parser() {
+    std::vector<std::pair<std::string, std::string>> events;
+    auto on_event = [&](const std::string& ev, const std::string& data) { events.emplace_back(ev, data); };
+
+    SseParser parser;
+    const std::string stream =
+        ": keep-alive comment\r\n"
+        "data: one\r\n\r\n"
+        "event: progress\n"
+        "data: line 1\n"
+        "data: line 2\n"
+        "id: 7\n\n"
+        "data:no-space\n\n"
+        "event: empty\n\n";
+    // Fed one byte at a time, every line is split across pieces
+    for (char c : stream) parser.feed(std::string_view(&c, 1), on_event);
+
+    check(events.size() == 3, "parser emits one event per blank line with data");
+    if (events.size() == 3) {
+        check(events[0].first.empty() && events[0].second == "one", "CRLF lines and comments are handled");
+        check(events[1].first == "progress" && events[1].second == "line 1\nline 2",
+              "event name is kept and multi-line data is joined with newlines");
+        check(events[2].second == "no-space", "data without a space after the colon");
+    }
+
+    // An unfinished event is held until its blank line arrives
+    events.clear();
+    parser.feed("data: part", on_event);
+    check(events.empty(), "incomplete event is not dispatched");
+    parser.feed("ial\n\n", on_event);
+    check(events.size() == 1 && events[0].second == "partial", "event completes across feeds");
+}
+
+// Wait until the client's workers have taken every queued call
+static void wait_dequeued(const UpstreamClient& client) {
+    auto until = Clock::now() + std::chrono::seconds(2);
+    while (client.queued() > 0 && Clock::now() < until) std::this_thread::sleep_for(std::chrono::milliseconds(1));
+}
+
+int main() {
+    test_sse_parser();
+
+    // The deployment name in the chat completions path picks the stub's stream
+    httplib::Server svr;
+    svr.Post(R"(/openai/deployments/(\w+)/chat/completions)", [](const httplib::Request& req, httplib::Response& res) {
+        const std::string route = req.matches[1];
+        if (route == "deltas") {
+            std::string body = ": opening comment\n\n" + delta_event("Hel") + delta_event("lo") +
+                               "data: {\"choices\":[]}\n\n" + delta_event(" world") + "data: [DONE]\n\n";
+            // Cut the body into chunks that end mid-line
+            std::vector<std::string> pieces;
+            for (size_t i = 0; i < body.size(); i += 7) pieces.push_back(body.substr(i, 7));
+            serve_chunks(res, std::move(pieces), std::chrono::milliseconds(1));
+        } else if (route == "error") {
+            serve_chunks(res, {delta_event("partial"), "data: {\"error\":{\"code\":\"429\",\"message\":\"rate limited\"}}\n\n"},
+                         std::chrono::milliseconds(0));
+        } else if (route == "stall") {
+            serve_chunks(res, {delta_event("first")}, std::chrono::milliseconds(STALL_MS));
+        } else {
+            std::vector<std::string> pieces;
+            for (int i = 0; i < EVENT_COUNT; i++) pieces.push_back(delta_event(std::to_string(i) + " "));
+            serve_chunks(res, std::move(pieces), std::chrono::milliseconds(5));
+        }
+    });
+    int port = svr.bind_to_any_port("127.0.0.1");
+    if (port <= 0) {
+        std::cerr << "[upstream_stream_test] failed to bind a local port\n";
+        return 1;
+    }
+    std::thread server([&] { svr.listen_after_bind(); });
+    while (!svr.is_running()) std::this_thread::sleep_for(std::chrono::milliseconds(1));
+    const std::string url = "http://127.0.0.1:" + std::to_string(port);
+
+    UpstreamClient::Options opt;
+    opt.connections = 1;
+    AzureOpenAIConfig config;
+    config.timeout = std::chrono::milliseconds(3000);
+    config.client = std::make_shared<UpstreamClient>(url, opt);
+
+    std::vector<std::string> deltas;
+    auto collect = [&](const std::string& d) {
+        deltas.push_back(d);
+        return true;
+    };
+
+    // Deltas reach the caller in order and are reassembled into a chat completion
+    config.model = "deltas";
+    UpstreamResult r = azure_chat_completion_stream(config, "{}", collect);
+    check(r.ok(), "streamed completion succeeds");
+    check(deltas == std::vector<std::string>({"Hel", "lo", " world"}), "deltas are delivered in order");
+    json body = json::parse(r.body, nullptr, false);
+    check(!body.is_discarded() && body["choices"][0]["message"]["content"] == "Hello world",
+          "body is reassembled into a chat completion");
+
+    // A mid-stream error event becomes the body's error
+    deltas.clear();
+    config.model = "error";
+    r = azure_chat_completion_stream(config, "{}", collect);
+    check(r.ok() && deltas == std::vector<std::string>({"partial"}), "deltas before the error are delivered");
+    body = json::parse(r.body, nullptr, false);
+    check(!body.is_discarded() && body.contains("error") && !body.contains("choices") &&
+          body["error"]["message"] == "rate limited", "error event is mapped to the body's error");
+
+    // A stream that stalls past the deadline releases the caller close to the deadline
+    deltas.clear();
+    config.model = "stall";
+    config.timeout = std::chrono::milliseconds(200);
+    auto t0 = Clock::now();
+    r = azure_chat_completion_stream(config, "{}", collect);
+    check(!r.ok() && r.error == "deadline exceeded", "stalled stream fails at its deadline");
+    check(ms_since(t0) < 1000, "caller stops waiting on a stalled stream");
+    check(deltas == std::vector<std::string>({"first"}), "deltas before the stall are delivered");
+
+    // A streamed call queued behind a long stream still returns at its deadline
+    const std::string stall_path = "/openai/deployments/stall/chat/completions";
+    const std::string many_path = "/openai/deployments/many/chat/completions";
+    auto busy = std::async(std::launch::async, [&] {
+        return config.client->post_stream(stall_path, {}, "{}", std::chrono::milliseconds(5000),
+                                          [](const std::string&) { return true; });
+    });
+    wait_dequeued(*config.client);
+    t0 = Clock::now();
+    r = config.client->post_stream(many_path, {}, "{}", std::chrono::milliseconds(200),
+                                   [](const std::string&) { return true; });
+    check(!r.ok() && r.error == "deadline exceeded", "queued stream fails at its deadline");
+    check(ms_since(t0) < 1000, "caller of a queued stream stops waiting at the deadline");
+    check(busy.get().ok(), "stream ahead of the expired one completes");
+
+    // on_data returning false cancels the call, and the client stays usable
+    int seen = 0;
+    r = config.client->post_stream(many_path, {}, "{}", std::chrono::milliseconds(3000),
+                                   [&](const std::string&) { return ++seen < 1; });
+    check(seen == 1, "no data is delivered after a cancel");
+    check(!r.ok() && r.error == "canceled by caller", "canceled stream reports the cancel");
+    int events = 0;
+    SseParser parser;
+    r = config.client->post_stream(many_path, {}, "{}", std::chrono::milliseconds(3000), [&](const std::string& c) {
+        parser.feed(c, [&](const std::string&, const std::string&) { events++; });
+        return true;
+    });
+    check(r.ok() && events == EVENT_COUNT, "connection is usable after a cancel");
+
+    config.client.reset();
+    svr.stop();
+    server.join();
+
+    if (failures == 0) std::cout << "[upstream_stream_test] ok\n";
+    return failures == 0 ? 0 : 1;
+}